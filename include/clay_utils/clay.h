@@ -865,6 +865,10 @@ CLAY_DLL_EXPORT void Clay_SetDebugModeEnabled(bool enabled);
 CLAY_DLL_EXPORT bool Clay_IsDebugModeEnabled(void);
 // Enables and disables visibility culling. By default, Clay will not generate render commands for elements whose bounding box is entirely outside the screen.
 CLAY_DLL_EXPORT void Clay_SetCullingEnabled(bool enabled);
+// Enables and disables incremental layout. When enabled, Clay diffs each element against the previous frame by ID, skips sizing for subtrees whose
+// configs and children are unchanged, and re-emits their render commands from the previous frame rather than regenerating them.
+// This state is retained and does not need to be set each frame.
+CLAY_DLL_EXPORT void Clay_SetIncrementalLayoutEnabled(bool enabled);
 // Returns the maximum number of UI elements supported by Clay's current configuration.
 CLAY_DLL_EXPORT int32_t Clay_GetMaxElementCount(void);
 // Modifies the maximum number of UI elements supported by Clay's current configuration.
@@ -1100,6 +1104,7 @@ typedef struct {
     Clay_LayoutConfig *layoutConfig;
     Clay__ElementConfigArraySlice elementConfigs;
     uint32_t id;
+    uint32_t layoutHash; // Only calculated when incremental layout is enabled
 } Clay_LayoutElement;
 
 CLAY__ARRAY_DEFINE(Clay_LayoutElement, Clay_LayoutElementArray)
@@ -1138,6 +1143,13 @@ typedef struct { // todo get this struct into a single cache line
     uint32_t generation;
     uint32_t idAlias;
     Clay__DebugElementData *debugData;
+    // Incremental layout - the result of laying out this element in the generation it was last laid out
+    Clay_Dimensions cachedDimensions;
+    uint32_t cachedLayoutHash;
+    uint32_t cachedGeneration;
+    int32_t cachedRenderCommandStart;
+    int32_t cachedRenderCommandCount;
+    int16_t cachedZIndex;
 } Clay_LayoutElementHashMapItem;
 
 CLAY__ARRAY_DEFINE(Clay_LayoutElementHashMapItem, Clay__LayoutElementHashMapItemArray)
@@ -1197,6 +1209,10 @@ struct Clay_Context {
     bool debugModeEnabled;
     bool disableCulling;
     bool externalScrollHandlingEnabled;
+    bool incrementalLayoutEnabled;
+    bool incrementalLayoutCacheValid;
+    bool incrementalLayoutInvalidated;
+    Clay_Dimensions incrementalLayoutDimensions;
     uint32_t debugSelectedElementId;
     uint32_t generation;
     uintptr_t arenaResetOffset;
@@ -1206,6 +1222,9 @@ struct Clay_Context {
     // Layout Elements / Render Commands
     Clay_LayoutElementArray layoutElements;
     Clay_RenderCommandArray renderCommands;
+    Clay__int32_tArray renderCommandTextElementIds;
+    Clay_RenderCommandArray renderCommandCache;
+    Clay__int32_tArray renderCommandCacheTextElementIds;
     Clay__int32_tArray openLayoutElementStack;
     Clay__int32_tArray layoutElementChildren;
     Clay__int32_tArray layoutElementChildrenBuffer;
@@ -1497,6 +1516,30 @@ uint32_t Clay__HashStringContentsWithConfig(Clay_String *text, Clay_TextElementC
     return hash + 1; // Reserve the hash result of zero as "null id"
 }
 
+uint32_t Clay__HashBytes(uint32_t hash, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++) {
+        hash += bytes[i];
+        hash += (hash << 10);
+        hash ^= (hash >> 6);
+    }
+    return hash;
+}
+
+uint32_t Clay__HashElementConfig(uint32_t hash, Clay_ElementConfig *config) {
+    hash = Clay__HashBytes(hash, &config->type, sizeof(Clay__ElementConfigType));
+    switch (config->type) {
+        case CLAY__ELEMENT_CONFIG_TYPE_BORDER: return Clay__HashBytes(hash, config->config.borderElementConfig, sizeof(Clay_BorderElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_FLOATING: return Clay__HashBytes(hash, config->config.floatingElementConfig, sizeof(Clay_FloatingElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_SCROLL: return Clay__HashBytes(hash, config->config.scrollElementConfig, sizeof(Clay_ScrollElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_IMAGE: return Clay__HashBytes(hash, config->config.imageElementConfig, sizeof(Clay_ImageElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_TEXT: return Clay__HashBytes(hash, config->config.textElementConfig, sizeof(Clay_TextElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_CUSTOM: return Clay__HashBytes(hash, config->config.customElementConfig, sizeof(Clay_CustomElementConfig));
+        case CLAY__ELEMENT_CONFIG_TYPE_SHARED: return Clay__HashBytes(hash, config->config.sharedElementConfig, sizeof(Clay_SharedElementConfig));
+        default: return hash;
+    }
+}
+
 Clay__MeasuredWord *Clay__AddMeasuredWord(Clay__MeasuredWord word, Clay__MeasuredWord *previousWord) {
     Clay_Context* context = Clay_GetCurrentContext();
     if (context->measuredWordsFreeList.length > 0) {
@@ -1712,6 +1755,20 @@ Clay_LayoutElementHashMapItem *Clay__GetHashMapItem(uint32_t id) {
     return &Clay_LayoutElementHashMapItem_DEFAULT;
 }
 
+// Returns the hash map item for an element if it was laid out in the previous frame with an identical declaration, otherwise NULL
+Clay_LayoutElementHashMapItem *Clay__GetIncrementalLayoutCacheItem(Clay_LayoutElement *layoutElement) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    if (!context->incrementalLayoutEnabled || context->incrementalLayoutInvalidated) {
+        return CLAY__NULL;
+    }
+    Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(layoutElement->id);
+    // Elements with duplicate IDs share a hash map item, so only the element that owns the item can use its cache
+    if (hashMapItem->layoutElement != layoutElement || hashMapItem->cachedGeneration + 1 != context->generation || hashMapItem->cachedLayoutHash != layoutElement->layoutHash) {
+        return CLAY__NULL;
+    }
+    return hashMapItem;
+}
+
 Clay_ElementId Clay__GenerateIdForAnonymousElement(Clay_LayoutElement *openLayoutElement) {
     Clay_Context* context = Clay_GetCurrentContext();
     Clay_LayoutElement *parentElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&context->openLayoutElementStack, context->openLayoutElementStack.length - 2));
@@ -1845,6 +1902,19 @@ void Clay__CloseElement(void) {
 
     Clay__UpdateAspectRatioBox(openLayoutElement);
 
+    // Summarise the declaration of this element and its children so it can be diffed against the previous frame
+    if (context->incrementalLayoutEnabled) {
+        uint32_t layoutHash = Clay__HashBytes(openLayoutElement->layoutHash + openLayoutElement->id, layoutConfig, sizeof(Clay_LayoutConfig));
+        for (int32_t i = 0; i < openLayoutElement->elementConfigs.length; i++) {
+            layoutHash = Clay__HashElementConfig(layoutHash, Clay__ElementConfigArraySlice_Get(&openLayoutElement->elementConfigs, i));
+        }
+        for (int32_t i = 0; i < openLayoutElement->childrenOrTextContent.children.length; i++) {
+            Clay_LayoutElement *child = Clay_LayoutElementArray_Get(&context->layoutElements, openLayoutElement->childrenOrTextContent.children.elements[i]);
+            layoutHash = Clay__HashBytes(layoutHash, &child->layoutHash, sizeof(uint32_t));
+        }
+        openLayoutElement->layoutHash = layoutHash;
+    }
+
     bool elementIsFloating = Clay__ElementHasConfig(openLayoutElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING);
 
     // Close the currently open element
@@ -1969,6 +2039,9 @@ void Clay__OpenTextElement(Clay_String text, Clay_TextElementConfig *textConfig)
             .internalArray = Clay__ElementConfigArray_Add(&context->elementConfigs, CLAY__INIT(Clay_ElementConfig) { .type = CLAY__ELEMENT_CONFIG_TYPE_TEXT, .config = { .textElementConfig = textConfig }})
     };
     textElement->layoutConfig = &CLAY_LAYOUT_DEFAULT;
+    if (context->incrementalLayoutEnabled) {
+        textElement->layoutHash = Clay__HashBytes(Clay__HashStringContentsWithConfig(&text, textConfig) + elementId.id, textConfig, sizeof(Clay_TextElementConfig));
+    }
     parentElement->childrenOrTextContent.children.length++;
 }
 
@@ -2093,6 +2166,10 @@ void Clay__ConfigureOpenElementPtr(const Clay_ElementDeclaration *declaration) {
         if (context->externalScrollHandlingEnabled) {
             scrollOffset->scrollPosition = Clay__QueryScrollOffset(scrollOffset->elementId, context->queryScrollOffsetUserData);
         }
+        // Scrolling moves the children without changing any declarations, so it has to invalidate the cached layout
+        if (context->incrementalLayoutEnabled) {
+            openLayoutElement->layoutHash = Clay__HashBytes(openLayoutElement->layoutHash, &scrollOffset->scrollPosition, sizeof(Clay_Vector2));
+        }
     }
     if (!Clay__MemCmp((char *)(&declaration->border.width), (char *)(&Clay__BorderWidth_DEFAULT), sizeof(Clay_BorderWidth))) {
         Clay__AttachElementConfig(CLAY__INIT(Clay_ElementConfigUnion) { .borderElementConfig = Clay__StoreBorderElementConfig(declaration->border) }, CLAY__ELEMENT_CONFIG_TYPE_BORDER);
@@ -2132,6 +2209,7 @@ void Clay__InitializeEphemeralMemory(Clay_Context* context) {
     context->textElementData = Clay__TextElementDataArray_Allocate_Arena(maxElementCount, arena);
     context->imageElementPointers = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->renderCommands = Clay_RenderCommandArray_Allocate_Arena(maxElementCount, arena);
+    context->renderCommandTextElementIds = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->treeNodeVisited = Clay__boolArray_Allocate_Arena(maxElementCount, arena);
     context->treeNodeVisited.length = context->treeNodeVisited.capacity; // This array is accessed directly rather than behaving as a list
     context->openClipElementStack = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
@@ -2156,6 +2234,8 @@ void Clay__InitializePersistentMemory(Clay_Context* context) {
     context->measuredWords = Clay__MeasuredWordArray_Allocate_Arena(maxMeasureTextCacheWordCount, arena);
     context->pointerOverIds = Clay__ElementIdArray_Allocate_Arena(maxElementCount, arena);
     context->debugElementData = Clay__DebugElementDataArray_Allocate_Arena(maxElementCount, arena);
+    context->renderCommandCache = Clay_RenderCommandArray_Allocate_Arena(maxElementCount, arena);
+    context->renderCommandCacheTextElementIds = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->arenaResetOffset = arena->nextAllocation;
 }
 
@@ -2166,6 +2246,36 @@ bool Clay__FloatEqual(float left, float right) {
     return subtracted < CLAY__EPSILON && subtracted > -CLAY__EPSILON;
 }
 
+// Incremental layout - an unchanged element that has been given the same size as last frame will size its children exactly as it did last frame,
+// so their sizes can be copied from the cache instead of being recalculated
+bool Clay__RestoreCachedChildSizes(Clay_LayoutElement *parent, bool xAxis, Clay__int32_tArray *bfsBuffer) {
+    Clay_LayoutElementHashMapItem *parentItem = Clay__GetIncrementalLayoutCacheItem(parent);
+    if (!parentItem || !Clay__FloatEqual(parent->dimensions.width, parentItem->cachedDimensions.width) || (!xAxis && !Clay__FloatEqual(parent->dimensions.height, parentItem->cachedDimensions.height))) {
+        return false;
+    }
+    Clay_Context* context = Clay_GetCurrentContext();
+    for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
+        Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, parent->childrenOrTextContent.children.elements[childOffset]);
+        if (!Clay__GetIncrementalLayoutCacheItem(childElement)) {
+            return false;
+        }
+    }
+    for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
+        int32_t childElementIndex = parent->childrenOrTextContent.children.elements[childOffset];
+        Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childElementIndex);
+        Clay_Dimensions cachedDimensions = Clay__GetHashMapItem(childElement->id)->cachedDimensions;
+        if (xAxis) {
+            childElement->dimensions.width = cachedDimensions.width;
+        } else {
+            childElement->dimensions.height = cachedDimensions.height;
+        }
+        if (!Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) && childElement->childrenOrTextContent.children.length > 0) {
+            Clay__int32_tArray_Add(bfsBuffer, childElementIndex);
+        }
+    }
+    return true;
+}
+
 void Clay__SizeContainersAlongAxis(bool xAxis) {
     Clay_Context* context = Clay_GetCurrentContext();
     Clay__int32_tArray bfsBuffer = context->layoutElementChildrenBuffer;
@@ -2197,6 +2307,9 @@ void Clay__SizeContainersAlongAxis(bool xAxis) {
         for (int32_t i = 0; i < bfsBuffer.length; ++i) {
             int32_t parentIndex = Clay__int32_tArray_GetValue(&bfsBuffer, i);
             Clay_LayoutElement *parent = Clay_LayoutElementArray_Get(&context->layoutElements, parentIndex);
+            if (Clay__RestoreCachedChildSizes(parent, xAxis, &bfsBuffer)) {
+                continue;
+            }
             Clay_LayoutConfig *parentStyleConfig = parent->layoutConfig;
             int32_t growContainerCount = 0;
             float parentSize = xAxis ? parent->dimensions.width : parent->dimensions.height;
@@ -2410,6 +2523,7 @@ void Clay__AddRenderCommand(Clay_RenderCommand renderCommand) {
     Clay_Context* context = Clay_GetCurrentContext();
     if (context->renderCommands.length < context->renderCommands.capacity - 1) {
         Clay_RenderCommandArray_Add(&context->renderCommands, renderCommand);
+        Clay__int32_tArray_Set(&context->renderCommandTextElementIds, context->renderCommands.length - 1, 0);
     } else {
         if (!context->booleanWarnings.maxRenderCommandsExceeded) {
             context->booleanWarnings.maxRenderCommandsExceeded = true;
@@ -2433,6 +2547,51 @@ bool Clay__ElementIsOffscreen(Clay_BoundingBox *boundingBox) {
            (boundingBox->y + boundingBox->height < 0);
 }
 
+// Copies an unchanged element's render commands from the previous frame, rather than walking its subtree to generate them again
+void Clay__EmitCachedRenderCommands(Clay_LayoutElementHashMapItem *cachedItem, Clay_LayoutElement *layoutElement) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    int32_t renderCommandStart = context->renderCommands.length;
+    for (int32_t i = 0; i < cachedItem->cachedRenderCommandCount; i++) {
+        int32_t cacheIndex = cachedItem->cachedRenderCommandStart + i;
+        Clay_RenderCommand renderCommand = *Clay_RenderCommandArray_Get(&context->renderCommandCache, cacheIndex);
+        uint32_t textElementId = (uint32_t)Clay__int32_tArray_GetValue(&context->renderCommandCacheTextElementIds, cacheIndex);
+        if (textElementId) {
+            // The text contents are unchanged, but they may now live at a different address
+            Clay_LayoutElement *textElement = Clay__GetHashMapItem(textElementId)->layoutElement;
+            if (textElement) {
+                Clay_StringSlice *stringContents = &renderCommand.renderData.text.stringContents;
+                const char *baseChars = textElement->childrenOrTextContent.textElementData->text.chars;
+                stringContents->chars = baseChars + (stringContents->chars - stringContents->baseChars);
+                stringContents->baseChars = baseChars;
+            }
+        }
+        int32_t previousLength = context->renderCommands.length;
+        Clay__AddRenderCommand(renderCommand);
+        if (context->renderCommands.length > previousLength) {
+            Clay__int32_tArray_Set(&context->renderCommandTextElementIds, context->renderCommands.length - 1, (int32_t)textElementId);
+        }
+    }
+
+    // Rebase the cached ranges of every element in the subtree so that they stay valid for the next frame
+    int32_t renderCommandOffset = renderCommandStart - cachedItem->cachedRenderCommandStart;
+    Clay__int32_tArray dfsBuffer = context->reusableElementIndexBuffer;
+    dfsBuffer.length = 0;
+    Clay__int32_tArray_Add(&dfsBuffer, (int32_t)(layoutElement - context->layoutElements.internalArray));
+    while (dfsBuffer.length > 0) {
+        Clay_LayoutElement *currentElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_RemoveSwapback(&dfsBuffer, (int)dfsBuffer.length - 1));
+        Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(currentElement->id);
+        if (hashMapItem->layoutElement == currentElement) {
+            hashMapItem->cachedRenderCommandStart += renderCommandOffset;
+            hashMapItem->cachedGeneration = context->generation;
+        }
+        if (!Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                Clay__int32_tArray_Add(&dfsBuffer, currentElement->childrenOrTextContent.children.elements[i]);
+            }
+        }
+    }
+}
+
 void Clay__CalculateFinalLayout(void) {
     Clay_Context* context = Clay_GetCurrentContext();
     // Calculate sizing along the X axis
@@ -2681,6 +2840,14 @@ void Clay__CalculateFinalLayout(void) {
                     currentElementBoundingBox.height += expand.height * 2;
                 }
 
+                // Incremental layout - if nothing about this element or its position has changed, neither have its render commands
+                Clay_LayoutElementHashMapItem *cachedItem = Clay__GetIncrementalLayoutCacheItem(currentElement);
+                if (cachedItem && cachedItem->cachedZIndex == root->zIndex && Clay__MemCmp((char *)&cachedItem->boundingBox, (char *)&currentElementBoundingBox, sizeof(Clay_BoundingBox))) {
+                    Clay__EmitCachedRenderCommands(cachedItem, currentElement);
+                    dfsBuffer.length--;
+                    continue;
+                }
+
                 Clay__ScrollContainerDataInternal *scrollContainerData = CLAY__NULL;
                 // Apply scroll offsets to container
                 if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
@@ -2709,6 +2876,7 @@ void Clay__CalculateFinalLayout(void) {
                 Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(currentElement->id);
                 if (hashMapItem) {
                     hashMapItem->boundingBox = currentElementBoundingBox;
+                    hashMapItem->cachedRenderCommandStart = context->renderCommands.length;
                     if (hashMapItem->idAlias) {
                         Clay_LayoutElementHashMapItem *hashMapItemAlias = Clay__GetHashMapItem(hashMapItem->idAlias);
                         if (hashMapItemAlias) {
@@ -2826,6 +2994,7 @@ void Clay__CalculateFinalLayout(void) {
                                     .zIndex = root->zIndex,
                                     .commandType = CLAY_RENDER_COMMAND_TYPE_TEXT,
                                 });
+                                Clay__int32_tArray_Set(&context->renderCommandTextElementIds, context->renderCommands.length - 1, (int32_t)currentElement->id);
                                 yPosition += finalLineHeight;
 
                                 if (!context->disableCulling && (currentElementBoundingBox.y + yPosition > context->layoutDimensions.height)) {
@@ -2996,6 +3165,17 @@ void Clay__CalculateFinalLayout(void) {
                     });
                 }
 
+                if (context->incrementalLayoutEnabled) {
+                    Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(currentElement->id);
+                    if (hashMapItem->layoutElement == currentElement) {
+                        hashMapItem->cachedDimensions = currentElement->dimensions;
+                        hashMapItem->cachedLayoutHash = currentElement->layoutHash;
+                        hashMapItem->cachedGeneration = context->generation;
+                        hashMapItem->cachedRenderCommandCount = context->renderCommands.length - hashMapItem->cachedRenderCommandStart;
+                        hashMapItem->cachedZIndex = root->zIndex;
+                    }
+                }
+
                 dfsBuffer.length--;
                 continue;
             }
@@ -4018,6 +4198,10 @@ void Clay_BeginLayout(void) {
     Clay__InitializeEphemeralMemory(context);
     context->generation++;
     context->dynamicElementIndex = 0;
+    // Culling and text line truncation depend on the layout dimensions, so cached render commands are only valid at the same size
+    context->incrementalLayoutInvalidated = !context->incrementalLayoutCacheValid
+        || !Clay__FloatEqual(context->incrementalLayoutDimensions.width, context->layoutDimensions.width)
+        || !Clay__FloatEqual(context->incrementalLayoutDimensions.height, context->layoutDimensions.height);
     // Set up the root container that covers the entire window
     Clay_Dimensions rootDimensions = {context->layoutDimensions.width, context->layoutDimensions.height};
     if (context->debugModeEnabled) {
@@ -4058,6 +4242,17 @@ Clay_RenderCommandArray Clay_EndLayout(void) {
     } else {
         Clay__CalculateFinalLayout();
     }
+    if (context->incrementalLayoutEnabled) {
+        // Keep this frame's render commands around so unchanged subtrees can re-emit them next frame
+        context->renderCommandCache.length = 0;
+        context->renderCommandCacheTextElementIds.length = 0;
+        for (int32_t i = 0; i < context->renderCommands.length; i++) {
+            Clay_RenderCommandArray_Add(&context->renderCommandCache, context->renderCommands.internalArray[i]);
+            Clay__int32_tArray_Add(&context->renderCommandCacheTextElementIds, context->renderCommandTextElementIds.internalArray[i]);
+        }
+        context->incrementalLayoutCacheValid = !context->booleanWarnings.maxElementsExceeded && !context->booleanWarnings.maxRenderCommandsExceeded && !context->debugModeEnabled;
+        context->incrementalLayoutDimensions = context->layoutDimensions;
+    }
     return context->renderCommands;
 }
 
@@ -4165,6 +4360,14 @@ CLAY_WASM_EXPORT("Clay_SetCullingEnabled")
 void Clay_SetCullingEnabled(bool enabled) {
     Clay_Context* context = Clay_GetCurrentContext();
     context->disableCulling = !enabled;
+    context->incrementalLayoutCacheValid = false;
+}
+
+CLAY_WASM_EXPORT("Clay_SetIncrementalLayoutEnabled")
+void Clay_SetIncrementalLayoutEnabled(bool enabled) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    context->incrementalLayoutEnabled = enabled;
+    context->incrementalLayoutCacheValid = false;
 }
 
 CLAY_WASM_EXPORT("Clay_SetExternalScrollHandlingEnabled")
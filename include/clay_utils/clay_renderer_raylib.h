@@ -3,6 +3,7 @@
 
 #include "raylib.h"
 #include "clay.h"
+#include "glyph_cache.h"
 
 // Camera for 3D models
 extern Camera Raylib_camera;
@@ -17,6 +18,11 @@ Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text,
                                   Clay_TextElementConfig *config,
                                   void *userData);
 
+// Per-character x offsets for a line, consistent with Raylib_MeasureText
+void Raylib_MeasureGlyphOffsets(Clay_StringSlice text,
+                                Clay_TextElementConfig *config,
+                                void *userData, float *offsets);
+
 // Initialize the Raylib window and settings
 void Clay_Raylib_Initialize(int width, int height, const char *title,
                           unsigned int flags);
@@ -25,6 +31,7 @@ void Clay_Raylib_Initialize(int width, int height, const char *title,
 void Clay_Raylib_Close(void);
 
 // Render Clay commands using Raylib
-void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font *fonts);
+void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands,
+                        glyph_cache **fonts);
 
 #endif // CLAY_RENDERER_RAYLIB_H
\ No newline at end of file
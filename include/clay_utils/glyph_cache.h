@@ -0,0 +1,72 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "raylib.h"
+
+#define GLYPH_PAGE_SIZE 1024      // atlas page width and height in pixels
+#define GLYPH_CACHE_MAX_PAGES 4   // pages per font before eviction kicks in
+#define GLYPH_TABLE_INIT_SIZE 512 // hash slots, always a power of two
+#define GLYPH_PADDING 1           // empty pixels kept around every bitmap
+
+#define GLYPH_PAGE_NONE -1     // bitmap not resident, or nothing to draw
+#define GLYPH_PAGE_FALLBACK -2 // bitmap lives in the raylib default font
+
+// Metrics of a single codepoint and where its bitmap sits in the atlas. The
+// metrics outlive the bitmap, an evicted glyph only needs rasterizing again
+// once it is drawn
+typedef struct {
+  uint32_t codepoint;
+  bool occupied;
+  int page;
+  Rectangle rec; // source rectangle within the page, empty for blank glyphs
+  float offset_x;
+  float offset_y;
+  float advance;
+} cached_glyph;
+
+// Atlas page, a CPU copy of the texture plus a shelf packer. New bitmaps are
+// only written to the copy, the dirty rows are uploaded in one go the next
+// time anything is drawn from the font
+typedef struct {
+  Texture2D texture;
+  unsigned char *pixels; // gray alpha, NULL until the page is first used
+  int pen_x;
+  int pen_y;
+  int shelf_height;
+  int dirty_y0;
+  int dirty_y1; // dirty_y0 == dirty_y1 when the page is uploaded
+  uint64_t last_used;
+} glyph_page;
+
+// Glyph Cache, rasterizes the codepoints of one font on first use. A bitmap
+// cache is tied to its base size, an SDF cache stores distance fields that
+// the shader turns into sharp edges at any size
+typedef struct {
+  unsigned char *file_data;
+  int file_size;
+  int base_size;
+  bool sdf;
+  Shader shader; // draw SDF glyphs with this active
+  Font fallback; // used when the font file could not be read
+
+  cached_glyph *glyphs;
+  size_t glyph_cap;
+  size_t glyph_count;
+
+  glyph_page pages[GLYPH_CACHE_MAX_PAGES];
+  int current_page;
+  uint64_t clock;
+  bool dirty;
+} glyph_cache;
+
+void glyph_cache_load(glyph_cache *cache, const char *font_path,
+                      int base_size, bool sdf);
+void glyph_cache_unload(glyph_cache *cache);
+cached_glyph glyph_cache_get(glyph_cache *cache, uint32_t codepoint);
+Texture2D glyph_cache_texture(glyph_cache *cache, cached_glyph *glyph);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "piece_table.h"
+
+#define LOADER_FIRST_CHUNK_BYTES (64 << 10) // counted alone, for the first screen
+#define LOADER_CHUNK_BYTES (4 << 20)        // most bytes taken in per frame
+#define LOADER_SNIFF_BYTES 4096             // bytes the encoding is told from
+#define LOADER_FOLLOW_RESERVE_BYTES ((size_t)256 << 30) // most a file can grow to
+#define LOADER_FOLLOW_POLL_MS 250 // checks without an event, inotify can't
+                                  // see writes over some network filesystems
+
+typedef enum {
+  FILE_UTF8,
+  FILE_UTF8_BOM,
+  FILE_UTF16_LE,
+  FILE_UTF16_BE,
+  FILE_LATIN1, // not valid UTF-8
+  FILE_BINARY, // has NUL bytes
+} file_encoding;
+
+// File Loader, maps a file on a worker thread and counts its codepoints a
+// chunk at a time for the table to take in as they come. Chunks start small
+// so the first screen shows before the rest is read, and double from there.
+// The worker counts one chunk ahead of the table and then waits for it to be
+// taken, so a frame never takes in more than LOADER_CHUNK_BYTES.
+// A followed file is copied into memory with room to grow into, once the end
+// is read the worker waits on inotify for appends and hands them over as more
+// chunks
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock; // guards the fields below
+  pthread_cond_t wake;  // signalled when a chunk is taken and on cancel
+  int fd;               // closed by the worker once mapped, or when it stops
+                        // following
+  int watch_fd;         // inotify instance, -1 if not following
+  bool follow;
+  size_t len;   // size of the file as of the last take, read without the lock
+  size_t grown; // size of the file as the worker last saw it
+  char *buf;            // the mapped or copied file, set before the first
+                        // chunk
+  file_encoding encoding; // told from the first bytes, before the first chunk
+  size_t read;     // bytes counted by the worker
+  size_t read_cps; // codepoints in them
+  size_t taken;    // bytes the table took in
+  size_t taken_cps;
+  bool cancel;
+  bool done; // the worker stopped, at the end of the file or cancelled
+} file_loader;
+
+void file_loader_start(file_loader *fl, const char *path, bool follow);
+void file_loader_stop(file_loader *fl);
+void file_loader_cancel(file_loader *fl);
+bool file_loader_take(file_loader *fl, piece_table *ptbl_p, size_t *pos_p);
+bool file_loader_busy(file_loader *fl);
+const char *file_encoding_name(file_encoding encoding);
+
+#endif
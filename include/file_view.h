@@ -0,0 +1,51 @@
+#ifndef FILE_VIEW_H
+#define FILE_VIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rx.h"
+
+#define VIEW_PAGE_BYTES (1 << 20)   // bytes read from the file at a time
+#define VIEW_CACHE_BYTES (64 << 20) // memory budget of the page cache
+#define VIEW_WINDOW_BYTES (4 << 20) // text the piece table holds at a time
+#define VIEW_FIND_BYTES (256 << 20) // bytes one find step reads past the window
+#define VIEW_FIND_OVERLAP 4096      // longer regex matches across pages are missed
+#define VIEW_AUTO_MIN_BYTES ((size_t)64 << 30) // files this large open read only
+
+// a page of the file, LRU stamped
+typedef struct {
+  size_t page; // index + 1 of the page held, 0 if none
+  uint64_t used;
+  size_t len;  // bytes read, short for the last page of the file
+  char *data;
+} view_page;
+
+// File View, reads a file that is too large to map or index through a cache
+// of fixed size pages read with pread, the least recently used page is read
+// over first. The piece table only holds a window of the file, moved along
+// as the view scrolls, so memory stays within the cache budget plus a window
+typedef struct {
+  int fd;
+  size_t len; // size of the file
+  view_page *pages;
+  size_t num_pages; // pages the budget has room for
+  uint64_t clock;
+  size_t hits;
+  size_t misses;
+  char *scratch; // a page and the overlap after it, for find
+  size_t win_start; // file offset of the window the table holds
+  size_t win_len;
+} file_view;
+
+void file_view_open(file_view *fv, const char *path, size_t budget);
+void file_view_close(file_view *fv);
+size_t file_view_read(file_view *fv, size_t pos, size_t len, char *out,
+                      bool keep);
+char *file_view_window(file_view *fv, size_t around, size_t *cps_p);
+bool file_view_find(file_view *fv, size_t from, bool forward,
+                    const char *query, size_t query_len, rx_regex *rx,
+                    size_t *start_p, size_t *len_p, size_t *stop_p);
+
+#endif
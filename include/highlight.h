@@ -0,0 +1,106 @@
+#ifndef HIGHLIGHT_H
+#define HIGHLIGHT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "piece_table.h"
+#include "wrap_index.h"
+
+#define HIGHLIGHT_SYNC_LINES 1024     // lexed on the spot, the worker does the rest
+#define HIGHLIGHT_PUBLISH_LINES 65536 // worker results are handed over in steps
+#define HL_STATE_UNKNOWN 0xFF         // line not lexed yet, draw as plain text
+
+// Styles a lexer assigns to every byte, the renderer maps them to colours
+typedef enum {
+  HL_NORMAL,
+  HL_KEYWORD,
+  HL_TYPE,
+  HL_NUMBER,
+  HL_STRING,
+  HL_COMMENT,
+  HL_PREPROC,
+  HL_PUNCT,
+  HL_HEADING,
+  HL_EMPHASIS,
+  HL_CODE,
+  HL_LINK,
+  HL_ERROR,
+  HL_WARNING,
+  HL_INFO,
+  HL_DEBUG,
+  HL_STYLE_COUNT,
+} hl_style;
+
+// Language, a state machine over byte classes plus a keyword list, see
+// highlight.c. NULL stands for plain text
+typedef struct hl_language hl_language;
+
+const hl_language *hl_language_by_name(const char *name);
+const hl_language *hl_language_for_path(const char *path);
+const char *hl_language_name(const hl_language *lang);
+uint8_t hl_initial_state(const hl_language *lang);
+uint8_t hl_lex(const hl_language *lang, uint8_t state, const char *text,
+               size_t len, uint8_t *styles);
+
+// Highlighter, caches the lexer state at the start of every line. Lines near
+// the ones drawn are lexed on the spot, the worker fills in the rest. An edit
+// re-lexes from its first line until the states agree with the cache again
+typedef struct {
+  const hl_language *lang;
+  uint8_t *states;  // state at the start of line i + 1
+  size_t num_lines; // lines of the table at the last update
+  size_t valid;     // states[0, valid) are exact
+  size_t known;     // states[valid, known) predate the last edits, still
+                    // right for most lines and drawn until replaced
+  size_t cap;
+  size_t version;           // bumped by every edit
+  size_t requested_version; // version the worker was last asked to lex
+  size_t lexed;     // lines lexed so far, to see how much an edit cost
+} highlighter;
+
+// Highlight Worker, lexes the rest of the table from a snapshot on its own
+// thread and hands the line states back tagged with the version they are for
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;        // guards the request/result fields below
+  pthread_cond_t wake;         // signalled on new requests and on quit
+  pthread_mutex_t *table_lock; // needed to release snapshots
+  piece_table *ptbl_p;
+  const hl_language *lang;
+
+  // request
+  ptbl_snapshot req_snap;
+  size_t req_line; // lex from the start of this line
+  size_t req_pos;
+  uint8_t req_state;
+  size_t req_num_lines;
+  size_t req_version;
+  bool pending;
+  bool quit;
+
+  // result, res_states[i] is the state at the start of line res_line + i + 1
+  uint8_t *res_states;
+  size_t res_cap;
+  size_t res_line;
+  size_t res_done;
+  size_t res_version;
+} highlight_worker;
+
+void highlight_init(highlighter *hl, const hl_language *lang);
+void highlight_free(highlighter *hl);
+void highlight_reset(highlighter *hl, size_t num_lines);
+void highlight_splice(highlighter *hl, piece_table *ptbl_p, wrap_index *wi,
+                      size_t start, size_t removed, size_t inserted);
+uint8_t highlight_state_at(highlighter *hl, piece_table *ptbl_p,
+                           wrap_index *wi, size_t line, bool *exact_p);
+void highlight_worker_start(highlight_worker *hw, piece_table *ptbl_p,
+                            pthread_mutex_t *table_lock,
+                            const hl_language *lang);
+void highlight_worker_stop(highlight_worker *hw);
+bool highlight_update(highlighter *hl, highlight_worker *hw,
+                      piece_table *ptbl_p, wrap_index *wi);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef LINE_SCAN_H
+#define LINE_SCAN_H
+
+#include <stddef.h>
+
+// Line Scan, finds line breaks in a span of bytes a vector block at a time
+// (SSE2, AVX2 or AVX-512 masks, picked per call from what the CPU supports)
+// so line structure is built at close to memory bandwidth
+
+size_t line_scan_count(const char *s, size_t len);
+size_t line_scan_skip(const char *s, size_t len, size_t *lines_p);
+size_t line_scan_next(const char *s, size_t len, size_t *tabs_p);
+
+#endif
@@ -9,14 +9,19 @@
 #define BLUE_C "\x1b[34m"
 #define RESET "\x1b[0m"
 
-#define EDIT_TEXT_BUFFER_MAX_SIZE 256
-#define MAX_LINE_BREAKS 256
+#define EDIT_TEXT_BUFFER_MAX_SIZE 65536 // only holds the visible window of text
+#define MAX_LINE_BREAKS 256            // max number of lines in the window
+#define GRAPHEME_SPAN_BYTES 32 // copied around the cursor to step a cluster
+                               // when its row isn't loaded
 
 // Append Only Buffer
 typedef struct {
   size_t capacity; // current capacity of internal buffer
   size_t len;      // current length of internal buffer
   char *buf;       // internal buffer (not null terminated)
+  int pins;        // snapshots reading buf, it doesn't move while pinned
+  char **retired;  // blocks outgrown while pinned, freed once unpinned
+  size_t num_retired;
 } append_only_buffer;
 
 // Type that marks which buffer a piece references
@@ -30,6 +35,7 @@ typedef struct {
   buffer_type buf_type; // denotes buffer to look into
   size_t start;         // starting character of piece
   size_t len;           // length of piece
+  size_t cp_len;        // number of UTF-8 codepoints in piece
 } piece;
 
 // Linked list of pieces, pl = "piece list"
@@ -48,8 +54,24 @@ typedef struct {
   size_t global_cursor_pos;      // position of cursor in table
   size_t local_cursor_pos;       // position of cursor in piece
   pl_node *cursor_hint;          // piece list node containing cursor
+  size_t selection_anchor;       // fixed end of the selection, the cursor is
+                                 // the end that moves
+  int selection_active;          // whether selection_anchor is set
+  size_t edit_start;    // pending edit, [edit_start, edit_start +
+  size_t edit_removed;  // edit_removed) of the text before the edits became
+  size_t edit_inserted; // [edit_start, edit_start + edit_inserted)
+  int edit_pending;     // whether there are edits not taken yet
 } piece_table;
 
+// Piece Table Snapshot, the text of every piece at one point in time. Stays
+// readable without the table lock while the table is edited, until released
+typedef struct {
+  const char **chars;
+  size_t *lens;
+  size_t num_pieces;
+  size_t len;
+} ptbl_snapshot;
+
 // Piece Table Iterator
 typedef struct {
   piece_table *ptbl_p;      // pointer to piece table
@@ -57,16 +79,24 @@ typedef struct {
   size_t piece_index;       // index of character in reference to current piece
 } piece_table_iterator;
 
-// export data to be used in a rendering engine
+// export data to be used in a rendering engine, only the lines in
+// [first_line, first_line + window_lines) are materialized
 typedef struct {
   char edit_text_buf[EDIT_TEXT_BUFFER_MAX_SIZE];
   size_t edit_text_len;
 
   int line_break_pos[MAX_LINE_BREAKS];
-  size_t num_line_breaks;
-  char line_numbers[MAX_LINE_BREAKS][8];
+  size_t num_line_breaks;        // line breaks within the window
+  char line_numbers[MAX_LINE_BREAKS][24]; // indexed by row in the window
+
+  size_t first_line;   // line number of the first row in the window
+  size_t first_line_pos; // table position of the start of the window
+  size_t window_lines; // number of lines requested for the window
+  size_t total_lines;  // lines up to the end of the window, all of the
+                       // table's only when the window reaches its end
 
-  size_t cursor_line;
+  size_t cursor_line;  // SIZE_MAX past the window, and before it when the
+                       // load seeked
   size_t cursor_offset;
 } render_buffers;
 
@@ -77,13 +107,44 @@ piece_table_iterator create_ptbl_iterator(piece_table *ptbl_p);
 char query_ptbl_iterator(piece_table_iterator *pti_p);
 void advance_ptbl_iterator(piece_table_iterator *pti_p);
 int ptbl_iterator_end(piece_table_iterator *pti_p);
-void create_line_number(render_buffers *render_bufs_p, size_t line);
-void load_ptbl_data(piece_table *ptbl_p, render_buffers *render_bufs_p);
+void create_line_number(render_buffers *render_bufs_p, size_t row);
+void load_ptbl_data(piece_table *ptbl_p, render_buffers *render_bufs_p,
+                    size_t first_line, size_t first_line_pos,
+                    size_t window_lines);
 void pl_place_between(pl_node *x, pl_node *y, pl_node *z);
 void aob_append_char(append_only_buffer *add_buffer_p, char c);
+void aob_append_text(append_only_buffer *add_buffer_p, const char *text,
+                     size_t len);
 void ptbl_insert_char(piece_table *ptbl_p, char c);
+void ptbl_insert_text(piece_table *ptbl_p, const char *text, size_t len);
 void ptbl_delete_char(piece_table *ptbl_p);
 void ptbl_update_global_cursor_pos(piece_table *ptbl_p, size_t new_global_cursor_pos);
+size_t ptbl_length(piece_table *ptbl_p);
+size_t pl_codepoints_before(piece_table *ptbl_p, piece *p, size_t at);
+size_t ptbl_codepoint_index(piece_table *ptbl_p, size_t pos);
+size_t ptbl_codepoint_pos(piece_table *ptbl_p, size_t cp_index);
+const char *ptbl_piece_chars(piece_table *ptbl_p, piece *p);
+size_t ptbl_copy_range(piece_table *ptbl_p, size_t start, size_t len, char *out);
+void ptbl_delete_range(piece_table *ptbl_p, size_t start, size_t len);
+size_t ptbl_grapheme_step(piece_table *ptbl_p, size_t pos, int direction);
+void ptbl_replace_all(piece_table *ptbl_p, const size_t *offsets,
+                      const size_t *lens, size_t count, const char *text,
+                      size_t len);
+void ptbl_start_selection(piece_table *ptbl_p);
+void ptbl_clear_selection(piece_table *ptbl_p);
+int ptbl_selection_range(piece_table *ptbl_p, size_t *start_p, size_t *end_p);
+void ptbl_delete_selection(piece_table *ptbl_p);
+void ptbl_indent_selection(piece_table *ptbl_p, char c);
+size_t ptbl_extend_original(piece_table *ptbl_p, char *buf, size_t len,
+                            size_t cp_len);
+void ptbl_replace_original(piece_table *ptbl_p, char *buf, size_t len,
+                           size_t cp_len);
+void ptbl_note_edit(piece_table *ptbl_p, size_t start, size_t removed,
+                    size_t inserted);
+int ptbl_take_edit(piece_table *ptbl_p, size_t *start_p, size_t *removed_p,
+                   size_t *inserted_p);
+void ptbl_snapshot_take(piece_table *ptbl_p, ptbl_snapshot *snap_p);
+void ptbl_snapshot_release(piece_table *ptbl_p, ptbl_snapshot *snap_p);
 void ptbl_display(piece_table *ptbl_p);
 
 #endif // PIECE_TABLE_H
@@ -0,0 +1,44 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "piece_table.h"
+
+// Line Prefetcher, materializes a window of lines on a worker thread so the
+// main thread can pick it up once scrolling reaches it
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;       // guards the request/result fields below
+  pthread_cond_t wake;        // signalled on new requests and on quit
+  pthread_mutex_t table_lock; // held by whoever reads or mutates the table
+  piece_table *ptbl_p;
+
+  // request
+  size_t req_first_line;
+  size_t req_first_line_pos; // where the line starts, 0 to scan for it
+  size_t req_window_lines;
+  size_t req_version;
+  bool pending;
+  bool quit;
+
+  // result
+  render_buffers *scratch_p; // only touched by the worker
+  render_buffers *back_p;    // last completed window
+  size_t back_version;
+  bool ready;
+} line_prefetcher;
+
+void prefetch_start(line_prefetcher *lp, piece_table *ptbl_p);
+void prefetch_stop(line_prefetcher *lp);
+void prefetch_request(line_prefetcher *lp, size_t first_line,
+                      size_t first_line_pos, size_t window_lines,
+                      size_t version);
+bool prefetch_take(line_prefetcher *lp, render_buffers *render_bufs_p,
+                   size_t first_line, size_t num_lines, size_t version);
+bool render_buffers_cover(render_buffers *render_bufs_p, size_t first_line,
+                          size_t num_lines);
+
+#endif
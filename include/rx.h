@@ -0,0 +1,99 @@
+#ifndef RX_H
+#define RX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "piece_table.h"
+#include "search.h"
+
+#define RX_ICASE 1 // ASCII letters match either case
+
+#define RX_MAX_INSTS 65536     // program size a pattern may compile to
+#define RX_MAX_REPEAT 1000     // largest count in {m,n}
+#define RX_MAX_DEPTH 256       // group nesting
+#define RX_PREFIX_MAX 64       // literal prefix bytes handed to search_literal
+#define RX_DFA_MAX_STATES 2048 // cached DFA states, 1 KiB of transitions each
+#define RX_DFA_MAX_IDS 262144  // NFA state ids held by the cached DFA states
+#define RX_ACCEL_BYTES 3       // states leaving on at most this many bytes skip
+                               // ahead to them with search_any_byte
+
+// Instruction of a Thompson NFA. Set instructions consume a byte in set,
+// the rest are epsilon moves. Split prefers out over out1
+typedef enum {
+  RX_OP_SET,
+  RX_OP_SPLIT,
+  RX_OP_BOL,
+  RX_OP_EOL,
+  RX_OP_MATCH,
+} rx_op;
+
+typedef struct {
+  uint8_t op;
+  uint32_t out;
+  uint32_t out1;
+  uint8_t set[32];
+} rx_inst;
+
+typedef struct {
+  rx_inst *insts;
+  size_t num;
+  size_t cap;
+  bool has_bol; // states then depend on whether a line break was consumed
+} rx_prog;
+
+// Lazy DFA, states are built from the NFA the first time they are reached
+// and cached up to a fixed budget, the cache is flushed when it runs out.
+// A state is the priority ordered list of NFA set, match and pending $
+// instructions, so leftmost-first semantics survive the subset construction
+typedef struct {
+  const rx_prog *prog;
+  bool longest; // keep going past a match instead of dropping lower priority
+                // threads
+  uint32_t *trans; // [state * 256 + byte], next state plus a matched flag
+  uint32_t *ids;   // NFA ids of every state back to back
+  size_t num_ids;
+  size_t max_ids;
+  size_t *state_off;
+  uint32_t *state_len;
+  uint8_t *state_flags;
+  size_t num_states;
+  uint32_t *table; // state + 1 by hash of its ids, 0 is empty
+  size_t flushes;
+  bool no_flush; // give up on new states instead of flushing
+  uint8_t *accel_len; // bytes leaving a state, RX_ACCEL_NONE if too many
+  uint8_t (*accel)[RX_ACCEL_BYTES];
+  uint32_t start_cache[4]; // start states by entry slot and line start
+  size_t start_flushes;    // flush the start states were cached at
+
+  // scratch, sized by the program
+  uint32_t *marks;
+  uint32_t gen;
+  uint32_t *stack;
+  uint32_t *list_a;
+  uint32_t *list_b;
+} rx_dfa;
+
+// Regex, compiled forwards for finding where matches end and backwards for
+// finding where they start
+typedef struct {
+  rx_prog fwd;
+  rx_prog rev;
+  uint32_t fwd_start;    // anchored entry
+  uint32_t fwd_loop;     // unanchored entry, tries every start position
+  uint32_t fwd_loop_any; // the byte the unanchored loop skips
+  uint32_t rev_start;
+  char prefix[RX_PREFIX_MAX]; // every match starts with these bytes
+  size_t prefix_len;
+  rx_dfa fwd_dfa;
+  rx_dfa rev_dfa;
+} rx_regex;
+
+rx_regex *rx_compile(const char *pattern, size_t len, int flags,
+                     const char **error_p);
+void rx_free(rx_regex *rx);
+size_t rx_search(rx_regex *rx, const ptbl_snapshot *snap_p, size_t from,
+                 size_t to, search_results *out);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "piece_table.h"
+
+// Search Results, document offsets of matches in ascending order and the
+// length of each
+typedef struct {
+  size_t *offsets;
+  size_t *lens;
+  size_t count;
+  size_t cap;
+} search_results;
+
+void search_results_push(search_results *sr, size_t offset, size_t len);
+void search_results_free(search_results *sr);
+size_t search_results_lower_bound(const search_results *sr, size_t pos);
+const char *search_any_byte(const char *p, const char *end,
+                            const uint8_t *bytes, size_t num_bytes);
+size_t search_literal(const ptbl_snapshot *snap_p, size_t from, size_t to,
+                      const char *needle, size_t needle_len,
+                      search_results *out);
+
+#endif
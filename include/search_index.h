@@ -0,0 +1,44 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+
+#include "piece_table.h"
+#include "rx.h"
+#include "search.h"
+
+#define SEARCH_INDEX_BLOCK 512   // matches per block
+#define SEARCH_INDEX_CONTEXT 256 // bytes either side of an edit a regex is
+                                 // searched again in
+
+typedef struct {
+  size_t offsets[SEARCH_INDEX_BLOCK]; // from the block's anchor, ascending
+  size_t lens[SEARCH_INDEX_BLOCK];
+} search_block;
+
+// Search Index, matches of a query kept in blocks of offsets relative to an
+// anchor, the first match of the block. Fenwick trees over the gaps between
+// anchors and over block sizes map matches and positions onto each other in
+// O(log n), an edit moves every match after it by changing a single gap
+typedef struct {
+  search_block **blocks;
+  size_t num_blocks;
+  size_t cap;
+  size_t *gaps;   // anchor of block i minus that of block i - 1
+  size_t *counts; // matches in block i
+  size_t *gap_tree; // fenwick trees over gaps and counts, 1-based
+  size_t *count_tree;
+  size_t count; // matches in every block
+} search_index;
+
+void search_index_free(search_index *si);
+void search_index_append(search_index *si, const search_results *sr);
+void search_index_copy(search_index *si, search_results *out);
+size_t search_index_lower_bound(search_index *si, size_t pos);
+void search_index_get(search_index *si, size_t i, size_t *offset_p,
+                      size_t *len_p);
+void search_index_update(search_index *si, const ptbl_snapshot *snap_p,
+                         size_t start, size_t removed, size_t inserted,
+                         const char *query, size_t query_len, rx_regex *rx);
+
+#endif
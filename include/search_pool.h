@@ -0,0 +1,64 @@
+#ifndef SEARCH_POOL_H
+#define SEARCH_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "piece_table.h"
+#include "search.h"
+
+#define SEARCH_MAX_THREADS 32
+#define SEARCH_RANGE_BYTES (1 << 22)        // bytes a worker scans per claim
+#define SEARCH_PARALLEL_MIN_BYTES (1 << 20) // smaller tables search inline
+
+// snapshot shared by the workers of one search
+typedef struct {
+  ptbl_snapshot snap;
+  int users;    // workers scanning it
+  bool retired; // released by the last user
+} search_snapshot;
+
+typedef struct {
+  search_results results;
+  bool done;
+} search_range;
+
+// Search Pool, splits a search of the table into byte ranges scanned on
+// worker threads. Ranges are merged back in document order as they finish,
+// so the first matches show up before the whole table is searched. A new
+// search cancels the one running
+typedef struct {
+  pthread_t threads[SEARCH_MAX_THREADS];
+  size_t num_threads;
+  pthread_mutex_t lock;        // guards every field below
+  pthread_cond_t wake;         // signalled on new searches and on quit
+  pthread_mutex_t *table_lock; // needed to release snapshots
+  piece_table *ptbl_p;
+  bool quit;
+
+  // search
+  size_t generation; // bumped by every search, stale ranges are dropped
+  search_snapshot *snap_p;
+  char *query;
+  size_t query_len;
+  bool regex;
+  search_range *ranges;
+  size_t num_ranges;
+  size_t next_range; // next range for a worker to claim
+  size_t published;  // ranges merged into results
+  size_t prev_end;   // end of the last regex match merged
+  bool merging;      // a worker is merging ranges into results
+
+  search_results results; // matches of the published ranges
+} search_pool;
+
+void search_pool_start(search_pool *sp, piece_table *ptbl_p,
+                       pthread_mutex_t *table_lock);
+void search_pool_stop(search_pool *sp);
+const char *search_pool_submit(search_pool *sp, const char *query,
+                               size_t query_len, bool regex);
+void search_pool_cancel(search_pool *sp);
+bool search_pool_poll(search_pool *sp, size_t *taken_p, search_results *out);
+
+#endif
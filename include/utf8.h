@@ -0,0 +1,26 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_REPLACEMENT_CHAR 0xFFFD
+
+// decodes the codepoint starting at s[0], invalid or truncated sequences
+// decode as a single UTF8_REPLACEMENT_CHAR byte
+uint32_t utf8_decode(const char *s, size_t len, size_t *size_p);
+size_t utf8_count_codepoints(const char *s, size_t len);
+int utf8_is_continuation(char c);
+
+// columns a codepoint takes in a monospace grid, 2 for East Asian wide and
+// fullwidth characters, 0 for combining marks
+int utf8_column_width(uint32_t cp);
+
+// Grapheme clusters, approximated with the rules that matter for editing:
+// CR LF, combining marks and other extenders, ZWJ sequences and regional
+// indicator pairs. pos is a byte offset into s.
+size_t utf8_next_grapheme(const char *s, size_t len, size_t pos);
+size_t utf8_prev_grapheme(const char *s, size_t len, size_t pos);
+size_t utf8_grapheme_start(const char *s, size_t len, size_t pos);
+
+#endif // UTF8_H
@@ -0,0 +1,87 @@
+#ifndef WRAP_INDEX_H
+#define WRAP_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "piece_table.h"
+
+#define WRAP_TAB_SIZE 4                     // columns a tab takes
+#define WRAP_MAX_THREADS 8                  // workers for a bulk rebuild
+#define WRAP_PARALLEL_MIN_BYTES (1 << 20)   // smaller tables build inline
+#define WRAP_SPARSE_MIN_BYTES (64 << 20)    // larger tables keep checkpoints
+#define WRAP_CHECKPOINT_LINES 256           // lines per checkpoint, edits let
+                                            // a block grow to twice this
+#define WRAP_BLOCK_CACHE 4                  // checkpoint blocks kept measured
+
+// Wrap State, greedy soft wrap over a monospace column grid. Bytes of one
+// logical line are fed in order, rows break after the last space that fits
+// or, for words longer than a row, before the codepoint that overflows
+typedef struct {
+  size_t cols;      // columns per visual row
+  size_t col;       // columns used in the current row
+  size_t rows;      // rows started so far
+  size_t pos;       // offset of the next byte in the line
+  size_t row_start; // offset the current row starts at
+  size_t break_pos; // offset after the last space in the row, or row_start
+  size_t break_col;
+
+  // codepoint being decoded
+  uint32_t cp;
+  size_t cp_start;
+  int cp_need;
+
+  size_t *starts; // optional, receives the offset every row starts at
+  size_t max_starts;
+} wrap_state;
+
+void wrap_begin(wrap_state *ws, size_t cols, size_t *starts,
+                size_t max_starts);
+void wrap_feed(wrap_state *ws, unsigned char c);
+void wrap_end(wrap_state *ws);
+size_t wrap_segments(const char *text, size_t len, size_t cols,
+                     size_t *starts, size_t max_starts);
+
+// per line counts of one checkpoint block, measured again from the table
+typedef struct {
+  size_t block; // index + 1 of the block held, 0 if none
+  size_t rows[2 * WRAP_CHECKPOINT_LINES];
+  size_t bytes[2 * WRAP_CHECKPOINT_LINES];
+} wrap_block;
+
+// Wrap Index, visual row count and byte length of every logical line with a
+// Fenwick tree over each, so rows, lines and positions map onto each other in
+// O(log n). Lines are numbered from 1, visual rows from 0.
+// Tables of WRAP_SPARSE_MIN_BYTES or more are indexed sparsely, an entry then
+// sums up a checkpoint block of lines and the lines inside a block are
+// measured again from the table when asked about, a few at a time cached
+typedef struct {
+  size_t num_lines;
+  size_t num_entries; // lines, or checkpoint blocks when sparse
+  size_t cap;
+  size_t *rows;      // visual rows of entry i
+  size_t *bytes;     // bytes of entry i, including its line breaks
+  size_t *lines;     // lines of entry i, sparse only
+  size_t *row_tree;  // fenwick trees over rows, bytes and lines, 1-based
+  size_t *byte_tree;
+  size_t *line_tree;
+  size_t cols;       // columns per visual row the rows were counted for
+  bool sparse;
+  piece_table *ptbl_p; // table blocks are measured from, sparse only
+  wrap_block cache[WRAP_BLOCK_CACHE];
+} wrap_index;
+
+void wrap_index_free(wrap_index *wi);
+void wrap_index_build(wrap_index *wi, piece_table *ptbl_p, size_t cols,
+                      size_t expected_len);
+void wrap_index_splice(wrap_index *wi, piece_table *ptbl_p, size_t start,
+                       size_t removed, size_t inserted);
+size_t wrap_index_rows(wrap_index *wi, size_t line);
+size_t wrap_index_total_rows(wrap_index *wi);
+size_t wrap_index_row_of_line(wrap_index *wi, size_t line);
+size_t wrap_index_line_at_row(wrap_index *wi, size_t row, size_t *sub_row_p);
+size_t wrap_index_line_start(wrap_index *wi, size_t line);
+size_t wrap_index_line_of_pos(wrap_index *wi, size_t pos);
+
+#endif
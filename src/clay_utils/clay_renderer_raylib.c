@@ -7,6 +7,9 @@
 
 #include "../../include/clay_utils/clay.h"
 #include "../../include/clay_utils/clay_renderer_raylib.h"
+#include "../../include/utf8.h"
+
+#define RAYLIB_TAB_SIZE 4
 
 #define CLAY_RECTANGLE_TO_RAYLIB_RECTANGLE(rectangle)                          \
   (Rectangle) {                                                                \
@@ -89,6 +92,15 @@ Ray GetScreenToWorldPointWithZDistance(Vector2 position, Camera camera,
   return ray;
 }
 
+// Unscaled advance of a single codepoint. Tabs are a fixed number of spaces
+// wide, the same as Raylib_DrawText draws them.
+static float Raylib_GlyphAdvance(glyph_cache *font, uint32_t codepoint) {
+  if (codepoint == '\t') {
+    return Raylib_GlyphAdvance(font, ' ') * RAYLIB_TAB_SIZE;
+  }
+  return glyph_cache_get(font, codepoint).advance;
+}
+
 Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text,
                                    Clay_TextElementConfig *config,
                                    void *userData) {
@@ -99,29 +111,19 @@ Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text,
   float lineTextWidth = 0;
 
   float textHeight = config->fontSize;
-  Font *fonts = (Font *)userData;
-  Font fontToUse = fonts[config->fontId];
-  // Font failed to load, likely the fonts are in the wrong place relative to
-  // the execution dir. RayLib ships with a default font, so we can continue
-  // with that built in one.
-  if (!fontToUse.glyphs) {
-    fontToUse = GetFontDefault();
-  }
+  glyph_cache *fontToUse = ((glyph_cache **)userData)[config->fontId];
 
-  float scaleFactor = config->fontSize / (float)fontToUse.baseSize;
+  float scaleFactor = config->fontSize / (float)fontToUse->base_size;
 
-  for (int i = 0; i < text.length; ++i) {
-    if (text.chars[i] == '\n') {
+  size_t size;
+  for (size_t i = 0; i < (size_t)text.length; i += size) {
+    uint32_t codepoint = utf8_decode(text.chars + i, text.length - i, &size);
+    if (codepoint == '\n') {
       maxTextWidth = fmax(maxTextWidth, lineTextWidth);
       lineTextWidth = 0;
       continue;
     }
-    int index = text.chars[i] - 32;
-    if (fontToUse.glyphs[index].advanceX != 0)
-      lineTextWidth += fontToUse.glyphs[index].advanceX;
-    else
-      lineTextWidth +=
-          (fontToUse.recs[index].width + fontToUse.glyphs[index].offsetX);
+    lineTextWidth += Raylib_GlyphAdvance(fontToUse, codepoint);
   }
 
   maxTextWidth = fmax(maxTextWidth, lineTextWidth);
@@ -132,6 +134,64 @@ Clay_Dimensions Raylib_MeasureText(Clay_StringSlice text,
   return textSize;
 }
 
+// Fills offsets[0..text.length] with the x position of every byte offset in
+// a single line of UTF-8 text, offsets[i] being the left edge of the
+// codepoint starting at byte i. The continuation bytes of a codepoint share
+// its left edge. Matches the widths returned by Raylib_MeasureText.
+void Raylib_MeasureGlyphOffsets(Clay_StringSlice text,
+                                Clay_TextElementConfig *config,
+                                void *userData, float *offsets) {
+  glyph_cache *fontToUse = ((glyph_cache **)userData)[config->fontId];
+  float scaleFactor = config->fontSize / (float)fontToUse->base_size;
+
+  float x = 0;
+  offsets[0] = 0;
+  size_t size;
+  for (size_t i = 0; i < (size_t)text.length; i += size) {
+    uint32_t codepoint = utf8_decode(text.chars + i, text.length - i, &size);
+    for (size_t j = 1; j < size; j++) {
+      offsets[i + j] = x * scaleFactor;
+    }
+    x += Raylib_GlyphAdvance(fontToUse, codepoint);
+    offsets[i + size] = x * scaleFactor;
+  }
+}
+
+// Draws a line of UTF-8 text glyph by glyph from the font's atlas pages, so
+// any codepoint the font has can show up. Tabs advance like RAYLIB_TAB_SIZE
+// spaces.
+static void Raylib_DrawText(glyph_cache *font, Clay_StringSlice text,
+                            Vector2 position, float fontSize, float spacing,
+                            Color tint) {
+  float scaleFactor = fontSize / (float)font->base_size;
+  float startX = position.x;
+  size_t size;
+  for (size_t i = 0; i < (size_t)text.length; i += size) {
+    uint32_t codepoint = utf8_decode(text.chars + i, text.length - i, &size);
+    if (codepoint == '\n') {
+      position.x = startX;
+      position.y += fontSize;
+      continue;
+    }
+    if (codepoint == '\t') {
+      position.x += Raylib_GlyphAdvance(font, '\t') * scaleFactor + spacing;
+      continue;
+    }
+    cached_glyph glyph = glyph_cache_get(font, codepoint);
+    if (glyph.rec.width > 0) {
+      Texture2D texture = glyph_cache_texture(font, &glyph);
+      Rectangle dest = {position.x + glyph.offset_x * scaleFactor,
+                        position.y + glyph.offset_y * scaleFactor,
+                        glyph.rec.width * scaleFactor,
+                        glyph.rec.height * scaleFactor};
+      if (texture.id != 0) {
+        DrawTexturePro(texture, glyph.rec, dest, (Vector2){0, 0}, 0, tint);
+      }
+    }
+    position.x += glyph.advance * scaleFactor + spacing;
+  }
+}
+
 void Clay_Raylib_Initialize(int width, int height, const char *title,
                             unsigned int flags) {
   SetConfigFlags(flags);
@@ -139,49 +199,38 @@ void Clay_Raylib_Initialize(int width, int height, const char *title,
   //    EnableEventWaiting();
 }
 
-// A MALLOC'd buffer, that we keep modifying inorder to save from so many Malloc
-// and Free Calls. Call Clay_Raylib_Close() to free
-static char *temp_render_buffer = NULL;
-static int temp_render_buffer_len = 0;
-
-// Call after closing the window to clean up the render buffer
-void Clay_Raylib_Close() {
-  if (temp_render_buffer)
-    free(temp_render_buffer);
-  temp_render_buffer_len = 0;
-
-  CloseWindow();
-}
+// Call after closing the window
+void Clay_Raylib_Close() { CloseWindow(); }
 
-void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font *fonts) {
+void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands,
+                        glyph_cache **fonts) {
+  // the SDF shader stays on across consecutive text commands, every switch
+  // flushes the batch
+  glyph_cache *shaderFont = NULL;
   for (int j = 0; j < renderCommands.length; j++) {
     Clay_RenderCommand *renderCommand =
         Clay_RenderCommandArray_Get(&renderCommands, j);
     Clay_BoundingBox boundingBox = renderCommand->boundingBox;
+    glyph_cache *textFont =
+        renderCommand->commandType == CLAY_RENDER_COMMAND_TYPE_TEXT
+            ? fonts[renderCommand->renderData.text.fontId]
+            : NULL;
+    if (shaderFont != NULL && shaderFont != textFont) {
+      EndShaderMode();
+      shaderFont = NULL;
+    }
+    if (textFont != NULL && textFont->sdf && shaderFont == NULL) {
+      BeginShaderMode(textFont->shader);
+      shaderFont = textFont;
+    }
     switch (renderCommand->commandType) {
     case CLAY_RENDER_COMMAND_TYPE_TEXT: {
       Clay_TextRenderData *textData = &renderCommand->renderData.text;
-      Font fontToUse = fonts[textData->fontId];
-
-      int strlen = textData->stringContents.length + 1;
-
-      if (strlen > temp_render_buffer_len) {
-        // Grow the temp buffer if we need a larger string
-        if (temp_render_buffer)
-          free(temp_render_buffer);
-        temp_render_buffer = (char *)malloc(strlen);
-        temp_render_buffer_len = strlen;
-      }
-
-      // Raylib uses standard C strings so isn't compatible with cheap slices,
-      // we need to clone the string to append null terminator
-      memcpy(temp_render_buffer, textData->stringContents.chars,
-             textData->stringContents.length);
-      temp_render_buffer[textData->stringContents.length] = '\0';
-      DrawTextEx(fontToUse, temp_render_buffer,
-                 (Vector2){boundingBox.x, boundingBox.y},
-                 (float)textData->fontSize, (float)textData->letterSpacing,
-                 CLAY_COLOR_TO_RAYLIB_COLOR(textData->textColor));
+      Raylib_DrawText(textFont, textData->stringContents,
+                      (Vector2){boundingBox.x, boundingBox.y},
+                      (float)textData->fontSize,
+                      (float)textData->letterSpacing,
+                      CLAY_COLOR_TO_RAYLIB_COLOR(textData->textColor));
 
       break;
     }
@@ -344,4 +393,7 @@ void Clay_Raylib_Render(Clay_RenderCommandArray renderCommands, Font *fonts) {
     }
     }
   }
+  if (shaderFont != NULL) {
+    EndShaderMode();
+  }
 }
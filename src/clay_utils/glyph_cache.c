@@ -0,0 +1,326 @@
+#include <rlgl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/clay_utils/glyph_cache.h"
+
+// Coverage is the distance field around the 0.5 edge, smoothed over one
+// screen pixel so edges stay sharp at any scale
+static const char *gc_sdf_fragment_shader =
+    "#version 330\n"
+    "in vec2 fragTexCoord;\n"
+    "in vec4 fragColor;\n"
+    "uniform sampler2D texture0;\n"
+    "uniform vec4 colDiffuse;\n"
+    "out vec4 finalColor;\n"
+    "void main() {\n"
+    "  float dist = texture(texture0, fragTexCoord).a - 0.5;\n"
+    "  float width = length(vec2(dFdx(dist), dFdy(dist)));\n"
+    "  float alpha = smoothstep(-width, width, dist);\n"
+    "  finalColor = vec4(fragColor.rgb, fragColor.a * alpha) * colDiffuse;\n"
+    "}\n";
+
+static cached_glyph *gc_slot(cached_glyph *glyphs, size_t cap,
+                             uint32_t codepoint) {
+  size_t mask = cap - 1;
+  size_t i = (codepoint * 2654435761u) & mask;
+  while (glyphs[i].occupied && glyphs[i].codepoint != codepoint) {
+    i = (i + 1) & mask;
+  }
+  return &glyphs[i];
+}
+
+static void gc_grow(glyph_cache *cache) {
+  size_t cap = cache->glyph_cap * 2;
+  cached_glyph *glyphs = (cached_glyph *)calloc(cap, sizeof(cached_glyph));
+  if (glyphs == NULL) {
+    fprintf(stderr, "Error: glyph table allocation failed");
+    exit(1);
+  }
+  for (size_t i = 0; i < cache->glyph_cap; i++) {
+    if (cache->glyphs[i].occupied) {
+      *gc_slot(glyphs, cap, cache->glyphs[i].codepoint) = cache->glyphs[i];
+    }
+  }
+  free(cache->glyphs);
+  cache->glyphs = glyphs;
+  cache->glyph_cap = cap;
+}
+
+// empty pixels are white with no coverage so bilinear filtering at the edge
+// of a glyph does not blend towards black
+static void gc_clear_page(glyph_page *page) {
+  for (size_t i = 0; i < (size_t)GLYPH_PAGE_SIZE * GLYPH_PAGE_SIZE; i++) {
+    page->pixels[2 * i] = 255;
+    page->pixels[2 * i + 1] = 0;
+  }
+  page->pen_x = GLYPH_PADDING;
+  page->pen_y = GLYPH_PADDING;
+  page->shelf_height = 0;
+  page->dirty_y0 = 0;
+  page->dirty_y1 = 0;
+}
+
+static void gc_evict(glyph_cache *cache, int index) {
+  for (size_t i = 0; i < cache->glyph_cap; i++) {
+    if (cache->glyphs[i].occupied && cache->glyphs[i].page == index) {
+      cache->glyphs[i].page = GLYPH_PAGE_NONE;
+    }
+  }
+  gc_clear_page(&cache->pages[index]);
+}
+
+// switches packing to a page with free space, allocating one while under the
+// page limit and evicting the least recently drawn page after that
+static glyph_page *gc_next_page(glyph_cache *cache) {
+  int next = -1;
+  for (int i = 0; i < GLYPH_CACHE_MAX_PAGES; i++) {
+    if (cache->pages[i].pixels == NULL) {
+      next = i;
+      break;
+    }
+  }
+
+  if (next >= 0) {
+    glyph_page *page = &cache->pages[next];
+    page->pixels =
+        (unsigned char *)malloc((size_t)GLYPH_PAGE_SIZE * GLYPH_PAGE_SIZE * 2);
+    if (page->pixels == NULL) {
+      fprintf(stderr, "Error: glyph page allocation failed");
+      exit(1);
+    }
+    gc_clear_page(page);
+    Image image = {.data = page->pixels,
+                   .width = GLYPH_PAGE_SIZE,
+                   .height = GLYPH_PAGE_SIZE,
+                   .mipmaps = 1,
+                   .format = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+    page->texture = LoadTextureFromImage(image);
+    SetTextureFilter(page->texture, TEXTURE_FILTER_BILINEAR);
+  } else {
+    for (int i = 0; i < GLYPH_CACHE_MAX_PAGES; i++) {
+      if (i != cache->current_page &&
+          (next < 0 || cache->pages[i].last_used < cache->pages[next].last_used)) {
+        next = i;
+      }
+    }
+    if (next < 0) {
+      next = cache->current_page;
+    }
+    gc_evict(cache, next);
+  }
+
+  cache->current_page = next;
+  cache->pages[next].last_used = ++cache->clock;
+  return &cache->pages[next];
+}
+
+static bool gc_is_blank(Image *image) {
+  unsigned char *pixels = (unsigned char *)image->data;
+  if (pixels == NULL) {
+    return true;
+  }
+  for (size_t i = 0; i < (size_t)image->width * image->height; i++) {
+    if (pixels[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// copies a grayscale bitmap into the current page's shelf, the upload is
+// deferred until the page is next drawn from
+static void gc_place(glyph_cache *cache, cached_glyph *glyph, Image *image) {
+  int w = image->width;
+  int h = image->height;
+  if (w + 2 * GLYPH_PADDING > GLYPH_PAGE_SIZE ||
+      h + 2 * GLYPH_PADDING > GLYPH_PAGE_SIZE) {
+    return;
+  }
+
+  glyph_page *page = NULL;
+  if (cache->current_page >= 0) {
+    page = &cache->pages[cache->current_page];
+    if (page->pen_x + w + GLYPH_PADDING > GLYPH_PAGE_SIZE) {
+      page->pen_x = GLYPH_PADDING;
+      page->pen_y += page->shelf_height + GLYPH_PADDING;
+      page->shelf_height = 0;
+    }
+  }
+  if (page == NULL || page->pen_y + h + GLYPH_PADDING > GLYPH_PAGE_SIZE) {
+    page = gc_next_page(cache);
+  }
+
+  int x = page->pen_x;
+  int y = page->pen_y;
+  unsigned char *src = (unsigned char *)image->data;
+  for (int row = 0; row < h; row++) {
+    unsigned char *dst =
+        page->pixels + ((size_t)(y + row) * GLYPH_PAGE_SIZE + x) * 2;
+    for (int col = 0; col < w; col++) {
+      dst[2 * col] = 255;
+      dst[2 * col + 1] = src[row * w + col];
+    }
+  }
+  page->pen_x += w + GLYPH_PADDING;
+  if (h > page->shelf_height) {
+    page->shelf_height = h;
+  }
+
+  // the padding rows go up too, an evicted page still has old bitmaps there
+  int y0 = y - GLYPH_PADDING;
+  int y1 = y + h + GLYPH_PADDING;
+  if (page->dirty_y0 == page->dirty_y1) {
+    page->dirty_y0 = y0;
+    page->dirty_y1 = y1;
+  } else {
+    page->dirty_y0 = y0 < page->dirty_y0 ? y0 : page->dirty_y0;
+    page->dirty_y1 = y1 > page->dirty_y1 ? y1 : page->dirty_y1;
+  }
+  cache->dirty = true;
+
+  glyph->page = (int)(page - cache->pages);
+  glyph->rec = (Rectangle){x, y, w, h};
+}
+
+static void gc_rasterize(glyph_cache *cache, cached_glyph *glyph) {
+  int codepoint = (int)glyph->codepoint;
+  GlyphInfo *info =
+      LoadFontData(cache->file_data, cache->file_size, cache->base_size,
+                   &codepoint, 1, cache->sdf ? FONT_SDF : FONT_DEFAULT);
+  if (info == NULL) {
+    return;
+  }
+  glyph->offset_x = info->offsetX;
+  glyph->offset_y = info->offsetY;
+  glyph->advance = info->advanceX != 0 ? info->advanceX
+                                       : info->image.width + info->offsetX;
+  if (!gc_is_blank(&info->image)) {
+    gc_place(cache, glyph, &info->image);
+  }
+  UnloadFontData(info, 1);
+}
+
+// uploads the dirty rows of every page, once per frame at most unless an
+// evicted glyph has to come back mid frame
+static void gc_upload(glyph_cache *cache) {
+  // quads already batched may sample the rows about to change
+  rlDrawRenderBatchActive();
+  for (int i = 0; i < GLYPH_CACHE_MAX_PAGES; i++) {
+    glyph_page *page = &cache->pages[i];
+    if (page->pixels == NULL || page->dirty_y0 == page->dirty_y1) {
+      continue;
+    }
+    UpdateTextureRec(
+        page->texture,
+        (Rectangle){0, page->dirty_y0, GLYPH_PAGE_SIZE,
+                    page->dirty_y1 - page->dirty_y0},
+        page->pixels + (size_t)page->dirty_y0 * GLYPH_PAGE_SIZE * 2);
+    page->dirty_y0 = 0;
+    page->dirty_y1 = 0;
+  }
+  cache->dirty = false;
+}
+
+static cached_glyph gc_fallback_glyph(glyph_cache *cache, uint32_t codepoint) {
+  Font font = cache->fallback;
+  int index = GetGlyphIndex(font, (int)codepoint);
+  GlyphInfo info = font.glyphs[index];
+  return (cached_glyph){
+      .codepoint = codepoint,
+      .occupied = true,
+      .page = GLYPH_PAGE_FALLBACK,
+      .rec = font.recs[index],
+      .offset_x = info.offsetX,
+      .offset_y = info.offsetY,
+      .advance = info.advanceX != 0 ? info.advanceX
+                                    : font.recs[index].width + info.offsetX,
+  };
+}
+
+void glyph_cache_load(glyph_cache *cache, const char *font_path,
+                      int base_size, bool sdf) {
+  *cache = (glyph_cache){.base_size = base_size, .current_page = -1};
+  cache->file_data = LoadFileData(font_path, &cache->file_size);
+  if (cache->file_data == NULL) {
+    // Font failed to load, likely the fonts are in the wrong place relative
+    // to the execution dir. RayLib ships with a default font, so we can
+    // continue with that built in one.
+    cache->fallback = GetFontDefault();
+    cache->base_size = cache->fallback.baseSize;
+    return;
+  }
+
+  if (sdf) {
+    cache->sdf = true;
+    cache->shader = LoadShaderFromMemory(NULL, gc_sdf_fragment_shader);
+  }
+
+  cache->glyph_cap = GLYPH_TABLE_INIT_SIZE;
+  cache->glyphs = (cached_glyph *)calloc(cache->glyph_cap, sizeof(cached_glyph));
+  if (cache->glyphs == NULL) {
+    fprintf(stderr, "Error: glyph table allocation failed");
+    exit(1);
+  }
+}
+
+void glyph_cache_unload(glyph_cache *cache) {
+  for (int i = 0; i < GLYPH_CACHE_MAX_PAGES; i++) {
+    if (cache->pages[i].pixels != NULL) {
+      UnloadTexture(cache->pages[i].texture);
+      free(cache->pages[i].pixels);
+    }
+  }
+  free(cache->glyphs);
+  if (cache->sdf) {
+    UnloadShader(cache->shader);
+  }
+  if (cache->file_data != NULL) {
+    UnloadFileData(cache->file_data);
+  }
+  *cache = (glyph_cache){0};
+}
+
+// metrics of a codepoint, rasterized into the atlas on first use
+cached_glyph glyph_cache_get(glyph_cache *cache, uint32_t codepoint) {
+  if (cache->file_data == NULL) {
+    return gc_fallback_glyph(cache, codepoint);
+  }
+  cached_glyph *glyph = gc_slot(cache->glyphs, cache->glyph_cap, codepoint);
+  if (!glyph->occupied) {
+    if ((cache->glyph_count + 1) * 2 > cache->glyph_cap) {
+      gc_grow(cache);
+      glyph = gc_slot(cache->glyphs, cache->glyph_cap, codepoint);
+    }
+    *glyph = (cached_glyph){
+        .codepoint = codepoint, .occupied = true, .page = GLYPH_PAGE_NONE};
+    cache->glyph_count++;
+    gc_rasterize(cache, glyph);
+  }
+  return *glyph;
+}
+
+// texture to draw a glyph from. Brings an evicted bitmap back, uploads any
+// pending bitmaps and marks the page as recently used. Blank glyphs have an
+// empty rec and nothing to draw
+Texture2D glyph_cache_texture(glyph_cache *cache, cached_glyph *glyph) {
+  if (glyph->page == GLYPH_PAGE_FALLBACK) {
+    return cache->fallback.texture;
+  }
+  if (glyph->page == GLYPH_PAGE_NONE && glyph->rec.width > 0) {
+    cached_glyph *slot =
+        gc_slot(cache->glyphs, cache->glyph_cap, glyph->codepoint);
+    gc_rasterize(cache, slot);
+    *glyph = *slot;
+  }
+  if (glyph->page == GLYPH_PAGE_NONE) {
+    return (Texture2D){0};
+  }
+  if (cache->dirty) {
+    gc_upload(cache);
+  }
+  glyph_page *page = &cache->pages[glyph->page];
+  page->last_used = ++cache->clock;
+  return page->texture;
+}
@@ -0,0 +1,262 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/file_loader.h"
+#include "../include/utf8.h"
+
+// byte order marks, then NUL bytes, then invalid UTF-8. A sequence cut off
+// by the end of the sniffed bytes only counts if the file ends there
+static file_encoding loader_sniff(const char *s, size_t len, bool cut) {
+  const unsigned char *u = (const unsigned char *)s;
+  if (len >= 3 && u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) {
+    return FILE_UTF8_BOM;
+  }
+  if (len >= 2 && u[0] == 0xFF && u[1] == 0xFE) {
+    return FILE_UTF16_LE;
+  }
+  if (len >= 2 && u[0] == 0xFE && u[1] == 0xFF) {
+    return FILE_UTF16_BE;
+  }
+  if (memchr(s, '\0', len) != NULL) {
+    return FILE_BINARY;
+  }
+  for (size_t i = 0; i < len;) {
+    size_t size;
+    uint32_t cp = utf8_decode(s + i, len - i, &size);
+    if (cp == UTF8_REPLACEMENT_CHAR && size == 1 && (!cut || len - i >= 4)) {
+      return FILE_LATIN1;
+    }
+    i += size;
+  }
+  return FILE_UTF8;
+}
+
+// copies n bytes of a followed file from at into buf, returns how many came.
+// Fewer come when the file was cut short since it was last looked at
+static size_t loader_copy(file_loader *fl, char *buf, size_t at, size_t n) {
+  size_t got = 0;
+  while (got < n) {
+    ssize_t r = pread(fl->fd, buf + at + got, n - got, (off_t)(at + got));
+    if (r < 0 && errno == EINTR) {
+      continue;
+    }
+    if (r <= 0) {
+      break;
+    }
+    got += (size_t)r;
+  }
+  return got;
+}
+
+// waits until the followed file grows past at, returns false when following
+// should stop, as when the file shrinks
+static bool loader_wait_growth(file_loader *fl, size_t at) {
+  struct pollfd pfd = {.fd = fl->watch_fd, .events = POLLIN};
+  char events[4096];
+  if (at == LOADER_FOLLOW_RESERVE_BYTES) {
+    return false;
+  }
+  for (;;) {
+    pthread_mutex_lock(&fl->lock);
+    bool cancel = fl->cancel;
+    pthread_mutex_unlock(&fl->lock);
+    struct stat st;
+    if (cancel || fstat(fl->fd, &st) != 0) {
+      return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < at) {
+      return false;
+    }
+    if (size > at) {
+      size = size < LOADER_FOLLOW_RESERVE_BYTES ? size
+                                                 : LOADER_FOLLOW_RESERVE_BYTES;
+      pthread_mutex_lock(&fl->lock);
+      fl->grown = size;
+      pthread_mutex_unlock(&fl->lock);
+      return true;
+    }
+    if (poll(&pfd, 1, LOADER_FOLLOW_POLL_MS) > 0) {
+      while (read(fl->watch_fd, events, sizeof(events)) > 0) {
+      }
+    }
+  }
+}
+
+static void *loader_worker(void *arg) {
+  file_loader *fl = (file_loader *)arg;
+  char *buf = "";
+  // a followed file is copied into memory reserved for it to grow into
+  // rather than mapped, a mapped file cut short faults on the pages past its
+  // new end before the worker sees it shrink
+  if (fl->follow) {
+    buf = mmap(NULL, LOADER_FOLLOW_RESERVE_BYTES, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  } else if (fl->grown > 0) {
+    buf = mmap(NULL, fl->grown, PROT_READ, MAP_PRIVATE, fl->fd, 0);
+  }
+  if (buf == MAP_FAILED) {
+    fprintf(stderr, "Error: could not map file");
+    exit(1);
+  }
+  size_t sniff = fl->grown < LOADER_SNIFF_BYTES ? fl->grown
+                                                 : LOADER_SNIFF_BYTES;
+  if (fl->follow) {
+    sniff = loader_copy(fl, buf, 0, sniff);
+  } else {
+    if (fl->grown > 0) {
+      madvise(buf, fl->grown, MADV_SEQUENTIAL);
+    }
+    close(fl->fd);
+  }
+  file_encoding encoding = loader_sniff(buf, sniff, sniff < fl->grown);
+
+  pthread_mutex_lock(&fl->lock);
+  fl->buf = buf;
+  fl->encoding = encoding;
+  pthread_mutex_unlock(&fl->lock);
+
+  // counting the codepoints faults the pages in, the next chunk is counted
+  // while the table takes in the last one. Only bytes already copied are
+  // handed over, a followed file cut short ends at what was copied
+  size_t chunk = LOADER_FIRST_CHUNK_BYTES;
+  for (size_t at = 0;;) {
+    if (at == fl->grown && !(fl->follow && loader_wait_growth(fl, at))) {
+      break;
+    }
+    size_t n = fl->grown - at < chunk ? fl->grown - at : chunk;
+    if (fl->follow) {
+      size_t got = loader_copy(fl, buf, at, n);
+      if (got < n) {
+        n = got;
+        pthread_mutex_lock(&fl->lock);
+        fl->grown = at + n;
+        pthread_mutex_unlock(&fl->lock);
+      }
+    }
+    size_t cps = utf8_count_codepoints(buf + at, n);
+    pthread_mutex_lock(&fl->lock);
+    while (!fl->cancel && fl->taken < fl->read) {
+      pthread_cond_wait(&fl->wake, &fl->lock);
+    }
+    bool cancel = fl->cancel;
+    if (!cancel) {
+      fl->read += n;
+      fl->read_cps += cps;
+    }
+    pthread_mutex_unlock(&fl->lock);
+    if (cancel) {
+      break;
+    }
+    at += n;
+    chunk = chunk * 2 < LOADER_CHUNK_BYTES ? chunk * 2 : LOADER_CHUNK_BYTES;
+  }
+
+  if (fl->follow) {
+    close(fl->fd);
+    if (fl->watch_fd >= 0) {
+      close(fl->watch_fd);
+    }
+  }
+  pthread_mutex_lock(&fl->lock);
+  fl->done = true;
+  pthread_mutex_unlock(&fl->lock);
+  return NULL;
+}
+
+// the file is opened here so a bad path fails right away, it is mapped and
+// read on the worker. Without inotify a followed file is checked every
+// LOADER_FOLLOW_POLL_MS instead
+void file_loader_start(file_loader *fl, const char *path, bool follow) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error: could not open %s", path);
+    exit(1);
+  }
+  *fl = (file_loader){.fd = fd,
+                      .watch_fd = -1,
+                      .follow = follow,
+                      .len = (size_t)st.st_size,
+                      .grown = (size_t)st.st_size};
+  if (follow) {
+    fl->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fl->watch_fd >= 0) {
+      inotify_add_watch(fl->watch_fd, path, IN_MODIFY);
+    }
+  }
+  pthread_mutex_init(&fl->lock, NULL);
+  pthread_cond_init(&fl->wake, NULL);
+  if (pthread_create(&fl->thread, NULL, loader_worker, fl) != 0) {
+    fprintf(stderr, "Error: loader thread creation failed");
+    exit(1);
+  }
+}
+
+// the mapping stays, the table keeps reading from it until exit
+void file_loader_stop(file_loader *fl) {
+  file_loader_cancel(fl);
+  pthread_join(fl->thread, NULL);
+  pthread_mutex_destroy(&fl->lock);
+  pthread_cond_destroy(&fl->wake);
+}
+
+// stops reading after the chunk being counted, the table keeps what it took
+void file_loader_cancel(file_loader *fl) {
+  pthread_mutex_lock(&fl->lock);
+  fl->cancel = true;
+  pthread_cond_signal(&fl->wake);
+  pthread_mutex_unlock(&fl->lock);
+}
+
+// hands the chunk counted since the last take to the table, *pos_p receives
+// where its text went. The caller holds the table lock
+bool file_loader_take(file_loader *fl, piece_table *ptbl_p, size_t *pos_p) {
+  pthread_mutex_lock(&fl->lock);
+  size_t len = fl->read - fl->taken;
+  size_t cps = fl->read_cps - fl->taken_cps;
+  fl->len = fl->grown;
+  fl->taken = fl->read;
+  fl->taken_cps = fl->read_cps;
+  pthread_cond_signal(&fl->wake);
+  pthread_mutex_unlock(&fl->lock);
+  if (len == 0) {
+    return false;
+  }
+  *pos_p = ptbl_extend_original(ptbl_p, fl->buf, len, cps);
+  return true;
+}
+
+// whether there is more for the table to take
+bool file_loader_busy(file_loader *fl) {
+  pthread_mutex_lock(&fl->lock);
+  bool busy = !fl->done || fl->taken < fl->read;
+  pthread_mutex_unlock(&fl->lock);
+  return busy;
+}
+
+const char *file_encoding_name(file_encoding encoding) {
+  switch (encoding) {
+  case FILE_UTF8:
+    return "UTF-8";
+  case FILE_UTF8_BOM:
+    return "UTF-8 BOM";
+  case FILE_UTF16_LE:
+    return "UTF-16 LE";
+  case FILE_UTF16_BE:
+    return "UTF-16 BE";
+  case FILE_LATIN1:
+    return "Latin-1";
+  case FILE_BINARY:
+    return "binary";
+  }
+  return "";
+}
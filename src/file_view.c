@@ -0,0 +1,200 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/file_view.h"
+#include "../include/search.h"
+#include "../include/utf8.h"
+
+void file_view_open(file_view *fv, const char *path, size_t budget) {
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "Error: could not open %s", path);
+    exit(1);
+  }
+  size_t num_pages = budget / VIEW_PAGE_BYTES;
+  *fv = (file_view){
+      .fd = fd,
+      .len = (size_t)st.st_size,
+      .num_pages = num_pages > 0 ? num_pages : 1,
+  };
+  fv->pages = (view_page *)calloc(fv->num_pages, sizeof(view_page));
+  fv->scratch = (char *)malloc(VIEW_PAGE_BYTES + VIEW_FIND_OVERLAP);
+  if (fv->pages == NULL || fv->scratch == NULL) {
+    fprintf(stderr, "Error: file view allocation failed");
+    exit(1);
+  }
+}
+
+void file_view_close(file_view *fv) {
+  for (size_t i = 0; i < fv->num_pages; i++) {
+    free(fv->pages[i].data);
+  }
+  free(fv->pages);
+  free(fv->scratch);
+  close(fv->fd);
+  *fv = (file_view){0};
+}
+
+static void fv_pread(file_view *fv, size_t pos, size_t len, char *out) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = pread(fv->fd, out + done, len - done, (off_t)(pos + done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      fprintf(stderr, "Error: could not read file");
+      exit(1);
+    }
+    done += (size_t)n;
+  }
+}
+
+// the cached copy of a page, NULL if it isn't held
+static view_page *fv_lookup(file_view *fv, size_t page) {
+  for (size_t i = 0; i < fv->num_pages; i++) {
+    if (fv->pages[i].page == page + 1) {
+      fv->pages[i].used = ++fv->clock;
+      fv->hits++;
+      return &fv->pages[i];
+    }
+  }
+  return NULL;
+}
+
+// reads a page over the least recently used one, empty slots first
+static view_page *fv_load(file_view *fv, size_t page) {
+  view_page *vp = &fv->pages[0];
+  for (size_t i = 1; i < fv->num_pages; i++) {
+    if (fv->pages[i].used < vp->used) {
+      vp = &fv->pages[i];
+    }
+  }
+  if (vp->data == NULL) {
+    vp->data = (char *)malloc(VIEW_PAGE_BYTES);
+    if (vp->data == NULL) {
+      fprintf(stderr, "Error: file view allocation failed");
+      exit(1);
+    }
+  }
+  size_t pos = page * VIEW_PAGE_BYTES;
+  vp->len = fv->len - pos < VIEW_PAGE_BYTES ? fv->len - pos : VIEW_PAGE_BYTES;
+  fv_pread(fv, pos, vp->len, vp->data);
+  vp->page = page + 1;
+  vp->used = ++fv->clock;
+  fv->misses++;
+  return vp;
+}
+
+// copies [pos, pos + len) of the file to out, returns the bytes copied. Pages
+// that aren't cached are read into the cache if keep is set, otherwise
+// straight into out so a one off scan doesn't push out the pages in view
+size_t file_view_read(file_view *fv, size_t pos, size_t len, char *out,
+                      bool keep) {
+  if (pos >= fv->len) {
+    return 0;
+  }
+  len = fv->len - pos < len ? fv->len - pos : len;
+  for (size_t done = 0; done < len;) {
+    size_t at = pos + done;
+    size_t page = at / VIEW_PAGE_BYTES;
+    size_t offset = at % VIEW_PAGE_BYTES;
+    size_t n = VIEW_PAGE_BYTES - offset < len - done ? VIEW_PAGE_BYTES - offset
+                                                     : len - done;
+    view_page *vp = fv_lookup(fv, page);
+    if (vp == NULL && keep) {
+      vp = fv_load(fv, page);
+    }
+    if (vp != NULL) {
+      memcpy(out + done, vp->data + offset, n);
+    } else {
+      fv_pread(fv, at, n, out + done);
+    }
+    done += n;
+  }
+  return len;
+}
+
+// reads the window of VIEW_WINDOW_BYTES centered on around, trimmed to whole
+// lines unless a line is longer than half of it. Returns the window text,
+// which the caller frees, *cps_p receives its codepoint count
+char *file_view_window(file_view *fv, size_t around, size_t *cps_p) {
+  size_t start = around > VIEW_WINDOW_BYTES / 2 ? around - VIEW_WINDOW_BYTES / 2
+                                                : 0;
+  if (start + VIEW_WINDOW_BYTES > fv->len) {
+    start = fv->len > VIEW_WINDOW_BYTES ? fv->len - VIEW_WINDOW_BYTES : 0;
+  }
+  char *buf = (char *)malloc(VIEW_WINDOW_BYTES);
+  if (buf == NULL) {
+    fprintf(stderr, "Error: file view allocation failed");
+    exit(1);
+  }
+  size_t len = file_view_read(fv, start, VIEW_WINDOW_BYTES, buf, true);
+  size_t half = len / 2;
+  if (start > 0) {
+    const char *newline = memchr(buf, '\n', half);
+    if (newline != NULL) {
+      size_t skip = (size_t)(newline - buf) + 1;
+      memmove(buf, buf + skip, len - skip);
+      start += skip;
+      len -= skip;
+    }
+  }
+  if (start + len < fv->len) {
+    size_t end = len;
+    while (end > half && buf[end - 1] != '\n') {
+      end--;
+    }
+    len = end > half ? end : len;
+  }
+  fv->win_start = start;
+  fv->win_len = len;
+  *cps_p = utf8_count_codepoints(buf, len);
+  return buf;
+}
+
+// looks for the first match starting in [from, from + VIEW_FIND_BYTES), or
+// going backward for the last one starting in [from - VIEW_FIND_BYTES, from).
+// The file is scanned a page at a time past the cache. Returns whether a
+// match was found, *stop_p receives where the scan stopped otherwise
+bool file_view_find(file_view *fv, size_t from, bool forward,
+                    const char *query, size_t query_len, rx_regex *rx,
+                    size_t *start_p, size_t *len_p, size_t *stop_p) {
+  search_results found = {0};
+  bool hit = false;
+  size_t pos = from;
+  for (size_t scanned = 0; !hit && scanned < VIEW_FIND_BYTES &&
+                           (forward ? pos < fv->len : pos > 0);) {
+    size_t n = forward ? fv->len - pos : pos;
+    n = n < VIEW_PAGE_BYTES ? n : VIEW_PAGE_BYTES;
+    size_t lo = forward ? pos : pos - n;
+    const char *chars = fv->scratch;
+    size_t got = file_view_read(fv, lo, n + VIEW_FIND_OVERLAP, fv->scratch,
+                                false);
+    ptbl_snapshot snap = {
+        .chars = &chars, .lens = &got, .num_pieces = 1, .len = got};
+    found.count = 0;
+    if (rx != NULL) {
+      rx_search(rx, &snap, 0, n, &found);
+    } else {
+      search_literal(&snap, 0, n, query, query_len, &found);
+    }
+    if (found.count > 0) {
+      size_t i = forward ? 0 : found.count - 1;
+      *start_p = lo + found.offsets[i];
+      *len_p = found.lens[i];
+      hit = true;
+    }
+    pos = forward ? lo + n : lo;
+    scanned += n;
+  }
+  *stop_p = pos;
+  search_results_free(&found);
+  return hit;
+}
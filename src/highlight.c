@@ -0,0 +1,871 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/highlight.h"
+
+#define HL_MAX_STATES 32
+#define HL_NO_WORD 0xFF // language has no keywords
+
+// Byte classes, every language reads text through the same classification
+enum {
+  HL_CC_OTHER,
+  HL_CC_SPACE,
+  HL_CC_ALPHA, // letters and every byte of a multi-byte codepoint
+  HL_CC_DIGIT,
+  HL_CC_UNDERSCORE,
+  HL_CC_DQUOTE,
+  HL_CC_SQUOTE,
+  HL_CC_BACKTICK,
+  HL_CC_SLASH,
+  HL_CC_STAR,
+  HL_CC_BACKSLASH,
+  HL_CC_HASH,
+  HL_CC_LBRACKET,
+  HL_CC_RBRACKET,
+  HL_CC_GT,
+  HL_CC_MINUS,
+  HL_CC_DOT,
+  HL_CC_COLON,
+  HL_CC_EOL,
+  HL_CC_COUNT,
+  HL_CC_ANY = HL_CC_COUNT, // rule for every class without its own, but EOL
+};
+
+// transition flags
+#define HL_REDO 1 // don't consume the byte, run it again in the next state
+#define HL_BACK 2 // the previous byte takes this byte's style as well
+
+typedef struct {
+  uint8_t state;
+  uint8_t cls;
+  uint8_t next;
+  uint8_t style;
+  uint8_t flags;
+} hl_rule;
+
+typedef struct {
+  uint8_t next;
+  uint8_t style;
+  uint8_t flags;
+} hl_transition;
+
+typedef struct {
+  const char *word;
+  uint8_t style;
+} hl_keyword;
+
+// rules are compiled into a dense table on first lookup. A line break moves
+// to line_start unless a rule for HL_CC_EOL says otherwise
+struct hl_language {
+  const char *name;
+  const char *extensions[3];
+  const hl_rule *rules;
+  size_t num_rules;
+  uint8_t line_start;
+  uint8_t word_state; // runs lexed in this state are looked up as keywords
+  hl_keyword *keywords;
+  size_t num_keywords;
+  bool nocase;
+  bool compiled;
+  hl_transition table[HL_MAX_STATES][HL_CC_COUNT];
+};
+
+static uint8_t hl_classes[256];
+
+// C ---------------------------------------------------------------------------
+enum {
+  C_LINE_START,
+  C_NORMAL,
+  C_IDENT,
+  C_NUMBER,
+  C_STRING,
+  C_STRING_ESC,
+  C_CHAR,
+  C_CHAR_ESC,
+  C_SLASH,
+  C_LINE_COMMENT,
+  C_BLOCK_COMMENT,
+  C_BLOCK_STAR,
+  C_PREPROC,
+};
+
+static const hl_rule c_rules[] = {
+    {C_LINE_START, HL_CC_ANY, C_NORMAL, HL_NORMAL, HL_REDO},
+    {C_LINE_START, HL_CC_SPACE, C_LINE_START, HL_NORMAL, 0},
+    {C_LINE_START, HL_CC_HASH, C_PREPROC, HL_PREPROC, 0},
+
+    {C_NORMAL, HL_CC_ANY, C_NORMAL, HL_PUNCT, 0},
+    {C_NORMAL, HL_CC_SPACE, C_NORMAL, HL_NORMAL, 0},
+    {C_NORMAL, HL_CC_ALPHA, C_IDENT, HL_NORMAL, 0},
+    {C_NORMAL, HL_CC_UNDERSCORE, C_IDENT, HL_NORMAL, 0},
+    {C_NORMAL, HL_CC_DIGIT, C_NUMBER, HL_NUMBER, 0},
+    {C_NORMAL, HL_CC_DQUOTE, C_STRING, HL_STRING, 0},
+    {C_NORMAL, HL_CC_SQUOTE, C_CHAR, HL_STRING, 0},
+    {C_NORMAL, HL_CC_SLASH, C_SLASH, HL_PUNCT, 0},
+
+    {C_IDENT, HL_CC_ANY, C_NORMAL, HL_NORMAL, HL_REDO},
+    {C_IDENT, HL_CC_ALPHA, C_IDENT, HL_NORMAL, 0},
+    {C_IDENT, HL_CC_DIGIT, C_IDENT, HL_NORMAL, 0},
+    {C_IDENT, HL_CC_UNDERSCORE, C_IDENT, HL_NORMAL, 0},
+
+    {C_NUMBER, HL_CC_ANY, C_NORMAL, HL_NORMAL, HL_REDO},
+    {C_NUMBER, HL_CC_ALPHA, C_NUMBER, HL_NUMBER, 0},
+    {C_NUMBER, HL_CC_DIGIT, C_NUMBER, HL_NUMBER, 0},
+    {C_NUMBER, HL_CC_UNDERSCORE, C_NUMBER, HL_NUMBER, 0},
+    {C_NUMBER, HL_CC_DOT, C_NUMBER, HL_NUMBER, 0},
+
+    {C_STRING, HL_CC_ANY, C_STRING, HL_STRING, 0},
+    {C_STRING, HL_CC_BACKSLASH, C_STRING_ESC, HL_STRING, 0},
+    {C_STRING, HL_CC_DQUOTE, C_NORMAL, HL_STRING, 0},
+    {C_STRING_ESC, HL_CC_ANY, C_STRING, HL_STRING, 0},
+    {C_STRING_ESC, HL_CC_EOL, C_STRING, HL_NORMAL, 0},
+
+    {C_CHAR, HL_CC_ANY, C_CHAR, HL_STRING, 0},
+    {C_CHAR, HL_CC_BACKSLASH, C_CHAR_ESC, HL_STRING, 0},
+    {C_CHAR, HL_CC_SQUOTE, C_NORMAL, HL_STRING, 0},
+    {C_CHAR_ESC, HL_CC_ANY, C_CHAR, HL_STRING, 0},
+
+    {C_SLASH, HL_CC_ANY, C_NORMAL, HL_NORMAL, HL_REDO},
+    {C_SLASH, HL_CC_SLASH, C_LINE_COMMENT, HL_COMMENT, HL_BACK},
+    {C_SLASH, HL_CC_STAR, C_BLOCK_COMMENT, HL_COMMENT, HL_BACK},
+
+    {C_LINE_COMMENT, HL_CC_ANY, C_LINE_COMMENT, HL_COMMENT, 0},
+
+    {C_BLOCK_COMMENT, HL_CC_ANY, C_BLOCK_COMMENT, HL_COMMENT, 0},
+    {C_BLOCK_COMMENT, HL_CC_STAR, C_BLOCK_STAR, HL_COMMENT, 0},
+    {C_BLOCK_COMMENT, HL_CC_EOL, C_BLOCK_COMMENT, HL_NORMAL, 0},
+    {C_BLOCK_STAR, HL_CC_ANY, C_BLOCK_COMMENT, HL_NORMAL, HL_REDO},
+    {C_BLOCK_STAR, HL_CC_STAR, C_BLOCK_STAR, HL_COMMENT, 0},
+    {C_BLOCK_STAR, HL_CC_SLASH, C_NORMAL, HL_COMMENT, 0},
+    {C_BLOCK_STAR, HL_CC_EOL, C_BLOCK_COMMENT, HL_NORMAL, 0},
+
+    // only the directive, the rest of the line lexes as code
+    {C_PREPROC, HL_CC_ANY, C_NORMAL, HL_NORMAL, HL_REDO},
+    {C_PREPROC, HL_CC_ALPHA, C_PREPROC, HL_PREPROC, 0},
+};
+
+static hl_keyword c_keywords[] = {
+    {"_Alignas", HL_KEYWORD},   {"_Alignof", HL_KEYWORD},
+    {"_Atomic", HL_KEYWORD},    {"_Bool", HL_TYPE},
+    {"_Generic", HL_KEYWORD},   {"_Noreturn", HL_KEYWORD},
+    {"_Static_assert", HL_KEYWORD}, {"_Thread_local", HL_KEYWORD},
+    {"auto", HL_KEYWORD},       {"bool", HL_TYPE},
+    {"break", HL_KEYWORD},      {"case", HL_KEYWORD},
+    {"char", HL_TYPE},          {"const", HL_KEYWORD},
+    {"continue", HL_KEYWORD},   {"default", HL_KEYWORD},
+    {"do", HL_KEYWORD},         {"double", HL_TYPE},
+    {"else", HL_KEYWORD},       {"enum", HL_KEYWORD},
+    {"extern", HL_KEYWORD},     {"false", HL_NUMBER},
+    {"float", HL_TYPE},         {"for", HL_KEYWORD},
+    {"goto", HL_KEYWORD},       {"if", HL_KEYWORD},
+    {"inline", HL_KEYWORD},     {"int", HL_TYPE},
+    {"int16_t", HL_TYPE},       {"int32_t", HL_TYPE},
+    {"int64_t", HL_TYPE},       {"int8_t", HL_TYPE},
+    {"long", HL_TYPE},          {"NULL", HL_NUMBER},
+    {"register", HL_KEYWORD},   {"restrict", HL_KEYWORD},
+    {"return", HL_KEYWORD},     {"short", HL_TYPE},
+    {"signed", HL_TYPE},        {"size_t", HL_TYPE},
+    {"sizeof", HL_KEYWORD},     {"static", HL_KEYWORD},
+    {"struct", HL_KEYWORD},     {"switch", HL_KEYWORD},
+    {"true", HL_NUMBER},        {"typedef", HL_KEYWORD},
+    {"uint16_t", HL_TYPE},      {"uint32_t", HL_TYPE},
+    {"uint64_t", HL_TYPE},      {"uint8_t", HL_TYPE},
+    {"union", HL_KEYWORD},      {"unsigned", HL_TYPE},
+    {"void", HL_TYPE},          {"volatile", HL_KEYWORD},
+    {"while", HL_KEYWORD},
+};
+
+// JSON ------------------------------------------------------------------------
+enum {
+  J_NORMAL,
+  J_WORD,
+  J_NUMBER,
+  J_STRING,
+  J_STRING_ESC,
+};
+
+static const hl_rule json_rules[] = {
+    {J_NORMAL, HL_CC_ANY, J_NORMAL, HL_PUNCT, 0},
+    {J_NORMAL, HL_CC_SPACE, J_NORMAL, HL_NORMAL, 0},
+    {J_NORMAL, HL_CC_ALPHA, J_WORD, HL_NORMAL, 0},
+    {J_NORMAL, HL_CC_DIGIT, J_NUMBER, HL_NUMBER, 0},
+    {J_NORMAL, HL_CC_MINUS, J_NUMBER, HL_NUMBER, 0},
+    {J_NORMAL, HL_CC_DQUOTE, J_STRING, HL_STRING, 0},
+
+    {J_WORD, HL_CC_ANY, J_NORMAL, HL_NORMAL, HL_REDO},
+    {J_WORD, HL_CC_ALPHA, J_WORD, HL_NORMAL, 0},
+
+    {J_NUMBER, HL_CC_ANY, J_NORMAL, HL_NORMAL, HL_REDO},
+    {J_NUMBER, HL_CC_DIGIT, J_NUMBER, HL_NUMBER, 0},
+    {J_NUMBER, HL_CC_ALPHA, J_NUMBER, HL_NUMBER, 0},
+    {J_NUMBER, HL_CC_DOT, J_NUMBER, HL_NUMBER, 0},
+    {J_NUMBER, HL_CC_MINUS, J_NUMBER, HL_NUMBER, 0},
+
+    {J_STRING, HL_CC_ANY, J_STRING, HL_STRING, 0},
+    {J_STRING, HL_CC_BACKSLASH, J_STRING_ESC, HL_STRING, 0},
+    {J_STRING, HL_CC_DQUOTE, J_NORMAL, HL_STRING, 0},
+    {J_STRING_ESC, HL_CC_ANY, J_STRING, HL_STRING, 0},
+};
+
+static hl_keyword json_keywords[] = {
+    {"false", HL_KEYWORD},
+    {"null", HL_KEYWORD},
+    {"true", HL_KEYWORD},
+};
+
+// Markdown --------------------------------------------------------------------
+enum {
+  M_LINE_START,
+  M_TEXT,
+  M_HEADING,
+  M_QUOTE,
+  M_BULLET,
+  M_CODE,
+  M_EMPH_OPEN,
+  M_EMPH,
+  M_EMPH_CLOSE,
+  M_LINK,
+  M_TICK1,
+  M_TICK2,
+  M_FENCE,
+  M_FENCE_LINE_START,
+  M_FENCE_TICK1,
+  M_FENCE_TICK2,
+  M_FENCE_CLOSE,
+  M_FENCE_BODY,
+};
+
+static const hl_rule markdown_rules[] = {
+    {M_LINE_START, HL_CC_ANY, M_TEXT, HL_NORMAL, HL_REDO},
+    {M_LINE_START, HL_CC_SPACE, M_LINE_START, HL_NORMAL, 0},
+    {M_LINE_START, HL_CC_HASH, M_HEADING, HL_HEADING, 0},
+    {M_LINE_START, HL_CC_GT, M_QUOTE, HL_COMMENT, 0},
+    {M_LINE_START, HL_CC_MINUS, M_TEXT, HL_KEYWORD, 0},
+    {M_LINE_START, HL_CC_STAR, M_BULLET, HL_KEYWORD, 0},
+    {M_LINE_START, HL_CC_BACKTICK, M_TICK1, HL_CODE, 0},
+
+    {M_HEADING, HL_CC_ANY, M_HEADING, HL_HEADING, 0},
+    {M_QUOTE, HL_CC_ANY, M_QUOTE, HL_COMMENT, 0},
+
+    // a star at the start of a line is a bullet when a space follows
+    {M_BULLET, HL_CC_ANY, M_EMPH, HL_EMPHASIS, HL_BACK},
+    {M_BULLET, HL_CC_SPACE, M_TEXT, HL_NORMAL, 0},
+    {M_BULLET, HL_CC_STAR, M_EMPH_OPEN, HL_EMPHASIS, HL_BACK},
+
+    {M_TEXT, HL_CC_ANY, M_TEXT, HL_NORMAL, 0},
+    {M_TEXT, HL_CC_BACKTICK, M_CODE, HL_CODE, 0},
+    {M_TEXT, HL_CC_STAR, M_EMPH_OPEN, HL_EMPHASIS, 0},
+    {M_TEXT, HL_CC_LBRACKET, M_LINK, HL_LINK, 0},
+
+    {M_CODE, HL_CC_ANY, M_CODE, HL_CODE, 0},
+    {M_CODE, HL_CC_BACKTICK, M_TEXT, HL_CODE, 0},
+
+    {M_EMPH_OPEN, HL_CC_ANY, M_EMPH, HL_NORMAL, HL_REDO},
+    {M_EMPH_OPEN, HL_CC_STAR, M_EMPH_OPEN, HL_EMPHASIS, 0},
+    {M_EMPH, HL_CC_ANY, M_EMPH, HL_EMPHASIS, 0},
+    {M_EMPH, HL_CC_STAR, M_EMPH_CLOSE, HL_EMPHASIS, 0},
+    {M_EMPH_CLOSE, HL_CC_ANY, M_TEXT, HL_NORMAL, HL_REDO},
+    {M_EMPH_CLOSE, HL_CC_STAR, M_EMPH_CLOSE, HL_EMPHASIS, 0},
+
+    {M_LINK, HL_CC_ANY, M_LINK, HL_LINK, 0},
+    {M_LINK, HL_CC_RBRACKET, M_TEXT, HL_LINK, 0},
+
+    // three backticks at the start of a line open a fence that runs until a
+    // line starting with three more
+    {M_TICK1, HL_CC_ANY, M_CODE, HL_NORMAL, HL_REDO},
+    {M_TICK1, HL_CC_BACKTICK, M_TICK2, HL_CODE, 0},
+    {M_TICK2, HL_CC_ANY, M_TEXT, HL_NORMAL, HL_REDO},
+    {M_TICK2, HL_CC_BACKTICK, M_FENCE, HL_CODE, 0},
+    {M_FENCE, HL_CC_ANY, M_FENCE, HL_CODE, 0},
+    {M_FENCE, HL_CC_EOL, M_FENCE_LINE_START, HL_NORMAL, 0},
+
+    {M_FENCE_LINE_START, HL_CC_ANY, M_FENCE_BODY, HL_NORMAL, HL_REDO},
+    {M_FENCE_LINE_START, HL_CC_SPACE, M_FENCE_LINE_START, HL_CODE, 0},
+    {M_FENCE_LINE_START, HL_CC_BACKTICK, M_FENCE_TICK1, HL_CODE, 0},
+    {M_FENCE_LINE_START, HL_CC_EOL, M_FENCE_LINE_START, HL_NORMAL, 0},
+    {M_FENCE_TICK1, HL_CC_ANY, M_FENCE_BODY, HL_NORMAL, HL_REDO},
+    {M_FENCE_TICK1, HL_CC_BACKTICK, M_FENCE_TICK2, HL_CODE, 0},
+    {M_FENCE_TICK1, HL_CC_EOL, M_FENCE_LINE_START, HL_NORMAL, 0},
+    {M_FENCE_TICK2, HL_CC_ANY, M_FENCE_BODY, HL_NORMAL, HL_REDO},
+    {M_FENCE_TICK2, HL_CC_BACKTICK, M_FENCE_CLOSE, HL_CODE, 0},
+    {M_FENCE_TICK2, HL_CC_EOL, M_FENCE_LINE_START, HL_NORMAL, 0},
+    {M_FENCE_CLOSE, HL_CC_ANY, M_FENCE_CLOSE, HL_CODE, 0},
+    {M_FENCE_BODY, HL_CC_ANY, M_FENCE_BODY, HL_CODE, 0},
+    {M_FENCE_BODY, HL_CC_EOL, M_FENCE_LINE_START, HL_NORMAL, 0},
+};
+
+// Logs ------------------------------------------------------------------------
+enum {
+  L_NORMAL,
+  L_WORD,
+  L_NUMBER,
+  L_STRING,
+};
+
+static const hl_rule log_rules[] = {
+    {L_NORMAL, HL_CC_ANY, L_NORMAL, HL_NORMAL, 0},
+    {L_NORMAL, HL_CC_ALPHA, L_WORD, HL_NORMAL, 0},
+    {L_NORMAL, HL_CC_DIGIT, L_NUMBER, HL_NUMBER, 0},
+    {L_NORMAL, HL_CC_DQUOTE, L_STRING, HL_STRING, 0},
+
+    {L_WORD, HL_CC_ANY, L_NORMAL, HL_NORMAL, HL_REDO},
+    {L_WORD, HL_CC_ALPHA, L_WORD, HL_NORMAL, 0},
+    {L_WORD, HL_CC_DIGIT, L_WORD, HL_NORMAL, 0},
+    {L_WORD, HL_CC_UNDERSCORE, L_WORD, HL_NORMAL, 0},
+
+    // timestamps, addresses and durations
+    {L_NUMBER, HL_CC_ANY, L_NORMAL, HL_NORMAL, HL_REDO},
+    {L_NUMBER, HL_CC_DIGIT, L_NUMBER, HL_NUMBER, 0},
+    {L_NUMBER, HL_CC_DOT, L_NUMBER, HL_NUMBER, 0},
+    {L_NUMBER, HL_CC_COLON, L_NUMBER, HL_NUMBER, 0},
+    {L_NUMBER, HL_CC_MINUS, L_NUMBER, HL_NUMBER, 0},
+
+    {L_STRING, HL_CC_ANY, L_STRING, HL_STRING, 0},
+    {L_STRING, HL_CC_DQUOTE, L_NORMAL, HL_STRING, 0},
+};
+
+static hl_keyword log_keywords[] = {
+    {"CRITICAL", HL_ERROR}, {"DEBUG", HL_DEBUG},  {"ERR", HL_ERROR},
+    {"ERROR", HL_ERROR},    {"FAIL", HL_ERROR},   {"FAILED", HL_ERROR},
+    {"FATAL", HL_ERROR},    {"INFO", HL_INFO},    {"NOTICE", HL_INFO},
+    {"PANIC", HL_ERROR},    {"TRACE", HL_DEBUG},  {"WARN", HL_WARNING},
+    {"WARNING", HL_WARNING},
+};
+
+#define HL_COUNT(array) (sizeof(array) / sizeof((array)[0]))
+
+static hl_language hl_languages[] = {
+    {.name = "c",
+     .extensions = {"c", "h"},
+     .rules = c_rules,
+     .num_rules = HL_COUNT(c_rules),
+     .line_start = C_LINE_START,
+     .word_state = C_IDENT,
+     .keywords = c_keywords,
+     .num_keywords = HL_COUNT(c_keywords)},
+    {.name = "json",
+     .extensions = {"json"},
+     .rules = json_rules,
+     .num_rules = HL_COUNT(json_rules),
+     .line_start = J_NORMAL,
+     .word_state = J_WORD,
+     .keywords = json_keywords,
+     .num_keywords = HL_COUNT(json_keywords)},
+    {.name = "markdown",
+     .extensions = {"md", "markdown"},
+     .rules = markdown_rules,
+     .num_rules = HL_COUNT(markdown_rules),
+     .line_start = M_LINE_START,
+     .word_state = HL_NO_WORD},
+    {.name = "log",
+     .extensions = {"log"},
+     .rules = log_rules,
+     .num_rules = HL_COUNT(log_rules),
+     .line_start = L_NORMAL,
+     .word_state = L_WORD,
+     .keywords = log_keywords,
+     .num_keywords = HL_COUNT(log_keywords),
+     .nocase = true},
+};
+
+static int hl_compare_words(const char *a, size_t a_len, const char *b,
+                            size_t b_len, bool nocase) {
+  size_t len = a_len < b_len ? a_len : b_len;
+  for (size_t i = 0; i < len; i++) {
+    int ca = nocase ? toupper((unsigned char)a[i]) : (unsigned char)a[i];
+    int cb = nocase ? toupper((unsigned char)b[i]) : (unsigned char)b[i];
+    if (ca != cb) {
+      return ca - cb;
+    }
+  }
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+static bool hl_sort_nocase;
+
+static int hl_compare_keywords(const void *a, const void *b) {
+  const char *wa = ((const hl_keyword *)a)->word;
+  const char *wb = ((const hl_keyword *)b)->word;
+  return hl_compare_words(wa, strlen(wa), wb, strlen(wb), hl_sort_nocase);
+}
+
+static void hl_compile(hl_language *lang) {
+  if (lang->compiled) {
+    return;
+  }
+  if (hl_classes['a'] == HL_CC_OTHER) {
+    for (int c = 0; c < 256; c++) {
+      hl_classes[c] = c >= 0x80 || isalpha(c) ? HL_CC_ALPHA
+                      : isdigit(c)            ? HL_CC_DIGIT
+                      : c == ' ' || c == '\t' || c == '\r' ||
+                              c == '\f' || c == '\v'
+                          ? HL_CC_SPACE
+                          : HL_CC_OTHER;
+    }
+    hl_classes['_'] = HL_CC_UNDERSCORE;
+    hl_classes['"'] = HL_CC_DQUOTE;
+    hl_classes['\''] = HL_CC_SQUOTE;
+    hl_classes['`'] = HL_CC_BACKTICK;
+    hl_classes['/'] = HL_CC_SLASH;
+    hl_classes['*'] = HL_CC_STAR;
+    hl_classes['\\'] = HL_CC_BACKSLASH;
+    hl_classes['#'] = HL_CC_HASH;
+    hl_classes['['] = HL_CC_LBRACKET;
+    hl_classes[']'] = HL_CC_RBRACKET;
+    hl_classes['>'] = HL_CC_GT;
+    hl_classes['-'] = HL_CC_MINUS;
+    hl_classes['.'] = HL_CC_DOT;
+    hl_classes[':'] = HL_CC_COLON;
+    hl_classes['\n'] = HL_CC_EOL;
+  }
+
+  for (int state = 0; state < HL_MAX_STATES; state++) {
+    for (int cls = 0; cls < HL_CC_COUNT; cls++) {
+      lang->table[state][cls] =
+          (hl_transition){.next = lang->line_start, .style = HL_NORMAL};
+    }
+  }
+  // catch-all rules first so the specific ones win
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < lang->num_rules; i++) {
+      hl_rule rule = lang->rules[i];
+      if ((rule.cls == HL_CC_ANY) != (pass == 0)) {
+        continue;
+      }
+      hl_transition t = {rule.next, rule.style, rule.flags};
+      if (rule.cls != HL_CC_ANY) {
+        lang->table[rule.state][rule.cls] = t;
+        continue;
+      }
+      for (int cls = 0; cls < HL_CC_EOL; cls++) {
+        lang->table[rule.state][cls] = t;
+      }
+    }
+  }
+
+  if (lang->num_keywords > 0) {
+    hl_sort_nocase = lang->nocase;
+    qsort(lang->keywords, lang->num_keywords, sizeof(hl_keyword),
+          hl_compare_keywords);
+  }
+  lang->compiled = true;
+}
+
+// languages are compiled on lookup, so look them up before lexing on another
+// thread
+const hl_language *hl_language_by_name(const char *name) {
+  for (size_t i = 0; i < HL_COUNT(hl_languages); i++) {
+    if (strcmp(hl_languages[i].name, name) == 0) {
+      hl_compile(&hl_languages[i]);
+      return &hl_languages[i];
+    }
+  }
+  return NULL;
+}
+
+const hl_language *hl_language_for_path(const char *path) {
+  const char *dot = strrchr(path, '.');
+  if (dot == NULL || strchr(dot, '/') != NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < HL_COUNT(hl_languages); i++) {
+    for (size_t j = 0; j < HL_COUNT(hl_languages[i].extensions); j++) {
+      const char *ext = hl_languages[i].extensions[j];
+      if (ext != NULL && strcmp(ext, dot + 1) == 0) {
+        hl_compile(&hl_languages[i]);
+        return &hl_languages[i];
+      }
+    }
+  }
+  return NULL;
+}
+
+const char *hl_language_name(const hl_language *lang) {
+  return lang != NULL ? lang->name : "text";
+}
+
+uint8_t hl_initial_state(const hl_language *lang) {
+  return lang != NULL ? lang->line_start : 0;
+}
+
+static uint8_t hl_keyword_style(const hl_language *lang, const char *word,
+                                size_t len) {
+  size_t lo = 0;
+  size_t hi = lang->num_keywords;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const char *kw = lang->keywords[mid].word;
+    int cmp = hl_compare_words(word, len, kw, strlen(kw), lang->nocase);
+    if (cmp == 0) {
+      return lang->keywords[mid].style;
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return HL_NORMAL;
+}
+
+static inline hl_transition hl_step(const hl_language *lang, uint8_t state,
+                                    uint8_t cls) {
+  hl_transition t = lang->table[state][cls];
+  while (t.flags & HL_REDO) {
+    t = lang->table[t.next][cls];
+  }
+  return t;
+}
+
+// runs text through the lexer from state and returns the state after it.
+// With styles, also writes the style of every byte, keywords included
+uint8_t hl_lex(const hl_language *lang, uint8_t state, const char *text,
+               size_t len, uint8_t *styles) {
+  if (lang == NULL) {
+    if (styles != NULL) {
+      memset(styles, HL_NORMAL, len);
+    }
+    return 0;
+  }
+  if (styles == NULL) {
+    for (size_t i = 0; i < len; i++) {
+      state = hl_step(lang, state, hl_classes[(unsigned char)text[i]]).next;
+    }
+    return state;
+  }
+
+  size_t word_start = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint8_t prev = state;
+    hl_transition t = hl_step(lang, state, hl_classes[(unsigned char)text[i]]);
+    state = t.next;
+    styles[i] = t.style;
+    if ((t.flags & HL_BACK) && i > 0) {
+      styles[i - 1] = t.style;
+    }
+    if (prev == lang->word_state && state != lang->word_state) {
+      uint8_t style = hl_keyword_style(lang, text + word_start, i - word_start);
+      if (style != HL_NORMAL) {
+        memset(styles + word_start, style, i - word_start);
+      }
+    } else if (state == lang->word_state && prev != lang->word_state) {
+      word_start = i;
+    }
+  }
+  if (state == lang->word_state) {
+    uint8_t style = hl_keyword_style(lang, text + word_start, len - word_start);
+    if (style != HL_NORMAL) {
+      memset(styles + word_start, style, len - word_start);
+    }
+  }
+  return state;
+}
+
+void highlight_init(highlighter *hl, const hl_language *lang) {
+  *hl = (highlighter){.lang = lang, .version = 1};
+}
+
+void highlight_free(highlighter *hl) {
+  free(hl->states);
+  *hl = (highlighter){.lang = hl->lang};
+}
+
+static void hl_reserve(highlighter *hl, size_t num_lines) {
+  if (num_lines <= hl->cap) {
+    return;
+  }
+  size_t cap = hl->cap > 0 ? hl->cap : 1024;
+  while (cap < num_lines) {
+    cap *= 2;
+  }
+  uint8_t *states = realloc(hl->states, cap);
+  if (states == NULL) {
+    fprintf(stderr, "Error: highlight allocation failed");
+    exit(1);
+  }
+  hl->states = states;
+  hl->cap = cap;
+}
+
+// lexes the table from the start of line, which starts at pos, and stores
+// the state at the start of every line after it. Stops once the state at the
+// start of line stop_line + 1 is stored and either agrees with the exact
+// part of the cache or there was none left to agree with. After max_lines
+// the rest is left to the worker, the older states past it stay as hints
+static void hl_relex(highlighter *hl, piece_table *ptbl_p, size_t line,
+                     size_t pos, size_t stop_line, size_t max_lines) {
+  uint8_t state = hl->states[line - 1];
+  size_t lexed = 0;
+  size_t piece_start = 0;
+  pl_node *iter = ptbl_p->piece_list_head_p;
+  while (iter != NULL && piece_start + iter->p.len <= pos) {
+    piece_start += iter->p.len;
+    iter = iter->next_node_p;
+  }
+  size_t index = iter != NULL ? pos - piece_start : 0;
+  for (; iter != NULL; iter = iter->next_node_p, index = 0) {
+    const char *chars = ptbl_piece_chars(ptbl_p, &iter->p);
+    while (index < iter->p.len) {
+      const char *text = chars + index;
+      const char *newline = memchr(text, '\n', iter->p.len - index);
+      size_t n = newline != NULL ? (size_t)(newline - text) + 1
+                                 : iter->p.len - index;
+      state = hl_lex(hl->lang, state, text, n, NULL);
+      index += n;
+      if (newline == NULL) {
+        continue;
+      }
+      hl->lexed++;
+      lexed++;
+      if (line >= hl->num_lines) {
+        return;
+      }
+      bool exact = line < hl->valid;
+      if (line >= stop_line && exact && hl->states[line] == state) {
+        return;
+      }
+      hl->states[line] = state;
+      if (!exact || lexed >= max_lines) {
+        hl->valid = line + 1;
+        hl->known = hl->known > hl->valid ? hl->known : hl->valid;
+      }
+      if ((line >= stop_line && !exact) || lexed >= max_lines) {
+        return;
+      }
+      line++;
+    }
+  }
+}
+
+// drops the cache, for a table that was replaced or indexed from scratch
+void highlight_reset(highlighter *hl, size_t num_lines) {
+  if (hl->lang != NULL) {
+    hl_reserve(hl, num_lines); // plain text keeps no line states
+  }
+  hl->num_lines = num_lines;
+  hl->valid = 0;
+  hl->known = 0;
+  hl->version++;
+}
+
+// follows an edit the wrap index has already taken in. The cached states
+// after the edited lines move with them, then the edited lines are lexed
+// again until the state at a line start agrees with the cache. Edits that
+// change the state of more than HIGHLIGHT_SYNC_LINES lines leave the rest to
+// the worker
+void highlight_splice(highlighter *hl, piece_table *ptbl_p, wrap_index *wi,
+                      size_t start, size_t removed, size_t inserted) {
+  (void)removed;
+  if (hl->lang == NULL || hl->num_lines == 0) {
+    return;
+  }
+  size_t new_lines = wi->num_lines;
+  size_t first = wrap_index_line_of_pos(wi, start);
+  size_t last = wrap_index_line_of_pos(wi, start + inserted);
+  size_t old_last = last + hl->num_lines - new_lines;
+  hl_reserve(hl, new_lines);
+  hl->version++;
+
+  if (hl->known > old_last) {
+    memmove(hl->states + last, hl->states + old_last, hl->known - old_last);
+    hl->known = hl->known - old_last + last;
+  } else if (hl->known > first) {
+    hl->known = first;
+  }
+  bool relex = hl->valid > old_last;
+  if (relex) {
+    hl->valid = hl->valid - old_last + last;
+  } else if (hl->valid > first) {
+    hl->valid = first;
+  }
+  hl->num_lines = new_lines;
+  if (relex) {
+    hl_relex(hl, ptbl_p, first, wrap_index_line_start(wi, first), last,
+             HIGHLIGHT_SYNC_LINES);
+  }
+}
+
+// state at the start of line. Lines a little past the exact part of the
+// cache are lexed on the spot, further ones get the state from before the
+// last edits or HL_STATE_UNKNOWN until the worker gets there
+uint8_t highlight_state_at(highlighter *hl, piece_table *ptbl_p,
+                           wrap_index *wi, size_t line, bool *exact_p) {
+  *exact_p = true;
+  if (hl->lang == NULL || line == 0 || line > hl->num_lines) {
+    return hl_initial_state(hl->lang);
+  }
+  if (hl->valid == 0) {
+    hl->states[0] = hl_initial_state(hl->lang);
+    hl->valid = 1;
+    hl->known = hl->known > 1 ? hl->known : 1;
+  }
+  if (line > hl->valid && line - hl->valid <= HIGHLIGHT_SYNC_LINES) {
+    hl_relex(hl, ptbl_p, hl->valid, wrap_index_line_start(wi, hl->valid),
+             line - 1, HIGHLIGHT_SYNC_LINES);
+  }
+  if (line <= hl->valid) {
+    return hl->states[line - 1];
+  }
+  *exact_p = false;
+  return line <= hl->known ? hl->states[line - 1] : HL_STATE_UNKNOWN;
+}
+
+// lexes the snapshot from pos, publishing the line start states every
+// HIGHLIGHT_PUBLISH_LINES lines. Gives up once a newer request comes in
+static void hl_worker_lex(highlight_worker *hw, ptbl_snapshot *snap_p,
+                          size_t pos, uint8_t state, size_t max_states) {
+  size_t done = 0;
+  size_t piece = 0;
+  size_t piece_start = 0;
+  while (piece < snap_p->num_pieces &&
+         piece_start + snap_p->lens[piece] <= pos) {
+    piece_start += snap_p->lens[piece++];
+  }
+  size_t index = pos - piece_start;
+  for (; piece < snap_p->num_pieces; piece++, index = 0) {
+    const char *chars = snap_p->chars[piece];
+    size_t len = snap_p->lens[piece];
+    while (index < len && done < max_states) {
+      const char *text = chars + index;
+      const char *newline = memchr(text, '\n', len - index);
+      size_t n = newline != NULL ? (size_t)(newline - text) + 1 : len - index;
+      state = hl_lex(hw->lang, state, text, n, NULL);
+      index += n;
+      if (newline == NULL) {
+        continue;
+      }
+      hw->res_states[done++] = state;
+      if (done % HIGHLIGHT_PUBLISH_LINES == 0) {
+        pthread_mutex_lock(&hw->lock);
+        bool cancelled = hw->pending || hw->quit;
+        hw->res_done = done;
+        pthread_mutex_unlock(&hw->lock);
+        if (cancelled) {
+          return;
+        }
+      }
+    }
+  }
+  pthread_mutex_lock(&hw->lock);
+  hw->res_done = done;
+  pthread_mutex_unlock(&hw->lock);
+}
+
+static void *hl_worker_main(void *arg) {
+  highlight_worker *hw = (highlight_worker *)arg;
+
+  pthread_mutex_lock(&hw->lock);
+  while (!hw->quit) {
+    if (!hw->pending) {
+      pthread_cond_wait(&hw->wake, &hw->lock);
+      continue;
+    }
+    ptbl_snapshot snap = hw->req_snap;
+    size_t pos = hw->req_pos;
+    uint8_t state = hw->req_state;
+    size_t max_states = hw->req_num_lines - hw->req_line;
+    hw->req_snap = (ptbl_snapshot){0};
+    hw->pending = false;
+    if (max_states > hw->res_cap) {
+      free(hw->res_states);
+      hw->res_states = malloc(max_states);
+      hw->res_cap = hw->res_states != NULL ? max_states : 0;
+    }
+    hw->res_line = hw->req_line;
+    hw->res_done = 0;
+    hw->res_version = hw->req_version;
+    pthread_mutex_unlock(&hw->lock);
+
+    if (hw->res_cap >= max_states) {
+      hl_worker_lex(hw, &snap, pos, state, max_states);
+    }
+
+    // table_lock is always taken before lock, never while holding it
+    pthread_mutex_lock(hw->table_lock);
+    ptbl_snapshot_release(hw->ptbl_p, &snap);
+    pthread_mutex_unlock(hw->table_lock);
+    pthread_mutex_lock(&hw->lock);
+  }
+  pthread_mutex_unlock(&hw->lock);
+  return NULL;
+}
+
+void highlight_worker_start(highlight_worker *hw, piece_table *ptbl_p,
+                            pthread_mutex_t *table_lock,
+                            const hl_language *lang) {
+  *hw = (highlight_worker){
+      .table_lock = table_lock, .ptbl_p = ptbl_p, .lang = lang};
+  pthread_mutex_init(&hw->lock, NULL);
+  pthread_cond_init(&hw->wake, NULL);
+  if (pthread_create(&hw->thread, NULL, hl_worker_main, hw) != 0) {
+    fprintf(stderr, "Error: highlight thread creation failed");
+    exit(1);
+  }
+}
+
+// the caller must not hold the table lock
+void highlight_worker_stop(highlight_worker *hw) {
+  pthread_mutex_lock(&hw->lock);
+  hw->quit = true;
+  pthread_cond_signal(&hw->wake);
+  pthread_mutex_unlock(&hw->lock);
+  pthread_join(hw->thread, NULL);
+
+  if (hw->pending) {
+    pthread_mutex_lock(hw->table_lock);
+    ptbl_snapshot_release(hw->ptbl_p, &hw->req_snap);
+    pthread_mutex_unlock(hw->table_lock);
+  }
+  pthread_mutex_destroy(&hw->lock);
+  pthread_cond_destroy(&hw->wake);
+  free(hw->res_states);
+}
+
+// swaps in what the worker lexed for the current version and asks it for
+// the rest of the table after edits. Returns whether more lines became
+// exact. The caller holds the table lock
+bool highlight_update(highlighter *hl, highlight_worker *hw,
+                      piece_table *ptbl_p, wrap_index *wi) {
+  if (hl->lang == NULL || hl->num_lines == 0 || hl->valid >= hl->num_lines) {
+    return false;
+  }
+  bool merged = false;
+  pthread_mutex_lock(&hw->lock);
+  size_t res_end = hw->res_line + hw->res_done;
+  if (hw->res_version == hl->version && hw->res_line <= hl->valid &&
+      res_end > hl->valid) {
+    memcpy(hl->states + hl->valid, hw->res_states + (hl->valid - hw->res_line),
+           res_end - hl->valid);
+    hl->valid = res_end;
+    hl->known = hl->known > hl->valid ? hl->known : hl->valid;
+    merged = true;
+  }
+  pthread_mutex_unlock(&hw->lock);
+
+  if (hl->requested_version != hl->version && hl->valid < hl->num_lines) {
+    if (hl->valid == 0) {
+      hl->states[0] = hl_initial_state(hl->lang);
+      hl->valid = 1;
+      hl->known = hl->known > 1 ? hl->known : 1;
+    }
+    ptbl_snapshot snap;
+    ptbl_snapshot_take(ptbl_p, &snap);
+    pthread_mutex_lock(&hw->lock);
+    if (hw->pending) {
+      ptbl_snapshot_release(ptbl_p, &hw->req_snap);
+    }
+    hw->req_snap = snap;
+    hw->req_line = hl->valid;
+    hw->req_pos = wrap_index_line_start(wi, hl->valid);
+    hw->req_state = hl->states[hl->valid - 1];
+    hw->req_num_lines = hl->num_lines;
+    hw->req_version = hl->version;
+    hw->pending = true;
+    pthread_cond_signal(&hw->wake);
+    pthread_mutex_unlock(&hw->lock);
+    hl->requested_version = hl->version;
+  }
+  return merged;
+}
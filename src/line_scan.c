@@ -0,0 +1,266 @@
+#include <stdint.h>
+
+#include "../include/line_scan.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define LINE_SCAN_X86 1
+#endif
+
+// Count kernels, line breaks in s[0, len)
+
+static size_t ls_count_scalar(const char *s, size_t len) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++) {
+    count += s[i] == '\n';
+  }
+  return count;
+}
+
+#ifdef LINE_SCAN_X86
+// compare results are subtracted into byte counters, summed with psadbw
+// before 255 blocks can overflow them
+static size_t ls_count_sse2(const char *s, size_t len) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  while (len - i >= 16) {
+    size_t blocks = (len - i) / 16 < 255 ? (len - i) / 16 : 255;
+    __m128i counters = _mm_setzero_si128();
+    for (size_t b = 0; b < blocks; b++, i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+      counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(block, nl));
+    }
+    __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+    count += (size_t)_mm_cvtsi128_si64(sums) +
+             (size_t)_mm_extract_epi16(sums, 4);
+  }
+  return count + ls_count_scalar(s + i, len - i);
+}
+
+__attribute__((target("avx2"))) static size_t ls_count_avx2(const char *s,
+                                                            size_t len) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  while (len - i >= 32) {
+    size_t blocks = (len - i) / 32 < 255 ? (len - i) / 32 : 255;
+    __m256i counters = _mm256_setzero_si256();
+    for (size_t b = 0; b < blocks; b++, i += 32) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(s + i));
+      counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(block, nl));
+    }
+    __m256i sums = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums),
+                                 _mm256_extracti128_si256(sums, 1));
+    count += (size_t)_mm_cvtsi128_si64(half) +
+             (size_t)_mm_extract_epi16(half, 4);
+  }
+  return count + ls_count_sse2(s + i, len - i);
+}
+
+__attribute__((target("avx512bw,popcnt"))) static size_t
+ls_count_avx512(const char *s, size_t len) {
+  const __m512i nl = _mm512_set1_epi8('\n');
+  size_t count = 0;
+  size_t i = 0;
+  for (; len - i >= 64; i += 64) {
+    __m512i block = _mm512_loadu_si512((const void *)(s + i));
+    count += (size_t)__builtin_popcountll(_mm512_cmpeq_epi8_mask(block, nl));
+  }
+  return count + ls_count_avx2(s + i, len - i);
+}
+#endif
+
+// returns the number of line breaks in s
+size_t line_scan_count(const char *s, size_t len) {
+#ifdef LINE_SCAN_X86
+  if (__builtin_cpu_supports("avx512bw")) {
+    return ls_count_avx512(s, len);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return ls_count_avx2(s, len);
+  }
+  return ls_count_sse2(s, len);
+#else
+  return ls_count_scalar(s, len);
+#endif
+}
+
+// Skip kernels, whole blocks are counted off *lines_p until the block with
+// the last line break to skip, found there by clearing the ones before it.
+// *lines_p > 0
+
+static size_t ls_skip_scalar(const char *s, size_t len, size_t *lines_p) {
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '\n' && --*lines_p == 0) {
+      return i + 1;
+    }
+  }
+  return len;
+}
+
+#ifdef LINE_SCAN_X86
+static size_t ls_skip_sse2(const char *s, size_t len, size_t *lines_p) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t want = *lines_p;
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    if (mask == 0) {
+      continue;
+    }
+    size_t found = (size_t)__builtin_popcount(mask);
+    if (found < want) {
+      want -= found;
+      continue;
+    }
+    while (--want > 0) {
+      mask &= mask - 1;
+    }
+    *lines_p = 0;
+    return i + __builtin_ctz(mask) + 1;
+  }
+  *lines_p = want;
+  return i + ls_skip_scalar(s + i, len - i, lines_p);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+ls_skip_avx2(const char *s, size_t len, size_t *lines_p) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t want = *lines_p;
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(s + i));
+    unsigned mask =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    size_t found = (size_t)__builtin_popcount(mask);
+    if (found < want) {
+      want -= found;
+      continue;
+    }
+    while (--want > 0) {
+      mask &= mask - 1;
+    }
+    *lines_p = 0;
+    return i + __builtin_ctz(mask) + 1;
+  }
+  *lines_p = want;
+  return i + ls_skip_sse2(s + i, len - i, lines_p);
+}
+
+__attribute__((target("avx512bw,popcnt"))) static size_t
+ls_skip_avx512(const char *s, size_t len, size_t *lines_p) {
+  const __m512i nl = _mm512_set1_epi8('\n');
+  size_t want = *lines_p;
+  size_t i = 0;
+  for (; len - i >= 64; i += 64) {
+    __m512i block = _mm512_loadu_si512((const void *)(s + i));
+    uint64_t mask = _mm512_cmpeq_epi8_mask(block, nl);
+    size_t found = (size_t)__builtin_popcountll(mask);
+    if (found < want) {
+      want -= found;
+      continue;
+    }
+    while (--want > 0) {
+      mask &= mask - 1;
+    }
+    *lines_p = 0;
+    return i + __builtin_ctzll(mask) + 1;
+  }
+  *lines_p = want;
+  return i + ls_skip_avx2(s + i, len - i, lines_p);
+}
+#endif
+
+// skips up to *lines_p line breaks, returns the offset just past the last
+// one skipped or len if there are fewer. *lines_p keeps how many are left
+size_t line_scan_skip(const char *s, size_t len, size_t *lines_p) {
+  if (*lines_p == 0) {
+    return 0;
+  }
+#ifdef LINE_SCAN_X86
+  if (__builtin_cpu_supports("avx512bw")) {
+    return ls_skip_avx512(s, len, lines_p);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return ls_skip_avx2(s, len, lines_p);
+  }
+  return ls_skip_sse2(s, len, lines_p);
+#else
+  return ls_skip_scalar(s, len, lines_p);
+#endif
+}
+
+// Next kernels, the first line break and the tabs before it. Lines are
+// short, so these stop at 32 byte blocks
+
+static size_t ls_next_scalar(const char *s, size_t len, size_t *tabs_p) {
+  size_t tabs = 0;
+  size_t i = 0;
+  for (; i < len && s[i] != '\n'; i++) {
+    tabs += s[i] == '\t';
+  }
+  *tabs_p += tabs;
+  return i;
+}
+
+#ifdef LINE_SCAN_X86
+static size_t ls_next_sse2(const char *s, size_t len, size_t *tabs_p) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8('\t');
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+    unsigned nl_mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    unsigned tab_mask =
+        (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, tab));
+    if (nl_mask != 0) {
+      unsigned at = (unsigned)__builtin_ctz(nl_mask);
+      tab_mask &= (1u << at) - 1;
+      *tabs_p += tab_mask != 0 ? (size_t)__builtin_popcount(tab_mask) : 0;
+      return i + at;
+    }
+    *tabs_p += tab_mask != 0 ? (size_t)__builtin_popcount(tab_mask) : 0;
+  }
+  return i + ls_next_scalar(s + i, len - i, tabs_p);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+ls_next_avx2(const char *s, size_t len, size_t *tabs_p) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  size_t tabs = 0;
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(s + i));
+    unsigned nl_mask =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    unsigned tab_mask =
+        (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, tab));
+    if (nl_mask != 0) {
+      unsigned at = (unsigned)__builtin_ctz(nl_mask);
+      tab_mask &= (1u << at) - 1;
+      *tabs_p += tabs + (size_t)__builtin_popcount(tab_mask);
+      return i + at;
+    }
+    tabs += (size_t)__builtin_popcount(tab_mask);
+  }
+  *tabs_p += tabs;
+  return i + ls_next_sse2(s + i, len - i, tabs_p);
+}
+#endif
+
+// offset of the first line break in s, len if there is none. The tabs
+// before it are added to *tabs_p
+size_t line_scan_next(const char *s, size_t len, size_t *tabs_p) {
+#ifdef LINE_SCAN_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return ls_next_avx2(s, len, tabs_p);
+  }
+  return ls_next_sse2(s, len, tabs_p);
+#else
+  return ls_next_scalar(s, len, tabs_p);
+#endif
+}
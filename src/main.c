@@ -1,12 +1,24 @@
+#include <math.h>
 #include <raylib.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define CLAY_IMPLEMENTATION
 #include "../include/clay_utils/clay.h"
 #include "../include/clay_utils/clay_renderer_raylib.h"
+#include "../include/file_loader.h"
+#include "../include/file_view.h"
+#include "../include/highlight.h"
 #include "../include/piece_table.h"
+#include "../include/prefetch.h"
+#include "../include/rx.h"
+#include "../include/search.h"
+#include "../include/search_index.h"
+#include "../include/search_pool.h"
+#include "../include/utf8.h"
+#include "../include/wrap_index.h"
 
 const uint32_t FONT_ID_BODY_24 = 0;
 const uint32_t FONT_ID_BODY_16 = 1;
@@ -21,22 +33,178 @@ const uint32_t FONT_ID_BODY_16 = 1;
 // TODO: Move these to separate file
 // Render Settings
 #define FPS 100
+#define FONT_SDF true          // one distance field atlas serves every size
+#define FONT_SDF_BASE_SIZE 48  // px the distance fields are generated at
+
+// Text Area Settings
+#define BASE_LINE_HEIGHT 40
+#define TEXT_AREA_PADDING 16
+#define BASE_TEXT_FONT_SIZE 30
+#define LINE_CHILD_GAP 10 // between the line number gutter and the text
+#define GUTTER_COLUMNS 6  // width of the line number gutter
+#define LINE_HEIGHT roundf(BASE_LINE_HEIGHT * zoom)
+#define TEXT_FONT_SIZE roundf(BASE_TEXT_FONT_SIZE * zoom)
+
+// Zoom Settings
+#define ZOOM_STEP 1.1f
+#define ZOOM_MIN 0.5f
+#define ZOOM_MAX 4.0f
+
+float zoom = 1.0f; // text scale, see SetZoom
+
+// Scroll Settings
+#define SCROLL_IMPULSE 1500     // px/s added per wheel notch
+#define SCROLL_FRICTION 6.0     // velocity decay rate, 1/s
+#define SCROLL_MIN_VELOCITY 5.0 // px/s, below this scrolling stops
+#define PREFETCH_SCREENS 3      // height of a loaded window in screens
+#define PREFETCH_LOOKAHEAD 0.02 // seconds of scrolling to prefetch ahead
+
+// Clay Memory Settings
+#define CLAY_MIN_ELEMENT_COUNT 8192
+#define CLAY_ELEMENTS_PER_LINE 16 // line, number and text containers, plus
+                                  // a container per visual row and a text
+                                  // per style run
+#define CLAY_WORDS_PER_LINE 64
 
 // Cursor Settings
 #define CURSOR_WIDTH 2 // TODO: move to function/memory location
+#define CURSOR_HEIGHT TEXT_FONT_SIZE
 #define CURSOR_BLINK_RATE 0.5
 #define CURSOR_BLINK_CYCLE 1.2
 
+// Input Settings
+#define INPUT_BATCH_SIZE 256 // bytes of typed text applied per insert
+
+// Highlight Settings
+#define HIGHLIGHT_LANGUAGE "c" // language of the scratch buffer
+const Clay_Color HIGHLIGHT_COLORS[HL_STYLE_COUNT] = {
+    [HL_NORMAL] = {200, 200, 200, 255},  [HL_KEYWORD] = {198, 120, 221, 255},
+    [HL_TYPE] = {86, 182, 194, 255},     [HL_NUMBER] = {209, 154, 102, 255},
+    [HL_STRING] = {152, 195, 121, 255},  [HL_COMMENT] = {110, 115, 125, 255},
+    [HL_PREPROC] = {224, 108, 117, 255}, [HL_PUNCT] = {171, 178, 191, 255},
+    [HL_HEADING] = {97, 175, 239, 255},  [HL_EMPHASIS] = {229, 192, 123, 255},
+    [HL_CODE] = {152, 195, 121, 255},    [HL_LINK] = {97, 175, 239, 255},
+    [HL_ERROR] = {224, 108, 117, 255},   [HL_WARNING] = {229, 192, 123, 255},
+    [HL_INFO] = {97, 175, 239, 255},     [HL_DEBUG] = {110, 115, 125, 255},
+};
+
+// Selection Settings
+#define SELECTION_COLOR (Color){90, 130, 200, 90}
+#define SELECTION_NEWLINE_WIDTH (TEXT_FONT_SIZE / 2) // marks selected breaks
+
+// Load Settings
+#define LOAD_BAR_WIDTH 320
+#define LOAD_BAR_HEIGHT 4
+
+// View Settings
+#define VIEW_SLIDE_MARGIN (VIEW_WINDOW_BYTES / 4) // bytes left past the view
+                                                  // before the window slides
+#define GOTO_DIGITS_MAX 20
+
+// Find Settings
+#define FIND_MATCH_COLOR (Color){200, 160, 60, 90}
+#define FIND_QUERY_MAX 256 // bytes of the query, typed or taken from a selection
+
 typedef struct {
   double cycle_start;
   bool should_render;
 } cursor_state;
 
+// x position of every character boundary in the loaded window, laid out
+// parallel to render_buffers.edit_text_buf so a row's offsets start at the
+// same index as its text
+typedef struct {
+  float *glyph_x;
+  bool measured[MAX_LINE_BREAKS];
+  size_t loads; // window load the offsets were measured for
+} line_metrics;
+
+// visual rows of every line in the loaded window, laid out like
+// line_metrics. Row r of the window wraps into the segments starting at
+// starts[first[r]] up to starts[first[r + 1] - 1], as offsets into the row
+typedef struct {
+  size_t *starts;
+  size_t first[MAX_LINE_BREAKS + 1];
+  size_t loads; // window load the rows were split for
+  size_t cols;  // columns the rows were split at
+} line_wraps;
+#define LINE_WRAPS_MAX_SEGMENTS (EDIT_TEXT_BUFFER_MAX_SIZE + MAX_LINE_BREAKS)
+
+// style of every byte in the loaded window, laid out like line_metrics
+typedef struct {
+  uint8_t *style;
+  bool lexed[MAX_LINE_BREAKS];
+  bool provisional; // a row was lexed from a stale state or left plain
+  size_t loads;     // window load the rows were lexed for
+} line_styles;
+
+typedef struct {
+  float velocity; // px/s, positive scrolls towards the start of the file
+} scroll_state;
+
+// find bar, typed text goes to the query while it is open, or to the
+// replacement while replacing
+typedef struct {
+  bool active;
+  bool regex;        // query is a pattern, see rx.h
+  const char *error; // why the pattern didn't compile
+  char query[FIND_QUERY_MAX];
+  size_t query_len;
+  bool replacing;
+  char replacement[FIND_QUERY_MAX];
+  size_t replacement_len;
+  rx_regex *rx;           // compiled query, for updating matches on edits
+  search_index matches;   // matches of the query, kept up to date on edits
+  search_results batch;   // matches polled from the search pool this frame
+  size_t taken;           // matches polled from the search pool so far
+  size_t current;         // match selected last, SIZE_MAX for none
+  bool dirty;             // matches predate the query
+  bool searching;         // the search pool is still streaming matches
+  char label[2 * FIND_QUERY_MAX + 64];
+} find_state;
+
+// go to bar, typed digits are the byte offset to put the cursor on
+typedef struct {
+  bool active;
+  char digits[GOTO_DIGITS_MAX];
+  size_t len;
+  char label[GOTO_DIGITS_MAX + 16];
+} goto_state;
+
 typedef struct {
   cursor_state curs;
+  scroll_state scroll;
+  line_prefetcher prefetch;
+  size_t version;     // bumped whenever loaded render data goes stale, the
+                      // cursor moving included
+  size_t loads;       // bumped whenever a new window is loaded
+  line_metrics metrics;
+  wrap_index wrap;    // visual rows of every line in the table
+  line_wraps segments;
+  highlighter hl;     // lexer state at the start of every line
+  highlight_worker hl_worker;
+  line_styles styles;
+  find_state find;
+  goto_state go_to;
+  search_pool search;
+  file_loader loader;
+  bool loading;       // the loader has more of the file for the table
+  char load_label[64];
+  file_view view;
+  bool viewing;       // read only, the table holds a window of the file
+  char view_label[96];
+  bool table_locked;  // main thread holds prefetch.table_lock
   piece_table ptbl;
-  Font *fonts;
+  glyph_cache **fonts;
   Clay_TextElementConfig text_config;
+  bool reload_data;
+
+  // the cursor is drawn on top of the last layout, so frames that only blink
+  // or move the cursor within a line skip layout entirely
+  Clay_RenderCommandArray render_commands;
+  bool relayout;
+  size_t shown_first_line; // lines declared in the last layout
+  size_t shown_end_line;
 } editor_state;
 
 void update_cursor_state(cursor_state *cs_p) {
@@ -48,150 +216,1466 @@ void update_cursor_state(cursor_state *cs_p) {
   cs_p->should_render = dt < CURSOR_BLINK_RATE * CURSOR_BLINK_CYCLE;
 }
 
+// returns the distance to scroll this frame in px
+float update_scroll_state(scroll_state *ss_p, float wheel, float dt) {
+  ss_p->velocity += wheel * SCROLL_IMPULSE;
+  float distance = ss_p->velocity * dt;
+  ss_p->velocity *= expf(-SCROLL_FRICTION * dt);
+  if (fabsf(ss_p->velocity) < SCROLL_MIN_VELOCITY) {
+    ss_p->velocity = 0;
+  }
+  return distance;
+}
+
+// the prefetch worker reads the table, so the main thread takes the table
+// lock lazily, only on frames that touch it
+void AcquireTable(editor_state *editor) {
+  if (!editor->table_locked) {
+    pthread_mutex_lock(&editor->prefetch.table_lock);
+    editor->table_locked = true;
+  }
+}
+
+void ReleaseTable(editor_state *editor) {
+  if (editor->table_locked) {
+    pthread_mutex_unlock(&editor->prefetch.table_lock);
+    editor->table_locked = false;
+  }
+}
+
+// scroll position carried over a clay arena resize, applied once the text
+// area is declared again
+bool restoreScroll = false;
+float restoreScrollY = 0;
+
+float GetTextAreaScrollY(void) {
+  if (restoreScroll) {
+    return restoreScrollY;
+  }
+  Clay_ScrollContainerData scroll_data =
+      Clay_GetScrollContainerData(CLAY_ID("OuterContainer"));
+  return scroll_data.found ? scroll_data.scrollPosition->y : 0;
+}
+
+// let clay decide whether visual rows would be culled at the current scroll
+// position, without declaring them
+bool RowsAreOffscreen(size_t first_row, size_t num_rows, float scroll_y) {
+  Clay_BoundingBox rows_box = {
+      .x = TEXT_AREA_PADDING,
+      .y = TEXT_AREA_PADDING + scroll_y + first_row * LINE_HEIGHT,
+      .width = (float)GetScreenWidth() - 2 * TEXT_AREA_PADDING,
+      .height = num_rows * LINE_HEIGHT,
+  };
+  return Clay__ElementIsOffscreen(&rows_box);
+}
+
+bool LineIsOffscreen(editor_state *editor, size_t line_number,
+                     float scroll_y) {
+  return RowsAreOffscreen(wrap_index_row_of_line(&editor->wrap, line_number),
+                          wrap_index_rows(&editor->wrap, line_number),
+                          scroll_y);
+}
+
+size_t LineAtScrollY(editor_state *editor, float scroll_y) {
+  if (-scroll_y <= TEXT_AREA_PADDING) {
+    return 1;
+  }
+  size_t row = (size_t)((-scroll_y - TEXT_AREA_PADDING) / LINE_HEIGHT);
+  return wrap_index_line_at_row(&editor->wrap, row, NULL);
+}
+
+// scrolls a line to the top of the view, the wrap index finds its row in
+// O(log n)
+void ScrollToLine(editor_state *editor, size_t line) {
+  restoreScrollY =
+      -(float)wrap_index_row_of_line(&editor->wrap, line) * LINE_HEIGHT;
+  restoreScroll = true;
+  editor->scroll.velocity = 0;
+  editor->relayout = true;
+}
+
+// advance of one column of the monospace grid at the current zoom
+float ColumnWidth(editor_state *editor) {
+  Clay_TextElementConfig config = {.fontId = FONT_ID_BODY_24,
+                                   .fontSize = TEXT_FONT_SIZE};
+  return Raylib_MeasureText(
+             (Clay_StringSlice){.length = 1, .chars = " ", .baseChars = " "},
+             &config, editor->fonts)
+      .width;
+}
+
+float GutterWidth(editor_state *editor) {
+  return GUTTER_COLUMNS * ColumnWidth(editor);
+}
+
+// columns that fit in a visual row next to the gutter
+size_t WrapColumns(editor_state *editor) {
+  float width = GetScreenWidth() - 2 * TEXT_AREA_PADDING -
+                GutterWidth(editor) - LINE_CHILD_GAP;
+  float column = ColumnWidth(editor);
+  return width > column ? (size_t)(width / column) : 1;
+}
+
+// matches around an edit are looked for again, the rest move with it. A
+// search still streaming in, or one the find bar isn't showing, is redone
+void UpdateMatches(editor_state *editor, size_t start, size_t removed,
+                   size_t inserted) {
+  find_state *fs = &editor->find;
+  if (!fs->active || fs->dirty || fs->searching || fs->error != NULL) {
+    fs->dirty = true;
+    return;
+  }
+  ptbl_snapshot snap;
+  ptbl_snapshot_take(&editor->ptbl, &snap);
+  search_index_update(&fs->matches, &snap, start, removed, inserted,
+                      fs->query, fs->query_len, fs->rx);
+  ptbl_snapshot_release(&editor->ptbl, &snap);
+  fs->current = SIZE_MAX;
+}
+
+// the wrap index, the highlighter and the find matches follow the table.
+// Edits only measure and lex the lines they touched again, a new column count
+// (resize, zoom) rebuilds the wrap index on every core and keeps the top line
+// in view
+void UpdateLineIndexes(editor_state *editor) {
+  size_t cols = WrapColumns(editor);
+  if (cols == editor->wrap.cols && !editor->ptbl.edit_pending) {
+    return;
+  }
+  AcquireTable(editor);
+  size_t start, removed, inserted;
+  bool edited = ptbl_take_edit(&editor->ptbl, &start, &removed, &inserted);
+  if (cols != editor->wrap.cols) {
+    size_t top_line = LineAtScrollY(editor, GetTextAreaScrollY());
+    bool built = editor->wrap.num_lines > 0;
+    wrap_index_build(&editor->wrap, &editor->ptbl, cols,
+                     editor->loading ? editor->loader.len : 0);
+    if (built) {
+      ScrollToLine(editor, top_line);
+    } else {
+      highlight_reset(&editor->hl, editor->wrap.num_lines);
+    }
+    editor->relayout = true;
+  } else {
+    wrap_index_splice(&editor->wrap, &editor->ptbl, start, removed, inserted);
+  }
+  if (edited) {
+    highlight_splice(&editor->hl, &editor->ptbl, &editor->wrap, start,
+                     removed, inserted);
+    UpdateMatches(editor, start, removed, inserted);
+  }
+}
+
+// whether the last row is in view
+bool ViewAtEnd(editor_state *editor) {
+  float bottom = -GetTextAreaScrollY() + GetScreenHeight() - TEXT_AREA_PADDING;
+  return bottom >=
+         (float)wrap_index_total_rows(&editor->wrap) * LINE_HEIGHT - LINE_HEIGHT;
+}
+
+// hands the table the next chunk of a file being loaded. The window is
+// loaded again if the new text lands in it, prefetched windows may end
+// before it
+void UpdateLoad(editor_state *editor, render_buffers *render_bufs_p) {
+  if (!editor->loading) {
+    return;
+  }
+  file_loader *fl = &editor->loader;
+  AcquireTable(editor);
+  bool at_end = fl->follow && ViewAtEnd(editor);
+  size_t pos;
+  if (file_loader_take(fl, &editor->ptbl, &pos)) {
+    editor->version++;
+    if (pos <= render_bufs_p->first_line_pos + render_bufs_p->edit_text_len +
+                   1) {
+      editor->reload_data = true;
+    }
+    // a followed file scrolls along with what is appended while the end is
+    // in view, like tail -f
+    if (at_end) {
+      UpdateLineIndexes(editor);
+      ScrollToLine(editor, editor->wrap.num_lines);
+      editor->reload_data = true;
+    }
+  }
+  editor->loading = file_loader_busy(fl);
+  char progress[16] = "Following";
+  if (!fl->follow || fl->taken < fl->len) {
+    snprintf(progress, sizeof(progress), "Loading %d%%",
+             fl->len > 0 ? (int)(100.0 * fl->taken / fl->len) : 100);
+  }
+  // the encoding is known once the first chunk is in
+  snprintf(editor->load_label, sizeof(editor->load_label),
+           "%s  %s%sctrl+L stops", progress,
+           fl->taken > 0 ? file_encoding_name(fl->encoding) : "",
+           fl->taken > 0 ? "  " : "");
+  editor->relayout = true;
+}
+
+// moves the window of a viewed file so it holds byte pos of the file, the
+// cursor goes there and the line indexes are caught up right away
+void ViewGoTo(editor_state *editor, size_t pos) {
+  file_view *fv = &editor->view;
+  AcquireTable(editor);
+  size_t cps;
+  char *buf = file_view_window(fv, pos < fv->len ? pos : fv->len, &cps);
+  ptbl_replace_original(&editor->ptbl, buf, fv->win_len, cps);
+  UpdateLineIndexes(editor);
+  ptbl_update_global_cursor_pos(&editor->ptbl,
+                                pos > fv->win_start ? pos - fv->win_start : 0);
+  editor->reload_data = true;
+}
+
+// slides the window of a viewed file once the view gets within
+// VIEW_SLIDE_MARGIN of one of its ends, keeping the top line in place and
+// the scroll going
+void UpdateView(editor_state *editor) {
+  if (!editor->viewing) {
+    return;
+  }
+  file_view *fv = &editor->view;
+  float scroll_y = GetTextAreaScrollY();
+  size_t top = wrap_index_line_start(&editor->wrap,
+                                     LineAtScrollY(editor, scroll_y));
+  size_t bottom = wrap_index_line_start(
+      &editor->wrap, LineAtScrollY(editor, scroll_y - GetScreenHeight()));
+  bool near_start = fv->win_start > 0 && top < VIEW_SLIDE_MARGIN;
+  bool near_end = fv->win_start + fv->win_len < fv->len &&
+                  bottom + VIEW_SLIDE_MARGIN > fv->win_len;
+  if (near_start || near_end) {
+    size_t top_pos = fv->win_start + top;
+    size_t cursor = fv->win_start + editor->ptbl.global_cursor_pos;
+    float velocity = editor->scroll.velocity;
+    ViewGoTo(editor, top_pos);
+    if (cursor >= fv->win_start && cursor <= fv->win_start + fv->win_len) {
+      ptbl_update_global_cursor_pos(&editor->ptbl, cursor - fv->win_start);
+    }
+    top = top_pos - fv->win_start;
+    ScrollToLine(editor, wrap_index_line_of_pos(&editor->wrap, top));
+    editor->scroll.velocity = velocity;
+  }
+  snprintf(editor->view_label, sizeof(editor->view_label),
+           "Read only  byte %zu of %zu  cache %zu MB",
+           fv->win_start + top, fv->len,
+           (size_t)(fv->misses < fv->num_pages ? fv->misses : fv->num_pages) *
+               VIEW_PAGE_BYTES >> 20);
+}
+
+// where a line starts according to the wrap index, so loading a window can
+// seek to it. 0 when the index doesn't have the line
+size_t LineStartHint(editor_state *editor, size_t line) {
+  return line <= editor->wrap.num_lines
+             ? wrap_index_line_start(&editor->wrap, line)
+             : 0;
+}
+
+// a window spans a few screens, biased towards the scroll direction
+size_t WindowStart(size_t line, size_t view_lines, float velocity) {
+  size_t behind = velocity > 0
+                      ? view_lines * PREFETCH_SCREENS - view_lines * 3 / 2
+                      : view_lines / 2;
+  return line > behind ? line - behind : 1;
+}
+
+// only the lines around the viewport are pulled out of the piece table,
+// windows ahead of the scroll are loaded on the prefetch worker
+void UpdateViewport(editor_state *editor, render_buffers *render_bufs_p) {
+  float scroll_y = GetTextAreaScrollY();
+  size_t first_line = LineAtScrollY(editor, scroll_y);
+  size_t view_lines = GetScreenHeight() / LINE_HEIGHT + 2;
+  size_t window_lines = view_lines * PREFETCH_SCREENS;
+  float velocity = editor->scroll.velocity;
+
+  if (editor->reload_data) {
+    editor->version++;
+  }
+  if (editor->reload_data ||
+      !render_buffers_cover(render_bufs_p, first_line, view_lines)) {
+    if (editor->reload_data ||
+        !prefetch_take(&editor->prefetch, render_bufs_p, first_line,
+                       view_lines, editor->version)) {
+      AcquireTable(editor);
+      size_t start = WindowStart(first_line, view_lines, velocity);
+      load_ptbl_data(&editor->ptbl, render_bufs_p, start,
+                     LineStartHint(editor, start), window_lines);
+    }
+    editor->reload_data = false;
+    editor->loads++;
+  }
+
+  if (velocity != 0) {
+    size_t next_line =
+        LineAtScrollY(editor, scroll_y + velocity * PREFETCH_LOOKAHEAD);
+    if (!render_buffers_cover(render_bufs_p, next_line, view_lines)) {
+      size_t start = WindowStart(next_line, view_lines, velocity);
+      prefetch_request(&editor->prefetch, start, LineStartHint(editor, start),
+                       window_lines, editor->version);
+    }
+  }
+}
+
+// text of a loaded row, without its line break
+Clay_String GetRowText(render_buffers *render_bufs_p, size_t row) {
+  size_t line_end = (row == render_bufs_p->num_line_breaks)
+                        ? render_bufs_p->edit_text_len
+                        : (size_t)render_bufs_p->line_break_pos[row + 1];
+  size_t line_start = render_bufs_p->line_break_pos[row] + 1;
+  return (Clay_String){
+      .isStaticallyAllocated = false,
+      .length = line_end - line_start,
+      .chars = render_bufs_p->edit_text_buf + line_start,
+  };
+}
+
+bool CursorRowLoaded(render_buffers *render_bufs_p) {
+  return render_bufs_p->cursor_line >= render_bufs_p->first_line &&
+         render_bufs_p->cursor_line - render_bufs_p->first_line <=
+             render_bufs_p->num_line_breaks;
+}
+
+// moves the cursor by one grapheme cluster. Moves that stay within the
+// loaded line only touch the cursor offset, anything else steps in the table
+// and reloads the window. The loaded cursor row is stale until then
+void MoveCursor(editor_state *editor, render_buffers *render_bufs_p,
+                int direction) {
+  size_t pos = editor->ptbl.global_cursor_pos;
+  if (CursorRowLoaded(render_bufs_p)) {
+    Clay_String row_text = GetRowText(
+        render_bufs_p, render_bufs_p->cursor_line - render_bufs_p->first_line);
+    size_t offset = render_bufs_p->cursor_offset;
+    size_t row_len = row_text.length;
+    if ((direction < 0 && offset > 0) || (direction > 0 && offset < row_len)) {
+      size_t new_offset =
+          direction < 0 ? utf8_prev_grapheme(row_text.chars, row_len, offset)
+                        : utf8_next_grapheme(row_text.chars, row_len, offset);
+      ptbl_update_global_cursor_pos(&editor->ptbl, pos - offset + new_offset);
+      render_bufs_p->cursor_offset = new_offset;
+      editor->version++; // windows prefetched before have the old cursor
+      return;
+    }
+  }
+  size_t new_pos = ptbl_grapheme_step(&editor->ptbl, pos, direction);
+  if (new_pos == pos) {
+    return;
+  }
+  ptbl_update_global_cursor_pos(&editor->ptbl, new_pos);
+  render_bufs_p->cursor_line = SIZE_MAX;
+  editor->reload_data = true;
+}
+
+// deletes the grapheme cluster before the cursor
+void DeleteBackward(editor_state *editor, render_buffers *render_bufs_p) {
+  size_t pos = editor->ptbl.global_cursor_pos;
+  if (pos == 0) {
+    return;
+  }
+  if (CursorRowLoaded(render_bufs_p) && render_bufs_p->cursor_offset > 0) {
+    Clay_String row_text = GetRowText(
+        render_bufs_p, render_bufs_p->cursor_line - render_bufs_p->first_line);
+    size_t offset = render_bufs_p->cursor_offset;
+    size_t prev = utf8_prev_grapheme(row_text.chars, row_text.length, offset);
+    ptbl_delete_range(&editor->ptbl, pos - (offset - prev), offset - prev);
+  } else {
+    size_t prev = ptbl_grapheme_step(&editor->ptbl, pos, -1);
+    ptbl_delete_range(&editor->ptbl, prev, pos - prev);
+  }
+  render_bufs_p->cursor_line = SIZE_MAX;
+  editor->reload_data = true;
+}
+
+// offsets of a loaded row's character boundaries, measured once per load
+float *GetRowOffsets(editor_state *editor, render_buffers *render_bufs_p,
+                     size_t row) {
+  line_metrics *lm_p = &editor->metrics;
+  if (lm_p->loads != editor->loads) {
+    memset(lm_p->measured, 0, sizeof(lm_p->measured));
+    lm_p->loads = editor->loads;
+  }
+
+  Clay_String row_text = GetRowText(render_bufs_p, row);
+  float *offsets = lm_p->glyph_x + (row_text.chars - render_bufs_p->edit_text_buf);
+  if (!lm_p->measured[row]) {
+    Clay_TextElementConfig config = {.fontId = FONT_ID_BODY_24,
+                                     .fontSize = TEXT_FONT_SIZE};
+    Raylib_MeasureGlyphOffsets((Clay_StringSlice){.length = row_text.length,
+                                                  .chars = row_text.chars,
+                                                  .baseChars = row_text.chars},
+                               &config, editor->fonts, offsets);
+    lm_p->measured[row] = true;
+  }
+  return offsets;
+}
+
+// styles of a loaded row, lexed from the cached state at the start of its
+// line the first time the row is drawn after a load
+uint8_t *GetRowStyles(editor_state *editor, render_buffers *render_bufs_p,
+                      size_t row) {
+  line_styles *ls_p = &editor->styles;
+  if (ls_p->loads != editor->loads) {
+    memset(ls_p->lexed, 0, sizeof(ls_p->lexed));
+    ls_p->provisional = false;
+    ls_p->loads = editor->loads;
+  }
+  Clay_String row_text = GetRowText(render_bufs_p, row);
+  uint8_t *styles =
+      ls_p->style + (row_text.chars - render_bufs_p->edit_text_buf);
+  if (!ls_p->lexed[row]) {
+    AcquireTable(editor);
+    bool exact;
+    uint8_t state = highlight_state_at(&editor->hl, &editor->ptbl,
+                                       &editor->wrap,
+                                       render_bufs_p->first_line + row, &exact);
+    hl_lex(state != HL_STATE_UNKNOWN ? editor->hl.lang : NULL, state,
+           row_text.chars, row_text.length, styles);
+    ls_p->lexed[row] = true;
+    ls_p->provisional |= !exact;
+  }
+  return styles;
+}
+
+// swaps in the line states the worker lexed, rows that were drawn from stale
+// states or as plain text get lexed again
+void UpdateHighlights(editor_state *editor) {
+  if (editor->hl.valid >= editor->hl.num_lines) {
+    return;
+  }
+  AcquireTable(editor);
+  if (highlight_update(&editor->hl, &editor->hl_worker, &editor->ptbl,
+                       &editor->wrap) &&
+      editor->styles.provisional) {
+    memset(editor->styles.lexed, 0, sizeof(editor->styles.lexed));
+    editor->styles.provisional = false;
+    editor->relayout = true;
+  }
+}
+
+// length of the run of text starting at from that draws in one colour.
+// Blanks look the same in any colour and join the run they are in
+size_t StyleRunLength(const char *text, const uint8_t *styles, size_t from,
+                      size_t to) {
+  size_t end = from + 1;
+  uint8_t style = styles[from];
+  while (end < to && (styles[end] == style || text[end] == ' ' ||
+                      text[end] == '\t')) {
+    end++;
+  }
+  return end - from;
+}
+
+// visual row starts of a loaded row, the whole window is split once per
+// load
+size_t *GetRowSegments(editor_state *editor, render_buffers *render_bufs_p,
+                       size_t row, size_t *count_p) {
+  line_wraps *lw_p = &editor->segments;
+  if (lw_p->loads != editor->loads || lw_p->cols != editor->wrap.cols) {
+    size_t used = 0;
+    for (size_t r = 0; r <= render_bufs_p->num_line_breaks; r++) {
+      Clay_String row_text = GetRowText(render_bufs_p, r);
+      lw_p->first[r] = used;
+      used += wrap_segments(row_text.chars, row_text.length, editor->wrap.cols,
+                            lw_p->starts + used,
+                            LINE_WRAPS_MAX_SEGMENTS - used);
+    }
+    lw_p->first[render_bufs_p->num_line_breaks + 1] = used;
+    lw_p->loads = editor->loads;
+    lw_p->cols = editor->wrap.cols;
+  }
+  *count_p = lw_p->first[row + 1] - lw_p->first[row];
+  return lw_p->starts + lw_p->first[row];
+}
+
+// segment an offset is drawn in, an offset on a wrap shows at the start of
+// the next row
+size_t SegmentOf(const size_t *starts, size_t count, size_t offset) {
+  size_t lo = 0;
+  size_t hi = count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (starts[mid] <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// nearest character boundary to x, offsets holds len + 1 ascending values
+size_t OffsetAtX(const float *offsets, size_t len, float x) {
+  size_t lo = 0;
+  size_t hi = len;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (offsets[mid] < x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo > 0 && x - offsets[lo - 1] < offsets[lo] - x) {
+    lo--;
+  }
+  return lo;
+}
+
+// maps a screen point onto the line and offset under it, using the last
+// layout. Points above or below the text snap to the nearest shown line.
+bool HitTestText(editor_state *editor, render_buffers *render_bufs_p,
+                 Vector2 point, size_t *line_p, size_t *offset_p) {
+  if (editor->shown_end_line <= editor->shown_first_line) {
+    return false;
+  }
+  float content_y = point.y - GetTextAreaScrollY() - TEXT_AREA_PADDING;
+  size_t sub_row = 0;
+  size_t line = content_y > 0
+                    ? wrap_index_line_at_row(&editor->wrap,
+                                             (size_t)(content_y / LINE_HEIGHT),
+                                             &sub_row)
+                    : 1;
+  if (line < editor->shown_first_line) {
+    line = editor->shown_first_line;
+    sub_row = 0;
+  } else if (line >= editor->shown_end_line) {
+    line = editor->shown_end_line - 1;
+    sub_row = wrap_index_rows(&editor->wrap, line) - 1;
+  }
+
+  Clay_ElementData line_data =
+      Clay_GetElementData(CLAY_IDI("LineTextCursorContainer", line));
+  if (!line_data.found) {
+    return false;
+  }
+  size_t row = line - render_bufs_p->first_line;
+  Clay_String row_text = GetRowText(render_bufs_p, row);
+  size_t num_segments;
+  size_t *starts =
+      GetRowSegments(editor, render_bufs_p, row, &num_segments);
+  size_t segment = sub_row < num_segments ? sub_row : num_segments - 1;
+  size_t seg_start = starts[segment];
+  size_t seg_end = segment + 1 < num_segments ? starts[segment + 1]
+                                              : (size_t)row_text.length;
+  float *offsets = GetRowOffsets(editor, render_bufs_p, row);
+  size_t offset =
+      seg_start + OffsetAtX(offsets + seg_start, seg_end - seg_start,
+                            point.x - line_data.boundingBox.x +
+                                offsets[seg_start]);
+  // past the end of a wrapped row, stay on that row
+  if (offset == seg_end && segment + 1 < num_segments && offset > seg_start) {
+    offset = utf8_prev_grapheme(row_text.chars, row_text.length, offset);
+  }
+  *line_p = line;
+  *offset_p = utf8_grapheme_start(row_text.chars, row_text.length, offset);
+  return true;
+}
+
+// clicking or dragging in the text area places the cursor
+void HandleMouse(editor_state *editor, render_buffers *render_bufs_p) {
+  if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+    return;
+  }
+  Vector2 mouse_delta = GetMouseDelta();
+  if (!IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && mouse_delta.x == 0 &&
+      mouse_delta.y == 0) {
+    return;
+  }
+
+  size_t line;
+  size_t offset;
+  if (!HitTestText(editor, render_bufs_p, GetMousePosition(), &line,
+                   &offset)) {
+    return;
+  }
+  size_t row = line - render_bufs_p->first_line;
+  size_t row_start = render_bufs_p->line_break_pos[row] + 1;
+  AcquireTable(editor);
+  ptbl_update_global_cursor_pos(&editor->ptbl, render_bufs_p->first_line_pos +
+                                                   row_start + offset);
+  render_bufs_p->cursor_line = line;
+  render_bufs_p->cursor_offset = offset;
+  editor->version++;
+  editor->curs.cycle_start = GetTime(); // keep the cursor lit while placing
+
+  // a click anchors a new selection, dragging extends it
+  if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+    ptbl_start_selection(&editor->ptbl);
+  }
+}
+
+// one rectangle per shown visual row that [sel_start, sel_end) touches
+void DrawRange(editor_state *editor, render_buffers *render_bufs_p,
+               size_t sel_start, size_t sel_end, Color color) {
+  for (size_t line = editor->shown_first_line; line < editor->shown_end_line;
+       line++) {
+    size_t row = line - render_bufs_p->first_line;
+    size_t row_len = GetRowText(render_bufs_p, row).length;
+    size_t row_start = render_bufs_p->first_line_pos +
+                       render_bufs_p->line_break_pos[row] + 1;
+    size_t row_end = row_start + row_len; // position of the line break
+    if (sel_start > row_end || sel_end <= row_start) {
+      continue;
+    }
+
+    Clay_ElementData line_data =
+        Clay_GetElementData(CLAY_IDI("LineTextCursorContainer", line));
+    if (!line_data.found) {
+      continue;
+    }
+    float *offsets = GetRowOffsets(editor, render_bufs_p, row);
+    size_t num_segments;
+    size_t *starts =
+        GetRowSegments(editor, render_bufs_p, row, &num_segments);
+    size_t from = sel_start > row_start ? sel_start - row_start : 0;
+    size_t to = sel_end < row_end ? sel_end - row_start : row_len;
+    Clay_BoundingBox box = line_data.boundingBox;
+    for (size_t segment = SegmentOf(starts, num_segments, from);
+         segment < num_segments && starts[segment] <= to; segment++) {
+      size_t seg_start = starts[segment];
+      bool last = segment + 1 == num_segments;
+      size_t seg_end = last ? row_len : starts[segment + 1];
+      bool newline = last && sel_end > row_end;
+      size_t a = from > seg_start ? from : seg_start;
+      size_t b = to < seg_end ? to : seg_end;
+      if (a >= b && !newline) {
+        continue;
+      }
+      float x0 = offsets[a] - offsets[seg_start];
+      float x1 = offsets[b] - offsets[seg_start];
+      if (newline) {
+        x1 += SELECTION_NEWLINE_WIDTH;
+      }
+      DrawRectangle((int)roundf(box.x + x0),
+                    (int)roundf(box.y + segment * LINE_HEIGHT),
+                    (int)roundf(x1 - x0), (int)roundf(LINE_HEIGHT), color);
+    }
+  }
+}
+
+void DrawSelection(editor_state *editor, render_buffers *render_bufs_p) {
+  size_t sel_start, sel_end;
+  if (ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end)) {
+    DrawRange(editor, render_bufs_p, sel_start, sel_end, SELECTION_COLOR);
+  }
+}
+
+// only the matches within the shown lines are looked at, the results are
+// sorted so the first one is a binary search away
+void DrawMatches(editor_state *editor, render_buffers *render_bufs_p) {
+  find_state *fs = &editor->find;
+  if (!fs->active || fs->dirty || fs->matches.count == 0 ||
+      editor->shown_end_line <= editor->shown_first_line) {
+    return;
+  }
+  size_t first_row = editor->shown_first_line - render_bufs_p->first_line;
+  size_t last_row = editor->shown_end_line - 1 - render_bufs_p->first_line;
+  size_t from = render_bufs_p->first_line_pos +
+                render_bufs_p->line_break_pos[first_row] + 1;
+  size_t to = render_bufs_p->first_line_pos +
+              render_bufs_p->line_break_pos[last_row] + 1 +
+              GetRowText(render_bufs_p, last_row).length;
+  // match ends ascend like their starts, step back to any reaching in
+  size_t i = search_index_lower_bound(&fs->matches, from);
+  size_t start, len;
+  for (; i > 0; i--) {
+    search_index_get(&fs->matches, i - 1, &start, &len);
+    if (start + len <= from) {
+      break;
+    }
+  }
+  for (; i < fs->matches.count; i++) {
+    search_index_get(&fs->matches, i, &start, &len);
+    if (start > to) {
+      break;
+    }
+    DrawRange(editor, render_bufs_p, start, start + len, FIND_MATCH_COLOR);
+  }
+}
+
+void DrawCursor(editor_state *editor, render_buffers *render_bufs_p) {
+  size_t line = render_bufs_p->cursor_line;
+  if (!editor->curs.should_render || line < editor->shown_first_line ||
+      line >= editor->shown_end_line || !CursorRowLoaded(render_bufs_p)) {
+    return;
+  }
+  Clay_ElementData line_data =
+      Clay_GetElementData(CLAY_IDI("LineTextCursorContainer", line));
+  if (!line_data.found) {
+    return;
+  }
+  size_t row = line - render_bufs_p->first_line;
+  size_t row_len = GetRowText(render_bufs_p, row).length;
+  size_t offset = render_bufs_p->cursor_offset < row_len
+                      ? render_bufs_p->cursor_offset
+                      : row_len;
+  size_t num_segments;
+  size_t *starts = GetRowSegments(editor, render_bufs_p, row, &num_segments);
+  size_t segment = SegmentOf(starts, num_segments, offset);
+  float *offsets = GetRowOffsets(editor, render_bufs_p, row);
+  Clay_BoundingBox box = line_data.boundingBox;
+  DrawRectangle(
+      (int)roundf(box.x + offsets[offset] - offsets[starts[segment]]),
+      (int)roundf(box.y + segment * LINE_HEIGHT +
+                  (LINE_HEIGHT - CURSOR_HEIGHT) / 2),
+      CURSOR_WIDTH, CURSOR_HEIGHT, (Color){200, 200, 200, 255});
+}
+
+// bytes snprintf left in a label of size bytes, it returns what it would have
+// written had the label been long enough
+size_t LabelLength(int written, size_t size) {
+  return written < 0 ? 0 : (size_t)written < size ? (size_t)written : size - 1;
+}
+
 Clay_RenderCommandArray CreateLayout(editor_state *editor,
                                      render_buffers *render_bufs_p) {
 
   Clay_BeginLayout();
 
-  Clay_Context *context = Clay_GetCurrentContext();
-  Clay_TextElementConfig *config = CLAY_TEXT_CONFIG({
-      .fontSize = 30, .textColor = {200, 200, 200, 255},
-      //.textAlignment = CLAY_TEXT_ALIGN_CENTER,
-  });
-  float spaceWidth =
-      Clay__MeasureText(
-          CLAY__INIT(Clay_StringSlice){.length = 1,
-                                       .chars = CLAY__SPACECHAR.chars,
-                                       .baseChars = CLAY__SPACECHAR.chars},
-          config, context->measureTextUserData)
-          .width;
+  // trim the window's overscan rows that clay would cull anyway, the
+  // spacers stand in for every line that isn't declared
+  float scroll_y = GetTextAreaScrollY();
+  size_t first_row = 0;
+  size_t end_row = render_bufs_p->num_line_breaks + 1;
+  while (first_row + 1 < end_row &&
+         LineIsOffscreen(editor, render_bufs_p->first_line + first_row,
+                         scroll_y)) {
+    first_row++;
+  }
+  while (end_row - 1 > first_row &&
+         LineIsOffscreen(editor, render_bufs_p->first_line + end_row - 1,
+                         scroll_y)) {
+    end_row--;
+  }
+  editor->shown_first_line = render_bufs_p->first_line + first_row;
+  editor->shown_end_line = render_bufs_p->first_line + end_row;
+  size_t rows_above =
+      wrap_index_row_of_line(&editor->wrap, editor->shown_first_line);
+  size_t rows_below =
+      wrap_index_total_rows(&editor->wrap) -
+      wrap_index_row_of_line(&editor->wrap, editor->shown_end_line);
+  float gutter_width = GutterWidth(editor);
 
   CLAY({.id = CLAY_ID("OuterContainer"),
         .layout = {.sizing = {.width = CLAY_SIZING_GROW(0),
                               .height = CLAY_SIZING_GROW(0)},
                    .layoutDirection = CLAY_TOP_TO_BOTTOM,
-                   .padding = {16, 16, 16, 16},
+                   .padding = {TEXT_AREA_PADDING, TEXT_AREA_PADDING,
+                               TEXT_AREA_PADDING, TEXT_AREA_PADDING},
                    /* .childGap = 16 */},
-        .backgroundColor = {50, 50, 50, 255}}) {
-    for (size_t line_number = 1;
-         line_number <= render_bufs_p->num_line_breaks + 1; line_number++) {
-      CLAY({.id = CLAY_ID("LineContainer"),
+        .backgroundColor = {50, 50, 50, 255},
+        .scroll = {.vertical = true}}) {
+    if (restoreScroll) {
+      Clay_ScrollContainerData scroll_data =
+          Clay_GetScrollContainerData(CLAY_ID("OuterContainer"));
+      if (scroll_data.found) {
+        scroll_data.scrollPosition->y = restoreScrollY;
+      }
+      restoreScroll = false;
+    }
+    CLAY({.id = CLAY_ID("SpacerAbove"),
+          .layout = {.sizing = {.width = CLAY_SIZING_GROW(0),
+                                .height = CLAY_SIZING_FIXED(rows_above *
+                                                            LINE_HEIGHT)}}}) {}
+    for (size_t row = first_row; row < end_row; row++) {
+      size_t line_number = render_bufs_p->first_line + row;
+      size_t line_rows = wrap_index_rows(&editor->wrap, line_number);
+      CLAY({.id = CLAY_IDI("LineContainer", line_number),
             .layout = {.sizing = {.width = CLAY_SIZING_GROW(0),
-                                  .height = CLAY_SIZING_FIXED(40)},
-                       .childAlignment = {.y = CLAY_ALIGN_Y_CENTER},
-                       .childGap = 10},
+                                  .height = CLAY_SIZING_FIXED(line_rows *
+                                                              LINE_HEIGHT)},
+                       .childGap = LINE_CHILD_GAP},
             .backgroundColor = {50, 50, 50, 50}}) {
-        CLAY({.id = CLAY_ID("LineNumberContainer"),
-              .layout = {.sizing = {.width = CLAY_SIZING_PERCENT(0.05f),
+        CLAY({.id = CLAY_IDI("LineNumberContainer", line_number),
+              .layout = {.sizing = {.width = CLAY_SIZING_FIXED(gutter_width),
                                     .height = CLAY_SIZING_GROW(0)},
-                         .childAlignment = {.x = CLAY_ALIGN_X_CENTER,
-                                            .y = CLAY_ALIGN_Y_CENTER}},
+                         .padding = {.top = (uint16_t)((LINE_HEIGHT -
+                                                        TEXT_FONT_SIZE) /
+                                                       2)},
+                         .childAlignment = {.x = CLAY_ALIGN_X_CENTER}},
               .backgroundColor = {0, 0, 0, 255}}) {
           Clay_String curr_line_number_str = (Clay_String){
               .isStaticallyAllocated = false,
-              .length = strlen(render_bufs_p->line_numbers[line_number]),
-              .chars = render_bufs_p->line_numbers[line_number],
+              .length = strlen(render_bufs_p->line_numbers[row]),
+              .chars = render_bufs_p->line_numbers[row],
           };
           CLAY_TEXT(curr_line_number_str,
                     CLAY_TEXT_CONFIG({
-                        .fontSize = 30,
+                        .fontSize = TEXT_FONT_SIZE,
                         .textColor = COLOR_BLUE,
                         .textAlignment = CLAY_TEXT_ALIGN_CENTER,
                     }));
         }
         CLAY({
-            .id = CLAY_ID("LineTextCursorContainer"),
+            .id = CLAY_IDI("LineTextCursorContainer", line_number),
             .layout =
                 {
                     .sizing = {.width = CLAY_SIZING_GROW(0),
                                .height = CLAY_SIZING_GROW(0)},
-                    .childGap = 2,
-                    .childAlignment = {.y = CLAY_ALIGN_Y_CENTER},
+                    .layoutDirection = CLAY_TOP_TO_BOTTOM,
                 },
         }) {
-          size_t line_end = (line_number == render_bufs_p->num_line_breaks + 1)
-                                ? render_bufs_p->edit_text_len
-                                : render_bufs_p->line_break_pos[line_number];
-          size_t line_start =
-              render_bufs_p->line_break_pos[line_number - 1] + 1;
-          size_t line_len = line_end - line_start;
-          Clay_String curr_line = (Clay_String){
-              .isStaticallyAllocated = false,
-              .length = line_len,
-              .chars = render_bufs_p->edit_text_buf + line_start,
-          };
-          CLAY_TEXT(curr_line,
-                    CLAY_TEXT_CONFIG({
-                        .fontSize = 30, .textColor = {200, 200, 200, 255},
-                        //.textAlignment = CLAY_TEXT_ALIGN_CENTER,
-                    }));
-
-          // TODO: LOOOL FIX THIS
-          if (line_number == render_bufs_p->cursor_line &&
-              editor->curs.should_render) {
-            CLAY(
-                {.id = CLAY_ID("CursorHack"),
-                 .layout = {.sizing = {.width = CLAY_SIZING_FIXED(CURSOR_WIDTH),
-                                       .height = CLAY_SIZING_FIXED(30)}},
-                 .floating =
-                     {
-                         .attachTo = CLAY_ATTACH_TO_PARENT,
-                         .offset = {.x = render_bufs_p->cursor_offset *
-                                         spaceWidth,
-                                    .y = 5}, // magic number = (parent container
-                                             // height - fontsize) / 2
-                         .attachPoints = CLAY_ATTACH_POINT_LEFT_TOP,
-                         .zIndex = 1,
-                     },
-                 .backgroundColor = {200, 200, 200, 255}});
+          GetRowOffsets(editor, render_bufs_p, row);
+          Clay_String row_text = GetRowText(render_bufs_p, row);
+          size_t num_segments;
+          size_t *starts =
+              GetRowSegments(editor, render_bufs_p, row, &num_segments);
+          uint8_t *styles = GetRowStyles(editor, render_bufs_p, row);
+          // only the visual rows in view of a long line are declared
+          size_t line_row = wrap_index_row_of_line(&editor->wrap, line_number);
+          size_t segment = 0;
+          while (segment + 1 < num_segments &&
+                 RowsAreOffscreen(line_row + segment, 1, scroll_y)) {
+            segment++;
+          }
+          if (segment > 0) {
+            CLAY({.layout = {.sizing = {.height = CLAY_SIZING_FIXED(
+                                            segment * LINE_HEIGHT)}}}) {}
+          }
+          for (; segment < num_segments &&
+                 (segment == 0 ||
+                  !RowsAreOffscreen(line_row + segment, 1, scroll_y));
+               segment++) {
+            size_t seg_start = starts[segment];
+            size_t seg_end = segment + 1 < num_segments
+                                 ? starts[segment + 1]
+                                 : (size_t)row_text.length;
+            CLAY({.layout = {.sizing = {.width = CLAY_SIZING_GROW(0),
+                                        .height =
+                                            CLAY_SIZING_FIXED(LINE_HEIGHT)},
+                             .childAlignment = {.y = CLAY_ALIGN_Y_CENTER}}}) {
+              for (size_t run = seg_start, run_len; run < seg_end;
+                   run += run_len) {
+                run_len =
+                    StyleRunLength(row_text.chars, styles, run, seg_end);
+                CLAY_TEXT(((Clay_String){.length = run_len,
+                                         .chars = row_text.chars + run}),
+                          CLAY_TEXT_CONFIG({
+                              .fontSize = TEXT_FONT_SIZE,
+                              .textColor = HIGHLIGHT_COLORS[styles[run]],
+                              .wrapMode = CLAY_TEXT_WRAP_NONE,
+                          }));
+              }
+            }
           }
         }
       }
     }
+    CLAY({.id = CLAY_ID("SpacerBelow"),
+          .layout = {.sizing = {.width = CLAY_SIZING_GROW(0),
+                                .height = CLAY_SIZING_FIXED(rows_below *
+                                                            LINE_HEIGHT)}}}) {}
+  }
+  if (editor->find.active) {
+    find_state *fs = &editor->find;
+    const char *mode = fs->regex ? "Regex" : "Find";
+    const char *more = fs->searching ? "..." : "";
+    size_t label_len = LabelLength(
+        snprintf(fs->label, sizeof(fs->label), "%s: %.*s", mode,
+                 (int)fs->query_len, fs->query),
+        sizeof(fs->label));
+    if (fs->replacing) {
+      char *replace = fs->label + label_len;
+      size_t replace_size = sizeof(fs->label) - label_len;
+      label_len += LabelLength(snprintf(replace, replace_size,
+                                        "  Replace: %.*s",
+                                        (int)fs->replacement_len,
+                                        fs->replacement),
+                               replace_size);
+    }
+    char *status = fs->label + label_len;
+    size_t status_size = sizeof(fs->label) - label_len;
+    label_len += LabelLength(
+        fs->error != NULL
+            ? snprintf(status, status_size, "  %s", fs->error)
+        : fs->current < fs->matches.count
+            ? snprintf(status, status_size, "  %zu/%zu%s", fs->current + 1,
+                       fs->matches.count, more)
+            : snprintf(status, status_size, "  %zu found%s",
+                       fs->matches.count, more),
+        status_size);
+    CLAY({.id = CLAY_ID("FindBar"),
+          .layout = {.padding = {8, 8, 4, 4}},
+          .backgroundColor = {0, 0, 0, 230},
+          .floating = {.attachTo = CLAY_ATTACH_TO_ROOT,
+                       .attachPoints = {.element = CLAY_ATTACH_POINT_RIGHT_TOP,
+                                        .parent = CLAY_ATTACH_POINT_RIGHT_TOP},
+                       .offset = {-TEXT_AREA_PADDING, TEXT_AREA_PADDING},
+                       .zIndex = 1}}) {
+      CLAY_TEXT(((Clay_String){.length = label_len, .chars = fs->label}),
+                CLAY_TEXT_CONFIG({
+                    .fontSize = TEXT_FONT_SIZE,
+                    .textColor = COLOR_ORANGE,
+                    .wrapMode = CLAY_TEXT_WRAP_NONE,
+                }));
+    }
+  }
+  if (editor->go_to.active) {
+    goto_state *gs = &editor->go_to;
+    size_t label_len = LabelLength(snprintf(gs->label, sizeof(gs->label),
+                                            "Go to byte: %.*s", (int)gs->len,
+                                            gs->digits),
+                                   sizeof(gs->label));
+    CLAY({.id = CLAY_ID("GotoBar"),
+          .layout = {.padding = {8, 8, 4, 4}},
+          .backgroundColor = {0, 0, 0, 230},
+          .floating = {.attachTo = CLAY_ATTACH_TO_ROOT,
+                       .attachPoints = {.element = CLAY_ATTACH_POINT_RIGHT_TOP,
+                                        .parent = CLAY_ATTACH_POINT_RIGHT_TOP},
+                       .offset = {-TEXT_AREA_PADDING, TEXT_AREA_PADDING},
+                       .zIndex = 1}}) {
+      CLAY_TEXT(((Clay_String){.length = label_len, .chars = gs->label}),
+                CLAY_TEXT_CONFIG({
+                    .fontSize = TEXT_FONT_SIZE,
+                    .textColor = COLOR_ORANGE,
+                    .wrapMode = CLAY_TEXT_WRAP_NONE,
+                }));
+    }
+  }
+  if (editor->viewing) {
+    CLAY({.id = CLAY_ID("ViewBar"),
+          .layout = {.padding = {8, 8, 4, 4}},
+          .backgroundColor = {0, 0, 0, 230},
+          .floating = {.attachTo = CLAY_ATTACH_TO_ROOT,
+                       .attachPoints = {.element =
+                                            CLAY_ATTACH_POINT_RIGHT_BOTTOM,
+                                        .parent =
+                                            CLAY_ATTACH_POINT_RIGHT_BOTTOM},
+                       .offset = {-TEXT_AREA_PADDING, -TEXT_AREA_PADDING},
+                       .zIndex = 1}}) {
+      CLAY_TEXT(((Clay_String){.length = strlen(editor->view_label),
+                               .chars = editor->view_label}),
+                CLAY_TEXT_CONFIG({
+                    .fontSize = TEXT_FONT_SIZE,
+                    .textColor = COLOR_BLUE,
+                    .wrapMode = CLAY_TEXT_WRAP_NONE,
+                }));
+    }
+  }
+  if (editor->loading) {
+    file_loader *fl = &editor->loader;
+    float fraction = fl->len > 0 ? (float)fl->taken / fl->len : 1.0f;
+    CLAY({.id = CLAY_ID("LoadBar"),
+          .layout = {.layoutDirection = CLAY_TOP_TO_BOTTOM,
+                     .padding = {8, 8, 4, 8},
+                     .childGap = 4},
+          .backgroundColor = {0, 0, 0, 230},
+          .floating = {.attachTo = CLAY_ATTACH_TO_ROOT,
+                       .attachPoints = {.element =
+                                            CLAY_ATTACH_POINT_RIGHT_BOTTOM,
+                                        .parent =
+                                            CLAY_ATTACH_POINT_RIGHT_BOTTOM},
+                       .offset = {-TEXT_AREA_PADDING, -TEXT_AREA_PADDING},
+                       .zIndex = 1}}) {
+      CLAY_TEXT(((Clay_String){.length = strlen(editor->load_label),
+                               .chars = editor->load_label}),
+                CLAY_TEXT_CONFIG({
+                    .fontSize = TEXT_FONT_SIZE,
+                    .textColor = COLOR_BLUE,
+                    .wrapMode = CLAY_TEXT_WRAP_NONE,
+                }));
+      CLAY({.id = CLAY_ID("LoadTrack"),
+            .layout = {.sizing = {.width = CLAY_SIZING_FIXED(LOAD_BAR_WIDTH),
+                                  .height =
+                                      CLAY_SIZING_FIXED(LOAD_BAR_HEIGHT)}},
+            .backgroundColor = {80, 80, 80, 255}}) {
+        CLAY({.id = CLAY_ID("LoadDone"),
+              .layout = {.sizing = {.width = CLAY_SIZING_PERCENT(fraction),
+                                    .height = CLAY_SIZING_GROW(0)}},
+              .backgroundColor = COLOR_BLUE}) {}
+      }
+    }
   }
   return Clay_EndLayout();
 }
 
 bool debugEnabled = false;
 
+bool IsShiftDown(void) {
+  return IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+}
+
+bool IsControlDown(void) {
+  return IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+}
+
+// font size changes only cost a relayout and a rewrap, the glyphs of every
+// size come out of the same atlas in SDF mode. The line at the top of the
+// view stays put
+void SetZoom(editor_state *editor, float new_zoom) {
+  new_zoom = fminf(fmaxf(new_zoom, ZOOM_MIN), ZOOM_MAX);
+  if (new_zoom == zoom) {
+    return;
+  }
+  size_t top_line = LineAtScrollY(editor, GetTextAreaScrollY());
+  zoom = new_zoom;
+  // glyph offsets were measured at the old size
+  memset(editor->metrics.measured, 0, sizeof(editor->metrics.measured));
+  UpdateLineIndexes(editor);
+  ScrollToLine(editor, top_line);
+}
+
+bool HasSelection(editor_state *editor) {
+  size_t sel_start, sel_end;
+  return ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end) != 0;
+}
+
+// removes the selected text in one range delete, returns whether there was
+// anything selected
+bool DeleteSelection(editor_state *editor) {
+  bool selected = HasSelection(editor);
+  if (selected) {
+    ptbl_delete_selection(&editor->ptbl);
+    editor->reload_data = true;
+  }
+  ptbl_clear_selection(&editor->ptbl);
+  return selected;
+}
+
+void CopySelection(editor_state *editor) {
+  size_t sel_start, sel_end;
+  if (!ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end)) {
+    return;
+  }
+  char *text = (char *)malloc(sel_end - sel_start + 1);
+  if (text == NULL) {
+    fprintf(stderr, "Error: copy allocation failed");
+    return;
+  }
+  size_t len =
+      ptbl_copy_range(&editor->ptbl, sel_start, sel_end - sel_start, text);
+  text[len] = '\0';
+  SetClipboardText(text);
+  free(text);
+}
+
+// replaces the selection with text in a single insert
+void InsertText(editor_state *editor, const char *text, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  AcquireTable(editor);
+  DeleteSelection(editor);
+  ptbl_insert_text(&editor->ptbl, text, len);
+  editor->reload_data = true;
+}
+
+// the clipboard text goes into the add buffer with a single copy
+void PasteClipboard(editor_state *editor) {
+  const char *text = GetClipboardText();
+  if (text != NULL) {
+    InsertText(editor, text, strlen(text));
+  }
+}
+
+// searches the whole table for the query again after it changed,
+// cancelling the search before it. Large tables are searched by the search
+// pool, their matches are picked up here as they come in
+void RunFind(editor_state *editor) {
+  find_state *fs = &editor->find;
+  if (fs->dirty) {
+    AcquireTable(editor);
+    search_index_free(&fs->matches);
+    rx_free(fs->rx);
+    fs->rx = NULL;
+    fs->error = search_pool_submit(&editor->search, fs->query, fs->query_len,
+                                   fs->regex);
+    if (fs->regex && fs->error == NULL) {
+      fs->rx = rx_compile(fs->query, fs->query_len, 0, &fs->error);
+    }
+    fs->taken = 0;
+    fs->current = SIZE_MAX;
+    fs->dirty = false;
+    fs->searching = true;
+    editor->relayout = true;
+  }
+  if (fs->searching) {
+    fs->batch.count = 0;
+    fs->searching =
+        search_pool_poll(&editor->search, &fs->taken, &fs->batch);
+    search_index_append(&fs->matches, &fs->batch);
+    if (fs->batch.count > 0 || !fs->searching) {
+      editor->relayout = true;
+    }
+  }
+}
+
+// selects a match of a viewed file past its window. Each call scans up to
+// VIEW_FIND_BYTES, the window moves to the match or to where the scan
+// stopped for the next call to carry on from, wrapping around the file
+void FindInFile(editor_state *editor, bool forward) {
+  find_state *fs = &editor->find;
+  file_view *fv = &editor->view;
+  size_t sel_start, sel_end;
+  if (!ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end)) {
+    sel_start = editor->ptbl.global_cursor_pos;
+  }
+  size_t from = fv->win_start +
+                (forward ? editor->ptbl.global_cursor_pos : sel_start);
+  if (forward && from == fv->len) {
+    from = 0;
+  } else if (!forward && from == 0) {
+    from = fv->len;
+  }
+  size_t start, len, stop;
+  bool found = file_view_find(fv, from, forward, fs->query, fs->query_len,
+                              fs->regex ? fs->rx : NULL, &start, &len, &stop);
+  size_t at = found ? start : stop;
+  ViewGoTo(editor, at);
+  at -= fv->win_start;
+  if (found) {
+    ptbl_start_selection(&editor->ptbl);
+    ptbl_update_global_cursor_pos(&editor->ptbl, at + len);
+  }
+  fs->current = SIZE_MAX;
+  ScrollToLine(editor, wrap_index_line_of_pos(&editor->wrap, at));
+}
+
+// selects the first match after the cursor, or the last one before the
+// selection, wrapping around the ends of the table. A viewed file is
+// searched past the window before wrapping
+void FindNext(editor_state *editor, bool forward) {
+  find_state *fs = &editor->find;
+  RunFind(editor);
+  size_t sel_start, sel_end;
+  if (!ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end)) {
+    sel_start = editor->ptbl.global_cursor_pos;
+  }
+  if (editor->viewing && !fs->searching && fs->error == NULL &&
+      fs->query_len > 0) {
+    size_t after = search_index_lower_bound(&fs->matches,
+                                            editor->ptbl.global_cursor_pos);
+    size_t before = search_index_lower_bound(&fs->matches, sel_start);
+    if (forward ? after == fs->matches.count : before == 0) {
+      FindInFile(editor, forward);
+      return;
+    }
+  }
+  if (fs->matches.count == 0) {
+    return;
+  }
+  size_t i;
+  if (forward) {
+    i = search_index_lower_bound(&fs->matches,
+                                 editor->ptbl.global_cursor_pos);
+    i = i < fs->matches.count ? i : 0;
+  } else {
+    i = search_index_lower_bound(&fs->matches, sel_start);
+    i = i > 0 ? i - 1 : fs->matches.count - 1;
+  }
+  size_t start, len;
+  search_index_get(&fs->matches, i, &start, &len);
+  ptbl_update_global_cursor_pos(&editor->ptbl, start);
+  ptbl_start_selection(&editor->ptbl);
+  ptbl_update_global_cursor_pos(&editor->ptbl, start + len);
+  fs->current = i;
+
+  size_t line = wrap_index_line_of_pos(&editor->wrap, start);
+  if (LineIsOffscreen(editor, line, GetTextAreaScrollY())) {
+    ScrollToLine(editor, line);
+  }
+  editor->reload_data = true;
+}
+
+// replaces every match with the replacement in one pass over the pieces,
+// once the search pool has found them all
+void ReplaceAll(editor_state *editor) {
+  find_state *fs = &editor->find;
+  RunFind(editor);
+  if (editor->viewing || fs->searching || fs->error != NULL ||
+      fs->matches.count == 0) {
+    return;
+  }
+  AcquireTable(editor);
+  search_results all = {0};
+  search_index_copy(&fs->matches, &all);
+  ptbl_replace_all(&editor->ptbl, all.offsets, all.lens, all.count,
+                   fs->replacement, fs->replacement_len);
+  search_results_free(&all);
+  fs->dirty = true; // looked for again in the new text
+  editor->reload_data = true;
+}
+
+// puts the cursor on byte pos of the file, or of the table when no file is
+// viewed, and scrolls its line to the top
+void GoToOffset(editor_state *editor, size_t pos) {
+  AcquireTable(editor);
+  ptbl_clear_selection(&editor->ptbl);
+  if (editor->viewing) {
+    ViewGoTo(editor, pos);
+  } else {
+    size_t len = ptbl_length(&editor->ptbl);
+    ptbl_update_global_cursor_pos(&editor->ptbl, pos < len ? pos : len);
+  }
+  ScrollToLine(editor, wrap_index_line_of_pos(&editor->wrap,
+                                              editor->ptbl.global_cursor_pos));
+  editor->reload_data = true;
+}
+
+// keys that act on the go to bar while it is open, returns whether the key
+// was used
+bool HandleGotoKey(editor_state *editor, int keycode) {
+  goto_state *gs = &editor->go_to;
+  switch (keycode) {
+  case KEY_BACKSPACE:
+    gs->len -= gs->len > 0;
+    editor->relayout = true;
+    return true;
+  case KEY_ENTER:
+    if (gs->len > 0) {
+      gs->digits[gs->len] = '\0';
+      GoToOffset(editor, (size_t)strtoull(gs->digits, NULL, 10));
+    }
+    gs->active = false;
+    editor->relayout = true;
+    return true;
+  }
+  return false;
+}
+
+// opening the find bar starts from the selected text, if it is a single line
+void ToggleFind(editor_state *editor) {
+  find_state *fs = &editor->find;
+  fs->active = !fs->active;
+  editor->go_to.active = false;
+  editor->relayout = true;
+  if (!fs->active && fs->searching) {
+    AcquireTable(editor);
+    search_pool_cancel(&editor->search);
+    fs->searching = false;
+    fs->dirty = true;
+  }
+  size_t sel_start, sel_end;
+  if (!fs->active ||
+      !ptbl_selection_range(&editor->ptbl, &sel_start, &sel_end) ||
+      sel_end - sel_start >= FIND_QUERY_MAX) {
+    return;
+  }
+  char query[FIND_QUERY_MAX];
+  size_t len = ptbl_copy_range(&editor->ptbl, sel_start, sel_end - sel_start,
+                               query);
+  if (memchr(query, '\n', len) == NULL) {
+    memcpy(fs->query, query, len);
+    fs->query_len = len;
+    fs->dirty = true;
+  }
+}
+
+// keys that act on the query while the find bar is open, returns whether
+// the key was used
+bool HandleFindKey(editor_state *editor, int keycode) {
+  find_state *fs = &editor->find;
+  switch (keycode) {
+  case KEY_BACKSPACE: {
+    // drop the last codepoint
+    char *text = fs->replacing ? fs->replacement : fs->query;
+    size_t *len_p = fs->replacing ? &fs->replacement_len : &fs->query_len;
+    while (*len_p > 0 && (text[--*len_p] & 0xC0) == 0x80) {
+    }
+    fs->dirty = fs->dirty || !fs->replacing;
+    editor->relayout = true;
+    return true;
+  }
+  case KEY_ENTER:
+    if (fs->replacing) {
+      ReplaceAll(editor);
+    } else {
+      FindNext(editor, !IsShiftDown());
+    }
+    return true;
+  case KEY_H:
+    if (IsControlDown()) {
+      fs->replacing = !fs->replacing;
+      editor->relayout = true;
+      return true;
+    }
+    break;
+  case KEY_R:
+    if (IsControlDown()) {
+      fs->regex = !fs->regex;
+      fs->dirty = true;
+      editor->relayout = true;
+      return true;
+    }
+    break;
+  }
+  return false;
+}
+
+// keys that would change the text, ignored while a file is viewed
+bool KeyEdits(int keycode) {
+  switch (keycode) {
+  case KEY_BACKSPACE:
+  case KEY_ENTER:
+  case KEY_TAB:
+    return true;
+  case KEY_X:
+  case KEY_V:
+    return IsControlDown();
+  }
+  return false;
+}
+
 void UpdateEditorState(editor_state *editor, render_buffers *render_bufs_p) {
   update_cursor_state(&editor->curs);
+  HandleMouse(editor, render_bufs_p);
 
-  char c;
-  int reload_data = 1; // consider removing
-  while ((c = GetCharPressed()) > 0) {
-    ptbl_insert_char(&editor->ptbl, c);
-    reload_data = 1;
+  // everything typed this frame is UTF-8 encoded and inserted as one edit
+  char typed[INPUT_BATCH_SIZE];
+  size_t typed_len = 0;
+  int codepoint;
+  while ((codepoint = GetCharPressed()) > 0) {
+    int utf8_size;
+    const char *utf8 = CodepointToUTF8(codepoint, &utf8_size);
+    if (editor->find.active) {
+      find_state *fs = &editor->find;
+      char *text = fs->replacing ? fs->replacement : fs->query;
+      size_t *len_p = fs->replacing ? &fs->replacement_len : &fs->query_len;
+      if (*len_p + utf8_size <= FIND_QUERY_MAX) {
+        memcpy(text + *len_p, utf8, utf8_size);
+        *len_p += utf8_size;
+        fs->dirty = fs->dirty || !fs->replacing;
+        editor->relayout = true;
+      }
+      continue;
+    }
+    if (editor->go_to.active) {
+      goto_state *gs = &editor->go_to;
+      if (codepoint >= '0' && codepoint <= '9' &&
+          gs->len + 1 < GOTO_DIGITS_MAX) {
+        gs->digits[gs->len++] = (char)codepoint;
+        editor->relayout = true;
+      }
+      continue;
+    }
+    if (editor->viewing) {
+      continue; // read only
+    }
+    if (typed_len + utf8_size > sizeof(typed)) {
+      InsertText(editor, typed, typed_len);
+      typed_len = 0;
+    }
+    memcpy(typed + typed_len, utf8, utf8_size);
+    typed_len += utf8_size;
   }
+  InsertText(editor, typed, typed_len);
 
   int keycode;
   while ((keycode = GetKeyPressed()) > 0) {
     printf("%d\n", keycode);
+    AcquireTable(editor);
+    if (editor->find.active && HandleFindKey(editor, keycode)) {
+      continue;
+    }
+    if (editor->go_to.active && HandleGotoKey(editor, keycode)) {
+      continue;
+    }
+    if (editor->viewing && KeyEdits(keycode)) {
+      continue;
+    }
     switch (keycode) {
     case KEY_LEFT:
-      ptbl_update_global_cursor_pos(&editor->ptbl,
-                                    editor->ptbl.global_cursor_pos - 1);
-      break;
     case KEY_RIGHT:
-      ptbl_update_global_cursor_pos(&editor->ptbl,
-                                    editor->ptbl.global_cursor_pos + 1);
+      if (!IsShiftDown()) {
+        ptbl_clear_selection(&editor->ptbl);
+      } else if (!editor->ptbl.selection_active) {
+        ptbl_start_selection(&editor->ptbl);
+      }
+      MoveCursor(editor, render_bufs_p, keycode == KEY_LEFT ? -1 : 1);
       break;
     case KEY_BACKSPACE:
-      if (editor->ptbl.global_cursor_pos > 0) {
-        ptbl_delete_char(&editor->ptbl);
-        reload_data = 1;
+      if (!DeleteSelection(editor)) {
+        DeleteBackward(editor, render_bufs_p);
       }
       break;
     case KEY_ENTER:
+      DeleteSelection(editor);
       ptbl_insert_char(&editor->ptbl, '\n');
-      reload_data = 1;
+      editor->reload_data = true;
+      break;
+    case KEY_TAB:
+      if (HasSelection(editor)) {
+        ptbl_indent_selection(&editor->ptbl, '\t');
+      } else {
+        ptbl_insert_char(&editor->ptbl, '\t');
+      }
+      editor->reload_data = true;
+      break;
+    case KEY_A:
+      if (IsControlDown()) {
+        editor->ptbl.selection_anchor = 0;
+        editor->ptbl.selection_active = 1;
+        ptbl_update_global_cursor_pos(&editor->ptbl,
+                                      ptbl_length(&editor->ptbl));
+        editor->reload_data = true;
+      }
+      break;
+    case KEY_C:
+      if (IsControlDown()) {
+        CopySelection(editor);
+      }
+      break;
+    case KEY_X:
+      if (IsControlDown()) {
+        CopySelection(editor);
+        DeleteSelection(editor);
+      }
+      break;
+    case KEY_V:
+      if (IsControlDown()) {
+        PasteClipboard(editor);
+      }
+      break;
+    case KEY_F:
+      if (IsControlDown()) {
+        ToggleFind(editor);
+      }
+      break;
+    case KEY_H:
+      if (IsControlDown()) {
+        ToggleFind(editor);
+        editor->find.replacing = true;
+      }
+      break;
+    case KEY_EQUAL:
+    case KEY_MINUS:
+      if (IsControlDown()) {
+        SetZoom(editor, keycode == KEY_EQUAL ? zoom * ZOOM_STEP
+                                             : zoom / ZOOM_STEP);
+      }
+      break;
+    case KEY_ZERO:
+      if (IsControlDown()) {
+        SetZoom(editor, 1.0f);
+      }
+      break;
+    case KEY_L:
+      if (IsControlDown() && editor->loading) {
+        file_loader_cancel(&editor->loader);
+      }
+      break;
+    case KEY_G:
+      if (IsControlDown()) {
+        if (editor->find.active) {
+          ToggleFind(editor);
+        }
+        editor->go_to = (goto_state){.active = !editor->go_to.active};
+        editor->relayout = true;
+      }
+      break;
+    case KEY_HOME:
+    case KEY_END:
+      if (IsControlDown()) {
+        bool home = keycode == KEY_HOME;
+        if (editor->viewing) {
+          ViewGoTo(editor, home ? 0 : editor->view.len);
+        }
+        ptbl_clear_selection(&editor->ptbl);
+        ptbl_update_global_cursor_pos(&editor->ptbl,
+                                      home ? 0 : ptbl_length(&editor->ptbl));
+        ScrollToLine(editor, home ? 1 : editor->wrap.num_lines);
+        editor->reload_data = true;
+      }
       break;
     }
   }
-
-  if (reload_data) {
-    load_ptbl_data(&editor->ptbl, render_bufs_p);
-  }
 }
 
 void UpdateDrawFrame(editor_state *editor, render_buffers *render_bufs_p) {
@@ -203,24 +1687,60 @@ void UpdateDrawFrame(editor_state *editor, render_buffers *render_bufs_p) {
     debugEnabled = !debugEnabled;
     Clay_SetDebugModeEnabled(debugEnabled);
   }
-  //----------------------------------------------------------------------------------
-  // Handle scroll containers
-  Clay_Vector2 mousePosition =
-      RAYLIB_VECTOR2_TO_CLAY_VECTOR2(GetMousePosition());
-  Clay_SetPointerState(mousePosition, IsMouseButtonDown(0));
-  Clay_SetLayoutDimensions(
-      (Clay_Dimensions){(float)GetScreenWidth(), (float)GetScreenHeight()});
-
-  // Generate the auto layout for rendering
-  double currentTime = GetTime();
+  float scroll_distance = update_scroll_state(&editor->scroll, mouseWheelY,
+                                              GetFrameTime());
   UpdateEditorState(editor, render_bufs_p);
-  Clay_RenderCommandArray renderCommands = CreateLayout(editor, render_bufs_p);
+  UpdateLoad(editor, render_bufs_p);
+  UpdateLineIndexes(editor);
+  UpdateView(editor);
+  UpdateHighlights(editor);
+  if (editor->find.active) {
+    RunFind(editor);
+  }
+
+  Clay_Dimensions screen_dimensions = {(float)GetScreenWidth(),
+                                       (float)GetScreenHeight()};
+  Clay_Dimensions layout_dimensions =
+      Clay_GetCurrentContext()->layoutDimensions;
+  if (editor->reload_data || scroll_distance != 0 || mouseWheelX != 0 ||
+      debugEnabled || screen_dimensions.width != layout_dimensions.width ||
+      screen_dimensions.height != layout_dimensions.height) {
+    editor->relayout = true;
+  }
+
+  double currentTime = GetTime();
+  if (editor->relayout) {
+    //----------------------------------------------------------------------------------
+    // Handle scroll containers
+    Clay_Vector2 mousePosition =
+        RAYLIB_VECTOR2_TO_CLAY_VECTOR2(GetMousePosition());
+    Clay_SetPointerState(mousePosition, IsMouseButtonDown(0));
+    Clay_SetLayoutDimensions(screen_dimensions);
+    // clay scales wheel deltas by 10px, feed it the kinetic distance instead.
+    // drag scrolling is off, dragging in the text area is for the cursor
+    float scroll_before = GetTextAreaScrollY();
+    Clay_UpdateScrollContainers(
+        false, (Clay_Vector2){mouseWheelX, scroll_distance / 10},
+        GetFrameTime());
+    if (scroll_distance != 0 && GetTextAreaScrollY() == scroll_before) {
+      editor->scroll.velocity = 0; // hit the top or bottom
+    }
+
+    // Generate the auto layout for rendering
+    UpdateViewport(editor, render_bufs_p);
+    editor->render_commands = CreateLayout(editor, render_bufs_p);
+    editor->relayout = false;
+  }
+  ReleaseTable(editor);
 
   // RENDERING ---------------------------------
   BeginDrawing();
   ClearBackground(BLACK);
   currentTime = GetTime();
-  Clay_Raylib_Render(renderCommands, editor->fonts);
+  Clay_Raylib_Render(editor->render_commands, editor->fonts);
+  DrawMatches(editor, render_bufs_p);
+  DrawSelection(editor, render_bufs_p);
+  DrawCursor(editor, render_bufs_p);
   EndDrawing();
 
   //----------------------------------------------------------------------------------
@@ -241,19 +1761,74 @@ void HandleClayErrors(Clay_ErrorData errorData) {
   }
 }
 
+Clay_Arena CreateClayArena(void) {
+  uint32_t totalMemorySize = Clay_MinMemorySize();
+  char *memory = (char *)malloc(totalMemorySize);
+  if (memory == NULL) {
+    fprintf(stderr, "Error: clay arena allocation failed");
+    exit(1);
+  }
+  return Clay_CreateArenaWithCapacityAndMemory(totalMemorySize, memory);
+}
+
+// size clay for a maximized window up front so growing is rare
+void PresizeClay(void) {
+  int32_t visible_lines =
+      GetMonitorHeight(GetCurrentMonitor()) / LINE_HEIGHT + 2;
+  int32_t element_count = visible_lines * CLAY_ELEMENTS_PER_LINE * 2;
+  if (element_count < CLAY_MIN_ELEMENT_COUNT) {
+    element_count = CLAY_MIN_ELEMENT_COUNT;
+  }
+  Clay_SetMaxElementCount(element_count);
+  Clay_SetMaxMeasureTextCacheWordCount(
+      element_count * 2 > visible_lines * CLAY_WORDS_PER_LINE
+          ? element_count * 2
+          : visible_lines * CLAY_WORDS_PER_LINE);
+}
+
+// Clay keeps absolute pointers into its arena so the block can't be
+// realloc'd in place. Instead a bigger arena is initialized from the old
+// context (which still holds the doubled capacities), the settings that live
+// in the context are carried over, and only then is the old block freed.
+void GrowClayArena(Clay_Arena *arena_p) {
+  Clay_Context *old_context = Clay_GetCurrentContext();
+  void *measure_text_user_data = old_context->measureTextUserData;
+  Clay_ErrorHandler error_handler = old_context->errorHandler;
+  Clay_Dimensions layout_dimensions = old_context->layoutDimensions;
+  bool debug_enabled = old_context->debugModeEnabled;
+  bool culling_enabled = !old_context->disableCulling;
+  bool incremental_enabled = old_context->incrementalLayoutEnabled;
+  if (!restoreScroll) {
+    restoreScrollY = GetTextAreaScrollY();
+    restoreScroll = true;
+  }
+
+  Clay_Arena new_arena = CreateClayArena();
+  Clay_Initialize(new_arena, layout_dimensions, error_handler);
+  Clay_SetMeasureTextFunction(Raylib_MeasureText, measure_text_user_data);
+  Clay_SetDebugModeEnabled(debug_enabled);
+  Clay_SetCullingEnabled(culling_enabled);
+  Clay_SetIncrementalLayoutEnabled(incremental_enabled);
+
+  free(arena_p->memory);
+  *arena_p = new_arena;
+}
+
 char *textbuf = "hi";
 
-int main(void) {
-  uint64_t totalMemorySize = Clay_MinMemorySize();
-  Clay_Arena clayMemory = Clay_CreateArenaWithCapacityAndMemory(
-      totalMemorySize, malloc(totalMemorySize));
+int main(int argc, char *argv[]) {
+  Clay_Raylib_Initialize(1024, 768, "Clay - Raylib Renderer Example",
+                         FLAG_VSYNC_HINT | FLAG_WINDOW_RESIZABLE |
+                             FLAG_MSAA_4X_HINT);
+  PresizeClay();
+  Clay_Arena clayMemory = CreateClayArena();
   Clay_Initialize(
       clayMemory,
       (Clay_Dimensions){(float)GetScreenWidth(), (float)GetScreenHeight()},
       (Clay_ErrorHandler){HandleClayErrors, 0});
-  Clay_Raylib_Initialize(1024, 768, "Clay - Raylib Renderer Example",
-                         FLAG_VSYNC_HINT | FLAG_WINDOW_RESIZABLE |
-                             FLAG_MSAA_4X_HINT);
+  Clay_SetCullingEnabled(true);
+  // most frames only touch a line or two, let clay reuse the rest
+  Clay_SetIncrementalLayoutEnabled(true);
 
   // Get font path based on platform
   const char *fontPath = NULL;
@@ -271,18 +1846,56 @@ int main(void) {
 #endif
 
   // Load fonts
-  Font fonts[2];
-  fonts[FONT_ID_BODY_24] = LoadFontEx(fontPath, 48, 0, 400);
-  SetTextureFilter(fonts[FONT_ID_BODY_24].texture, TEXTURE_FILTER_BILINEAR);
-  fonts[FONT_ID_BODY_16] = LoadFontEx(fontPath, 32, 0, 400);
-  SetTextureFilter(fonts[FONT_ID_BODY_16].texture, TEXTURE_FILTER_BILINEAR);
+  // glyphs are rasterized on first use, see glyph_cache.h. In SDF mode both
+  // font ids share one atlas
+  glyph_cache font_caches[2] = {0};
+  glyph_cache *fonts[2];
+  if (FONT_SDF) {
+    glyph_cache_load(&font_caches[0], fontPath, FONT_SDF_BASE_SIZE, true);
+    fonts[FONT_ID_BODY_24] = &font_caches[0];
+    fonts[FONT_ID_BODY_16] = &font_caches[0];
+  } else {
+    glyph_cache_load(&font_caches[0], fontPath, 48, false);
+    glyph_cache_load(&font_caches[1], fontPath, 32, false);
+    fonts[FONT_ID_BODY_24] = &font_caches[0];
+    fonts[FONT_ID_BODY_16] = &font_caches[1];
+  }
   Clay_SetMeasureTextFunction(Raylib_MeasureText, fonts);
 
-  // initialize piece table from file
+  // a file is loaded into an empty table in the background, the scratch
+  // buffer is there from the start. Files too large to load are viewed read
+  // only a window at a time, as is any file given with --view. With --follow
+  // appends to the file are loaded as they are written, a file that is
+  // viewed can't be followed
+  const char *path = NULL;
+  bool view = false;
+  bool follow = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--view") == 0) {
+      view = true;
+    } else if (strcmp(argv[i], "--follow") == 0) {
+      follow = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  struct stat st;
+  if (path != NULL && stat(path, &st) == 0 &&
+      (size_t)st.st_size >= VIEW_AUTO_MIN_BYTES) {
+    view = true;
+  }
+  if (path != NULL && view && follow) {
+    fprintf(stderr, "Error: --follow can't be used when %s is viewed read only",
+            path);
+    exit(1);
+  }
   editor_state es = (editor_state){
       .curs = {.cycle_start = GetTime(), .should_render = true},
-      .ptbl = create_piece_table(textbuf, 2),
+      .ptbl = path != NULL ? create_piece_table(NULL, 0)
+                           : create_piece_table(textbuf, 2),
       .fonts = fonts,
+      .reload_data = false,
+      .relayout = true,
       .text_config =
           {
               .fontId = FONT_ID_BODY_16,
@@ -290,7 +1903,42 @@ int main(void) {
               .textColor = {200, 200, 200, 255},
           },
   };
-  ptbl_update_global_cursor_pos(&es.ptbl, 2);
+  if (path != NULL && view) {
+    file_view_open(&es.view, path, VIEW_CACHE_BYTES);
+    es.viewing = true;
+    size_t cps;
+    char *buf = file_view_window(&es.view, 0, &cps);
+    ptbl_replace_original(&es.ptbl, buf, es.view.win_len, cps);
+  } else if (path != NULL) {
+    file_loader_start(&es.loader, path, follow);
+    es.loading = true;
+  } else {
+    ptbl_update_global_cursor_pos(&es.ptbl, 2);
+  }
+  prefetch_start(&es.prefetch, &es.ptbl);
+  es.metrics.glyph_x =
+      (float *)malloc((EDIT_TEXT_BUFFER_MAX_SIZE + 1) * sizeof(float));
+  if (es.metrics.glyph_x == NULL) {
+    fprintf(stderr, "Error: line metrics allocation failed");
+    exit(1);
+  }
+  es.styles.style = (uint8_t *)malloc(EDIT_TEXT_BUFFER_MAX_SIZE);
+  if (es.styles.style == NULL) {
+    fprintf(stderr, "Error: line styles allocation failed");
+    exit(1);
+  }
+  highlight_init(&es.hl, path != NULL
+                             ? hl_language_for_path(path)
+                             : hl_language_by_name(HIGHLIGHT_LANGUAGE));
+  highlight_worker_start(&es.hl_worker, &es.ptbl, &es.prefetch.table_lock,
+                         es.hl.lang);
+  search_pool_start(&es.search, &es.ptbl, &es.prefetch.table_lock);
+  es.segments.starts =
+      (size_t *)malloc(LINE_WRAPS_MAX_SEGMENTS * sizeof(size_t));
+  if (es.segments.starts == NULL) {
+    fprintf(stderr, "Error: line wraps allocation failed");
+    exit(1);
+  }
 
   // initialize render buffers to 0
   render_buffers render_bufs = (render_buffers){
@@ -305,9 +1953,10 @@ int main(void) {
   memset(render_bufs.edit_text_buf, 0, EDIT_TEXT_BUFFER_MAX_SIZE);
   memset(render_bufs.line_break_pos, 0, MAX_LINE_BREAKS);
   for (int i = 0; i < MAX_LINE_BREAKS; i++) {
-    memset(render_bufs.line_numbers[i], 0, 8);
+    memset(render_bufs.line_numbers[i], 0, sizeof(render_bufs.line_numbers[i]));
   }
-  load_ptbl_data(&es.ptbl, &render_bufs);
+  load_ptbl_data(&es.ptbl, &render_bufs, 1, 0,
+                 (GetScreenHeight() / LINE_HEIGHT + 2) * PREFETCH_SCREENS);
 
   //--------------------------------------------------------------------------------------
 
@@ -315,19 +1964,35 @@ int main(void) {
   while (!WindowShouldClose()) // Detect window close button or ESC key
   {
     if (reinitializeClay) {
-      Clay_SetMaxElementCount(8192);
-      totalMemorySize = Clay_MinMemorySize();
-      clayMemory = Clay_CreateArenaWithCapacityAndMemory(
-          totalMemorySize, malloc(totalMemorySize));
-      Clay_Initialize(
-          clayMemory,
-          (Clay_Dimensions){(float)GetScreenWidth(), (float)GetScreenHeight()},
-          (Clay_ErrorHandler){HandleClayErrors, 0});
+      GrowClayArena(&clayMemory);
       reinitializeClay = false;
+      es.relayout = true;
     }
     UpdateDrawFrame(&es, &render_bufs);
   }
+  if (es.viewing) {
+    file_view_close(&es.view);
+  } else if (path != NULL) {
+    file_loader_stop(&es.loader);
+  }
+  highlight_worker_stop(&es.hl_worker);
+  search_pool_stop(&es.search);
+  prefetch_stop(&es.prefetch);
+  free(es.metrics.glyph_x);
+  free(es.segments.starts);
+  free(es.styles.style);
+  highlight_free(&es.hl);
+  search_index_free(&es.find.matches);
+  search_results_free(&es.find.batch);
+  rx_free(es.find.rx);
+  wrap_index_free(&es.wrap);
+  if (es.viewing) {
+    free(es.ptbl.orig_buf); // the window, the table doesn't own it otherwise
+  }
   free_piece_table(&es.ptbl);
+  glyph_cache_unload(&font_caches[0]);
+  glyph_cache_unload(&font_caches[1]);
   Clay_Raylib_Close();
+  free(clayMemory.memory);
   return 0;
 }
@@ -1,8 +1,12 @@
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "../include/line_scan.h"
 #include "../include/piece_table.h"
+#include "../include/utf8.h"
 
 piece_table create_piece_table(char *buf, size_t len) {
   // initialize append only internal buffer
@@ -26,6 +30,7 @@ piece_table create_piece_table(char *buf, size_t len) {
                           .buf_type = ORIGINAL,
                           .start = 0,
                           .len = len,
+                          .cp_len = utf8_count_codepoints(buf, len),
                       }};
   }
 
@@ -42,11 +47,17 @@ piece_table create_piece_table(char *buf, size_t len) {
       .global_cursor_pos = 0,
       .local_cursor_pos = 0,
       .cursor_hint = head,
+      .selection_anchor = 0,
+      .selection_active = 0,
   };
 }
 
 void free_piece_table(piece_table *ptbl_p) {
   free(ptbl_p->add_buffer.buf);
+  for (size_t i = 0; i < ptbl_p->add_buffer.num_retired; i++) {
+    free(ptbl_p->add_buffer.retired[i]);
+  }
+  free(ptbl_p->add_buffer.retired);
 
   pl_node *iter = ptbl_p->piece_list_head_p;
   while (iter != NULL) {
@@ -101,51 +112,156 @@ int ptbl_iterator_end(piece_table_iterator *pti_p) {
   return pti_p->curr_piece_node == NULL;
 }
 
-void create_line_number(render_buffers *render_bufs_p, size_t line) {
-  assert(line < MAX_LINE_BREAKS);
-  if (render_bufs_p->line_numbers[line][0] > 0)
-    return;
-  sprintf(render_bufs_p->line_numbers[line], "%zu", line);
+void create_line_number(render_buffers *render_bufs_p, size_t row) {
+  assert(row < MAX_LINE_BREAKS);
+  sprintf(render_bufs_p->line_numbers[row], "%zu",
+          render_bufs_p->first_line + row);
+}
+
+// finds the piece holding byte pos, or the one after when pos ends a piece,
+// and where it starts. Fails unless pos starts a line other than the first
+static int ptbl_seek_line_start(piece_table *ptbl_p, size_t pos,
+                                 pl_node **node_p, size_t *node_start_p) {
+  size_t start = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    size_t end = start + iter->p.len;
+    if (pos > start && pos <= end) {
+      if (ptbl_piece_chars(ptbl_p, &iter->p)[pos - start - 1] != '\n') {
+        return 0;
+      }
+      *node_p = pos < end ? iter : iter->next_node_p;
+      *node_start_p = pos < end ? start : end;
+      return 1;
+    }
+    start = end;
+  }
+  return 0;
 }
 
-void load_ptbl_data(piece_table *ptbl_p, render_buffers *render_bufs_p) {
+// first_line_pos is where first_line starts, as the wrap index has it. The
+// walk starts there instead of at the top of the table when it checks out,
+// pass 0 to find the line by scanning
+void load_ptbl_data(piece_table *ptbl_p, render_buffers *render_bufs_p,
+                    size_t first_line, size_t first_line_pos,
+                    size_t window_lines) {
   assert(ptbl_p != NULL);
-  // TODO: consider making this an is_empty function
-  if (ptbl_p->piece_list_head_p == NULL) {
-    return;
+  assert(first_line >= 1);
+  if (window_lines == 0 || window_lines > MAX_LINE_BREAKS) {
+    window_lines = MAX_LINE_BREAKS;
   }
 
+  render_bufs_p->first_line = first_line;
+  render_bufs_p->first_line_pos = 0;
+  render_bufs_p->window_lines = window_lines;
   render_bufs_p->line_break_pos[0] = -1;
   render_bufs_p->num_line_breaks = 0;
   render_bufs_p->edit_text_len = 0;
-  create_line_number(render_bufs_p, 1);
+  render_bufs_p->total_lines = 1;
+  render_bufs_p->cursor_line = SIZE_MAX;
+  render_bufs_p->cursor_offset = 0;
 
-  // TODO: get rid of the iterator and all its methods, just make this inline
-  piece_table_iterator pti = create_ptbl_iterator(ptbl_p);
-  while (!ptbl_iterator_end(&pti)) {
-    char c = query_ptbl_iterator(&pti);
-    render_bufs_p->edit_text_buf[render_bufs_p->edit_text_len] = c;
-    if (render_bufs_p->edit_text_len == ptbl_p->global_cursor_pos) {
-      render_bufs_p->cursor_line = render_bufs_p->num_line_breaks + 1;
-      render_bufs_p->cursor_offset =
-          ptbl_p->global_cursor_pos -
-          render_bufs_p->line_break_pos[render_bufs_p->num_line_breaks] - 1;
-    }
-    if (c == '\n') {
-      render_bufs_p->num_line_breaks++;
-      render_bufs_p->line_break_pos[render_bufs_p->num_line_breaks] =
-          render_bufs_p->edit_text_len;
-      create_line_number(render_bufs_p, render_bufs_p->num_line_breaks + 1);
+  // TODO: consider making this an is_empty function
+  if (ptbl_p->piece_list_head_p == NULL) {
+    render_bufs_p->first_line = 1;
+    render_bufs_p->cursor_line = 1;
+    create_line_number(render_bufs_p, 0);
+    return;
+  }
+
+  size_t last_line = first_line + window_lines - 1;
+  size_t line = 1;
+  size_t line_start = 0;
+  size_t pos = 0;
+  size_t cursor = ptbl_p->global_cursor_pos;
+  pl_node *start_node = ptbl_p->piece_list_head_p;
+  size_t piece_start = 0;
+  if (first_line > 1 && first_line_pos > 0 &&
+      ptbl_seek_line_start(ptbl_p, first_line_pos, &start_node,
+                           &piece_start)) {
+    line = first_line;
+    line_start = first_line_pos;
+    pos = first_line_pos;
+    render_bufs_p->first_line_pos = first_line_pos;
+  }
+
+  // the table is walked up to the end of the window, only the window is
+  // copied out. Lines before it are skipped with line_scan, a vector block at
+  // a time, and nothing after it is read
+  for (pl_node *iter = start_node; iter != NULL && line <= last_line;
+       iter = iter->next_node_p) {
+    const char *chars = ptbl_piece_chars(ptbl_p, &iter->p);
+    size_t piece_end = piece_start + iter->p.len;
+    while (pos < piece_end && line <= last_line) {
+      const char *s = chars + (pos - piece_start);
+      if (pos == cursor) {
+        render_bufs_p->cursor_line = line;
+        render_bufs_p->cursor_offset = pos - line_start;
+      }
+
+      if (line < first_line) {
+        // stops at the cursor so it is seen on the way
+        size_t stop = cursor > pos && cursor < piece_end ? cursor : piece_end;
+        size_t left = first_line - line;
+        size_t used = line_scan_skip(s, stop - pos, &left);
+        size_t found = first_line - line - left;
+        if (found > 0) {
+          size_t after = used; // just past the last line break scanned
+          while (s[after - 1] != '\n') {
+            after--;
+          }
+          line += found;
+          line_start = pos + after;
+          if (line == first_line) {
+            render_bufs_p->first_line_pos = line_start;
+          }
+        }
+        pos += used;
+        continue;
+      }
+
+      char c = *s;
+      if (!(c == '\n' && line == last_line)) {
+        if (render_bufs_p->edit_text_len == EDIT_TEXT_BUFFER_MAX_SIZE &&
+            render_bufs_p->num_line_breaks > 0) {
+          // window buffer is full, drop the partially copied row
+          render_bufs_p->edit_text_len =
+              render_bufs_p->line_break_pos[render_bufs_p->num_line_breaks];
+          render_bufs_p->num_line_breaks--;
+          last_line = line - 1;
+        } else if (render_bufs_p->edit_text_len < EDIT_TEXT_BUFFER_MAX_SIZE) {
+          render_bufs_p->edit_text_buf[render_bufs_p->edit_text_len] = c;
+          if (c == '\n') {
+            render_bufs_p->num_line_breaks++;
+            render_bufs_p->line_break_pos[render_bufs_p->num_line_breaks] =
+                render_bufs_p->edit_text_len;
+          }
+          render_bufs_p->edit_text_len++;
+        }
+      }
+      if (c == '\n') {
+        line++;
+        line_start = pos + 1;
+      }
+      pos++;
     }
-    advance_ptbl_iterator(&pti);
-    render_bufs_p->edit_text_len++;
+    piece_start = piece_end;
+  }
+
+  if (ptbl_p->global_cursor_pos == pos) {
+    render_bufs_p->cursor_line = line;
+    render_bufs_p->cursor_offset = pos - line_start;
+  }
+  render_bufs_p->total_lines = line;
+
+  // window starts past the end of the table (e.g. after a large deletion)
+  if (first_line > line) {
+    load_ptbl_data(ptbl_p, render_bufs_p, line, 0, window_lines);
+    return;
   }
 
-  if (ptbl_p->global_cursor_pos == render_bufs_p->edit_text_len) {
-    render_bufs_p->cursor_line = render_bufs_p->num_line_breaks + 1;
-    render_bufs_p->cursor_offset =
-        ptbl_p->global_cursor_pos -
-        render_bufs_p->line_break_pos[render_bufs_p->num_line_breaks] - 1;
+  for (size_t row = 0; row <= render_bufs_p->num_line_breaks; row++) {
+    create_line_number(render_bufs_p, row);
   }
 }
 
@@ -163,32 +279,70 @@ void pl_place_between(pl_node *x, pl_node *y, pl_node *z) {
   }
 };
 
-// TODO: create similar function for adding multiple chars at once (for better
-// copy paste support)
 void aob_append_char(append_only_buffer *add_buffer_p, char c) {
+  aob_append_text(add_buffer_p, &c, 1);
+}
+
+// grows the buffer once to fit all of text, then copies it in. While a
+// snapshot pins the buffer the old block is copied and kept, the bytes a
+// snapshot points at never change since the buffer is only appended to
+void aob_append_text(append_only_buffer *add_buffer_p, const char *text,
+                     size_t len) {
   assert(add_buffer_p != NULL);
   assert(add_buffer_p->buf != NULL);
 
   // resize buffer if capacity limit reached
-  if (add_buffer_p->len == add_buffer_p->capacity) {
-    add_buffer_p->capacity *= 2;
-    add_buffer_p->buf = realloc(add_buffer_p->buf, add_buffer_p->capacity);
+  if (add_buffer_p->len + len > add_buffer_p->capacity) {
+    while (add_buffer_p->len + len > add_buffer_p->capacity) {
+      add_buffer_p->capacity *= 2;
+    }
+    char *buf;
+    if (add_buffer_p->pins > 0) {
+      char **retired =
+          realloc(add_buffer_p->retired,
+                  (add_buffer_p->num_retired + 1) * sizeof(char *));
+      buf = malloc(add_buffer_p->capacity);
+      if (retired == NULL || buf == NULL) {
+        fprintf(stderr, "Error: add buffer allocation failed");
+        exit(1);
+      }
+      memcpy(buf, add_buffer_p->buf, add_buffer_p->len);
+      retired[add_buffer_p->num_retired++] = add_buffer_p->buf;
+      add_buffer_p->retired = retired;
+    } else {
+      buf = realloc(add_buffer_p->buf, add_buffer_p->capacity);
+      if (buf == NULL) {
+        fprintf(stderr, "Error: add buffer allocation failed");
+        exit(1);
+      }
+    }
+    add_buffer_p->buf = buf;
   }
 
-  add_buffer_p->buf[add_buffer_p->len] = c;
-  add_buffer_p->len++;
+  memcpy(add_buffer_p->buf + add_buffer_p->len, text, len);
+  add_buffer_p->len += len;
 }
 
-// TODO: create similar function for adding multiple chars at once (for better
-// copy paste support)
 void ptbl_insert_char(piece_table *ptbl_p, char c) {
+  ptbl_insert_text(ptbl_p, &c, 1);
+}
+
+// inserts text at the cursor as a single piece, leaves the cursor after it
+void ptbl_insert_text(piece_table *ptbl_p, const char *text, size_t len) {
   assert(ptbl_p != NULL);
   // assert(ptbl_p->global_cursor_pos <= ptbl_p->orig_len +
   // ptbl_p->add_buffer.len); // TODO: revise this check with a better notion of
   // total piece table length
+  if (len == 0) {
+    return;
+  }
+
+  ptbl_note_edit(ptbl_p, ptbl_p->global_cursor_pos, 0, len);
 
   // populate add buffer
-  aob_append_char(&ptbl_p->add_buffer, c);
+  size_t add_start = ptbl_p->add_buffer.len;
+  size_t cp_len = utf8_count_codepoints(text, len);
+  aob_append_text(&ptbl_p->add_buffer, text, len);
 
   // empty piece table case
   if (ptbl_p->piece_list_head_p == NULL) {
@@ -203,15 +357,16 @@ void ptbl_insert_char(piece_table *ptbl_p, char c) {
         .p =
             (piece){
                 .buf_type = ADD,
-                .start = ptbl_p->add_buffer.len - 1,
-                .len = 1,
+                .start = add_start,
+                .len = len,
+                .cp_len = cp_len,
             },
     };
 
     ptbl_p->piece_list_head_p = new_node;
     ptbl_p->cursor_hint = new_node;
-    ptbl_p->local_cursor_pos = 1;
-    ptbl_p->global_cursor_pos = 1;
+    ptbl_p->local_cursor_pos = len;
+    ptbl_p->global_cursor_pos = len;
     return;
   }
 
@@ -222,10 +377,11 @@ void ptbl_insert_char(piece_table *ptbl_p, char c) {
   // current piece contains end of add buffer
   int is_end = cursor_hint->p.len == ptbl_p->local_cursor_pos;
   if (cursor_hint->p.buf_type == ADD && is_end &&
-      cursor_hint->p.start + cursor_hint->p.len == ptbl_p->add_buffer.len - 1) {
-    cursor_hint->p.len++;
-    ptbl_p->local_cursor_pos++;
-    ptbl_p->global_cursor_pos++;
+      cursor_hint->p.start + cursor_hint->p.len == add_start) {
+    cursor_hint->p.len += len;
+    cursor_hint->p.cp_len += cp_len;
+    ptbl_p->local_cursor_pos += len;
+    ptbl_p->global_cursor_pos += len;
     return;
   }
 
@@ -240,8 +396,9 @@ void ptbl_insert_char(piece_table *ptbl_p, char c) {
       .p =
           (piece){
               .buf_type = ADD,
-              .start = ptbl_p->add_buffer.len - 1,
-              .len = 1,
+              .start = add_start,
+              .len = len,
+              .cp_len = cp_len,
           },
   };
 
@@ -258,34 +415,35 @@ void ptbl_insert_char(piece_table *ptbl_p, char c) {
     if (split_node == NULL) {
       // TODO: handle error
     }
+    size_t cp_before =
+        pl_codepoints_before(ptbl_p, &cursor_hint->p, ptbl_p->local_cursor_pos);
     *split_node = (pl_node){
         .pre_node_p = NULL,
         .next_node_p = NULL,
         .p =
             (piece){
                 .buf_type = cursor_hint->p.buf_type,
-                .start = ptbl_p->local_cursor_pos,
+                .start = cursor_hint->p.start + ptbl_p->local_cursor_pos,
                 .len = cursor_hint->p.len - ptbl_p->local_cursor_pos,
+                .cp_len = cursor_hint->p.cp_len - cp_before,
             },
     };
 
     cursor_hint->p.len = ptbl_p->local_cursor_pos;
+    cursor_hint->p.cp_len = cp_before;
     pl_place_between(cursor_hint, split_node, cursor_hint->next_node_p);
     pl_place_between(cursor_hint, new_node, split_node);
   }
 
   // update cursor state
-  ptbl_p->local_cursor_pos = 1;
-  ptbl_p->global_cursor_pos++;
+  ptbl_p->local_cursor_pos = len;
+  ptbl_p->global_cursor_pos += len;
   ptbl_p->cursor_hint = new_node;
 }
 
 void ptbl_delete_char(piece_table *ptbl_p) {
   assert(ptbl_p != NULL);
-  assert(ptbl_p->global_cursor_pos <=
-         ptbl_p->orig_len +
-             ptbl_p->add_buffer.len); // TODO: revise this check with a better
-                                      // notion of total piece table length
+  assert(ptbl_p->global_cursor_pos <= ptbl_length(ptbl_p));
   assert(ptbl_p->piece_list_head_p != NULL);
 
   // do nothing if cursor is at beginning of file
@@ -298,6 +456,7 @@ void ptbl_delete_char(piece_table *ptbl_p) {
   assert(cursor_hint->p.len >= ptbl_p->local_cursor_pos);
 
   ptbl_p->global_cursor_pos--;
+  ptbl_note_edit(ptbl_p, ptbl_p->global_cursor_pos, 1, 0);
 
   // move cursor hint to previous block if on first index
   if (ptbl_p->local_cursor_pos == 0) {
@@ -326,12 +485,20 @@ void ptbl_delete_char(piece_table *ptbl_p) {
     }
     free(cursor_hint);
     return;
-  } else if (ptbl_p->local_cursor_pos == cursor_hint->p.len) {
+  }
+
+  // whether the deleted byte starts a codepoint
+  const char *chars = ptbl_piece_chars(ptbl_p, &cursor_hint->p);
+  size_t deleted_cp = !utf8_is_continuation(chars[ptbl_p->local_cursor_pos - 1]);
+
+  if (ptbl_p->local_cursor_pos == cursor_hint->p.len) {
     cursor_hint->p.len--;
+    cursor_hint->p.cp_len -= deleted_cp;
     ptbl_p->local_cursor_pos--;
     return;
   } else if (ptbl_p->local_cursor_pos == 1) {
     cursor_hint->p.len--;
+    cursor_hint->p.cp_len -= deleted_cp;
     cursor_hint->p.start++;
     ptbl_p->local_cursor_pos--;
     return;
@@ -343,6 +510,8 @@ void ptbl_delete_char(piece_table *ptbl_p) {
     // TODO: handle error
     exit(4);
   }
+  size_t cp_before = pl_codepoints_before(ptbl_p, &cursor_hint->p,
+                                          ptbl_p->local_cursor_pos - 1);
   *split_node = (pl_node){
       .pre_node_p = NULL,
       .next_node_p = NULL,
@@ -351,10 +520,12 @@ void ptbl_delete_char(piece_table *ptbl_p) {
               .buf_type = cursor_hint->p.buf_type,
               .start = cursor_hint->p.start + ptbl_p->local_cursor_pos,
               .len = cursor_hint->p.len - ptbl_p->local_cursor_pos,
+              .cp_len = cursor_hint->p.cp_len - cp_before - deleted_cp,
           },
   };
 
   cursor_hint->p.len -= split_node->p.len + 1;
+  cursor_hint->p.cp_len = cp_before;
   ptbl_p->local_cursor_pos = cursor_hint->p.len;
   pl_place_between(cursor_hint, split_node, cursor_hint->next_node_p);
 }
@@ -383,6 +554,589 @@ void ptbl_update_global_cursor_pos(piece_table *ptbl_p,
   ptbl_p->cursor_hint = iter;
 }
 
+size_t ptbl_length(piece_table *ptbl_p) {
+  size_t len = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    len += iter->p.len;
+  }
+  return len;
+}
+
+const char *ptbl_piece_chars(piece_table *ptbl_p, piece *p) {
+  switch (p->buf_type) {
+  case ORIGINAL:
+    return ptbl_p->orig_buf + p->start;
+  case ADD:
+    return ptbl_p->add_buffer.buf + p->start;
+  }
+  return NULL;
+}
+
+// codepoints in the first `at` bytes of a piece, counting whichever side of
+// `at` is shorter
+size_t pl_codepoints_before(piece_table *ptbl_p, piece *p, size_t at) {
+  const char *chars = ptbl_piece_chars(ptbl_p, p);
+  if (at <= p->len / 2) {
+    return utf8_count_codepoints(chars, at);
+  }
+  return p->cp_len - utf8_count_codepoints(chars + at, p->len - at);
+}
+
+// table byte position -> codepoint index in O(pieces), whole pieces are
+// skipped using their cached counts and only the piece holding pos is
+// decoded. Nothing on the editing path converts whole table positions, cursor
+// motion and columns work on the loaded row text or a span around the cursor
+size_t ptbl_codepoint_index(piece_table *ptbl_p, size_t pos) {
+  size_t cp_index = 0;
+  size_t piece_start = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    if (pos < piece_start + iter->p.len) {
+      return cp_index +
+             pl_codepoints_before(ptbl_p, &iter->p, pos - piece_start);
+    }
+    cp_index += iter->p.cp_len;
+    piece_start += iter->p.len;
+  }
+  return cp_index;
+}
+
+// codepoint index -> table byte position, O(pieces) like the above
+size_t ptbl_codepoint_pos(piece_table *ptbl_p, size_t cp_index) {
+  size_t piece_start = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    if (cp_index < iter->p.cp_len) {
+      const char *chars = ptbl_piece_chars(ptbl_p, &iter->p);
+      size_t i = 0;
+      for (;; i++) {
+        if (!utf8_is_continuation(chars[i])) {
+          if (cp_index == 0) {
+            break;
+          }
+          cp_index--;
+        }
+      }
+      return piece_start + i;
+    }
+    cp_index -= iter->p.cp_len;
+    piece_start += iter->p.len;
+  }
+  return piece_start;
+}
+
+// gathers [start, start + len) into out one piece span at a time, returns
+// the number of characters copied
+size_t ptbl_copy_range(piece_table *ptbl_p, size_t start, size_t len,
+                       char *out) {
+  assert(ptbl_p != NULL);
+  size_t end = start + len;
+  size_t copied = 0;
+  size_t piece_start = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p;
+       iter != NULL && piece_start < end; iter = iter->next_node_p) {
+    size_t piece_end = piece_start + iter->p.len;
+    if (piece_end > start) {
+      size_t from = start > piece_start ? start - piece_start : 0;
+      size_t to = end < piece_end ? end - piece_start : iter->p.len;
+      memcpy(out + copied, ptbl_piece_chars(ptbl_p, &iter->p) + from,
+             to - from);
+      copied += to - from;
+    }
+    piece_start = piece_end;
+  }
+  return copied;
+}
+
+// the grapheme cluster boundary before (direction < 0) or after pos, stepped
+// in a span copied around it. A line break is one byte, a cluster longer than
+// the span stops at the codepoint start nearest its edge
+size_t ptbl_grapheme_step(piece_table *ptbl_p, size_t pos, int direction) {
+  assert(ptbl_p != NULL);
+  char span[GRAPHEME_SPAN_BYTES];
+  size_t len = ptbl_length(ptbl_p);
+  if (direction < 0) {
+    size_t start = pos > GRAPHEME_SPAN_BYTES ? pos - GRAPHEME_SPAN_BYTES : 0;
+    size_t n = ptbl_copy_range(ptbl_p, start, pos - start, span);
+    size_t prev = utf8_prev_grapheme(span, n, n);
+    while (start > 0 && prev < n && utf8_is_continuation(span[prev])) {
+      prev++;
+    }
+    return start + prev;
+  }
+  size_t end = len - pos > GRAPHEME_SPAN_BYTES ? pos + GRAPHEME_SPAN_BYTES : len;
+  size_t n = ptbl_copy_range(ptbl_p, pos, end - pos, span);
+  size_t next = utf8_next_grapheme(span, n, 0);
+  if (end < len && (next == n || utf8_is_continuation(span[next]))) {
+    next = next < n ? next : n - 1;
+    while (next > 1 && utf8_is_continuation(span[next])) {
+      next--;
+    }
+  }
+  return pos + next;
+}
+
+// removes [start, start + len) by trimming the pieces at either end and
+// unlinking the ones in between, leaves the cursor at start
+void ptbl_delete_range(piece_table *ptbl_p, size_t start, size_t len) {
+  assert(ptbl_p != NULL);
+  if (len > 0) {
+    ptbl_note_edit(ptbl_p, start, len, 0);
+  }
+  size_t end = start + len;
+  size_t piece_start = 0;
+  pl_node *iter = ptbl_p->piece_list_head_p;
+  while (iter != NULL && piece_start < end) {
+    pl_node *next = iter->next_node_p;
+    size_t piece_end = piece_start + iter->p.len;
+
+    if (piece_end <= start) {
+      // piece entirely before the range
+    } else if (piece_start < start && piece_end > end) {
+      // range inside a single piece, split it around the range
+      pl_node *split_node = (pl_node *)malloc(sizeof(pl_node));
+      if (split_node == NULL) {
+        fprintf(stderr, "Error: piece table allocation failed");
+        exit(1);
+      }
+      *split_node = (pl_node){
+          .pre_node_p = NULL,
+          .next_node_p = NULL,
+          .p =
+              (piece){
+                  .buf_type = iter->p.buf_type,
+                  .start = iter->p.start + (end - piece_start),
+                  .len = piece_end - end,
+                  .cp_len = iter->p.cp_len -
+                            pl_codepoints_before(ptbl_p, &iter->p,
+                                                 end - piece_start),
+              },
+      };
+      iter->p.cp_len = pl_codepoints_before(ptbl_p, &iter->p,
+                                            start - piece_start);
+      iter->p.len = start - piece_start;
+      pl_place_between(iter, split_node, next);
+      break;
+    } else if (piece_start < start) {
+      iter->p.cp_len = pl_codepoints_before(ptbl_p, &iter->p,
+                                            start - piece_start);
+      iter->p.len = start - piece_start;
+    } else if (piece_end > end) {
+      iter->p.cp_len -= pl_codepoints_before(ptbl_p, &iter->p,
+                                             end - piece_start);
+      iter->p.start += end - piece_start;
+      iter->p.len = piece_end - end;
+    } else {
+      if (iter->pre_node_p == NULL) {
+        ptbl_p->piece_list_head_p = next;
+      } else {
+        iter->pre_node_p->next_node_p = next;
+      }
+      if (next != NULL) {
+        next->pre_node_p = iter->pre_node_p;
+      }
+      free(iter);
+    }
+
+    piece_start = piece_end;
+    iter = next;
+  }
+
+  if (ptbl_p->piece_list_head_p == NULL) {
+    ptbl_p->cursor_hint = NULL;
+    ptbl_p->global_cursor_pos = 0;
+    ptbl_p->local_cursor_pos = 0;
+    return;
+  }
+  ptbl_update_global_cursor_pos(ptbl_p, start);
+}
+
+// Replace-all pass, links the new piece list together while walking the old
+// one. Pieces kept whole are moved over, the rest are freed once passed
+typedef struct {
+  piece_table *ptbl_p;
+  pl_node *iter;      // old piece holding pos
+  size_t piece_start; // position of iter in the old text
+  size_t pos;         // old text up to here has been kept or dropped
+  pl_node *head;
+  pl_node *tail;
+} pl_rebuild;
+
+static void pl_rebuild_append(pl_rebuild *rb, pl_node *node) {
+  pl_place_between(rb->tail, node, NULL);
+  if (rb->head == NULL) {
+    rb->head = node;
+  }
+  rb->tail = node;
+}
+
+static void pl_rebuild_push(pl_rebuild *rb, buffer_type buf_type,
+                            size_t start, size_t len, size_t cp_len) {
+  pl_node *node = (pl_node *)malloc(sizeof(pl_node));
+  if (node == NULL) {
+    fprintf(stderr, "Error: piece table allocation failed");
+    exit(1);
+  }
+  node->p = (piece){
+      .buf_type = buf_type, .start = start, .len = len, .cp_len = cp_len};
+  pl_rebuild_append(rb, node);
+}
+
+// old text in [pos, until) goes into the new list, or is dropped
+static void pl_rebuild_advance(pl_rebuild *rb, size_t until, int keep) {
+  while (rb->iter != NULL && rb->pos < until) {
+    pl_node *next = rb->iter->next_node_p;
+    size_t piece_end = rb->piece_start + rb->iter->p.len;
+    size_t seg_end = until < piece_end ? until : piece_end;
+    int whole = rb->pos == rb->piece_start && seg_end == piece_end;
+    if (keep && whole) {
+      pl_rebuild_append(rb, rb->iter);
+    } else if (keep) {
+      size_t at = rb->pos - rb->piece_start;
+      const char *chars = ptbl_piece_chars(rb->ptbl_p, &rb->iter->p);
+      pl_rebuild_push(rb, rb->iter->p.buf_type, rb->iter->p.start + at,
+                      seg_end - rb->pos,
+                      utf8_count_codepoints(chars + at, seg_end - rb->pos));
+    }
+    rb->pos = seg_end;
+    if (seg_end < piece_end) {
+      break;
+    }
+    if (!(keep && whole)) {
+      free(rb->iter);
+    }
+    rb->iter = next;
+    rb->piece_start = piece_end;
+  }
+}
+
+// replaces the text at every match with text in one pass over the pieces,
+// matches ascend and those overlapping the one before are skipped. text is
+// appended to the add buffer once and shared by every replacement piece, the
+// whole pass is noted as a single edit. The cursor stays on the same text,
+// or after the replacement it was inside of
+void ptbl_replace_all(piece_table *ptbl_p, const size_t *offsets,
+                      const size_t *lens, size_t count, const char *text,
+                      size_t len) {
+  size_t add_start = ptbl_p->add_buffer.len;
+  size_t cp_len = utf8_count_codepoints(text, len);
+  aob_append_text(&ptbl_p->add_buffer, text, len);
+
+  pl_rebuild rb = {.ptbl_p = ptbl_p, .iter = ptbl_p->piece_list_head_p};
+  size_t cursor = ptbl_p->global_cursor_pos;
+  size_t new_cursor = cursor;
+  size_t span_start = SIZE_MAX;
+  size_t span_end = 0;
+  size_t removed = 0;
+  size_t replaced = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (offsets[i] < rb.pos || lens[i] == 0) {
+      continue;
+    }
+    size_t end = offsets[i] + lens[i];
+    pl_rebuild_advance(&rb, offsets[i], 1);
+    pl_rebuild_advance(&rb, end, 0);
+    if (len > 0) {
+      pl_rebuild_push(&rb, ADD, add_start, len, cp_len);
+    }
+    if (cursor >= end) {
+      new_cursor = new_cursor + len - lens[i];
+    } else if (cursor > offsets[i]) {
+      new_cursor = offsets[i] + replaced - removed + len;
+    }
+    span_start = span_start < offsets[i] ? span_start : offsets[i];
+    span_end = end;
+    removed += lens[i];
+    replaced += len;
+  }
+  pl_rebuild_advance(&rb, SIZE_MAX, 1);
+  ptbl_p->piece_list_head_p = rb.head;
+  if (span_start == SIZE_MAX) {
+    return;
+  }
+  ptbl_note_edit(ptbl_p, span_start, span_end - span_start,
+                 span_end - span_start - removed + replaced);
+  ptbl_clear_selection(ptbl_p);
+  if (rb.head == NULL) {
+    ptbl_p->cursor_hint = NULL;
+    ptbl_p->global_cursor_pos = 0;
+    ptbl_p->local_cursor_pos = 0;
+    return;
+  }
+  ptbl_update_global_cursor_pos(ptbl_p, new_cursor);
+}
+
+void ptbl_start_selection(piece_table *ptbl_p) {
+  ptbl_p->selection_anchor = ptbl_p->global_cursor_pos;
+  ptbl_p->selection_active = 1;
+}
+
+void ptbl_clear_selection(piece_table *ptbl_p) {
+  ptbl_p->selection_active = 0;
+}
+
+// returns whether there is a non-empty selection, and its ordered bounds
+int ptbl_selection_range(piece_table *ptbl_p, size_t *start_p,
+                         size_t *end_p) {
+  if (!ptbl_p->selection_active ||
+      ptbl_p->selection_anchor == ptbl_p->global_cursor_pos) {
+    return 0;
+  }
+  if (ptbl_p->selection_anchor < ptbl_p->global_cursor_pos) {
+    *start_p = ptbl_p->selection_anchor;
+    *end_p = ptbl_p->global_cursor_pos;
+  } else {
+    *start_p = ptbl_p->global_cursor_pos;
+    *end_p = ptbl_p->selection_anchor;
+  }
+  return 1;
+}
+
+void ptbl_delete_selection(piece_table *ptbl_p) {
+  size_t start, end;
+  if (ptbl_selection_range(ptbl_p, &start, &end)) {
+    ptbl_delete_range(ptbl_p, start, end - start);
+  }
+  ptbl_clear_selection(ptbl_p);
+}
+
+// start of the line holding pos, found by walking back from its piece
+static size_t ptbl_line_start(piece_table *ptbl_p, size_t pos) {
+  pl_node *iter = ptbl_p->piece_list_head_p;
+  size_t piece_start = 0;
+  while (iter != NULL && piece_start + iter->p.len < pos) {
+    piece_start += iter->p.len;
+    iter = iter->next_node_p;
+  }
+  for (; iter != NULL; iter = iter->pre_node_p) {
+    const char *chars = ptbl_piece_chars(ptbl_p, &iter->p);
+    for (size_t i = pos - piece_start; i > 0; i--) {
+      if (chars[i - 1] == '\n') {
+        return piece_start + i;
+      }
+    }
+    pos = piece_start;
+    if (iter->pre_node_p != NULL) {
+      piece_start -= iter->pre_node_p->p.len;
+    }
+  }
+  return 0;
+}
+
+// inserts c at the start of every line touched by the selection in one pass
+// over the pieces, like ptbl_replace_all. c is appended to the add buffer
+// once and shared by every inserted piece. The selection grows to cover the
+// inserted characters
+void ptbl_indent_selection(piece_table *ptbl_p, char c) {
+  size_t start, end;
+  if (!ptbl_selection_range(ptbl_p, &start, &end)) {
+    return;
+  }
+  int cursor_at_end = ptbl_p->global_cursor_pos == end;
+  size_t first_line_start = ptbl_line_start(ptbl_p, start);
+  size_t add_start = ptbl_p->add_buffer.len;
+  aob_append_char(&ptbl_p->add_buffer, c);
+
+  pl_rebuild rb = {.ptbl_p = ptbl_p, .iter = ptbl_p->piece_list_head_p};
+  pl_rebuild_advance(&rb, first_line_start, 1);
+  pl_rebuild_push(&rb, ADD, add_start, 1, 1);
+  size_t num_lines = 1;
+  // a line break before end - 1 starts another line inside the selection
+  while (rb.iter != NULL && rb.pos + 1 < end) {
+    size_t piece_end = rb.piece_start + rb.iter->p.len;
+    size_t scan_end = piece_end < end - 1 ? piece_end : end - 1;
+    const char *chars = ptbl_piece_chars(ptbl_p, &rb.iter->p);
+    const char *newline = memchr(chars + (rb.pos - rb.piece_start), '\n',
+                                 scan_end - rb.pos);
+    if (newline == NULL && scan_end < piece_end) {
+      break; // the rest of the piece is kept whole below
+    }
+    if (newline == NULL) {
+      pl_rebuild_advance(&rb, scan_end, 1);
+      continue;
+    }
+    pl_rebuild_advance(&rb, rb.piece_start + (newline - chars) + 1, 1);
+    pl_rebuild_push(&rb, ADD, add_start, 1, 1);
+    num_lines++;
+  }
+  pl_rebuild_advance(&rb, SIZE_MAX, 1);
+  ptbl_p->piece_list_head_p = rb.head;
+  ptbl_note_edit(ptbl_p, first_line_start, end - first_line_start,
+                 end - first_line_start + num_lines);
+
+  start += 1;
+  end += num_lines;
+  ptbl_p->selection_anchor = cursor_at_end ? start : end;
+  ptbl_update_global_cursor_pos(ptbl_p, cursor_at_end ? end : start);
+}
+
+// the original buffer, now at buf, grew by len bytes at its end. They go
+// after the last piece that ends where the buffer used to, growing it in
+// place, or at the end of the table if no piece does. Returns where they went
+size_t ptbl_extend_original(piece_table *ptbl_p, char *buf, size_t len,
+                            size_t cp_len) {
+  ptbl_p->orig_buf = buf;
+  if (len == 0) {
+    return ptbl_length(ptbl_p);
+  }
+  pl_node *last = NULL;
+  pl_node *tail = NULL;
+  size_t pos = 0;
+  size_t running_len = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    running_len += iter->p.len;
+    if (iter->p.buf_type == ORIGINAL &&
+        iter->p.start + iter->p.len == ptbl_p->orig_len) {
+      last = iter;
+      pos = running_len;
+    }
+    tail = iter;
+  }
+
+  if (last != NULL) {
+    last->p.len += len;
+    last->p.cp_len += cp_len;
+  } else {
+    pl_node *node = (pl_node *)malloc(sizeof(pl_node));
+    if (node == NULL) {
+      fprintf(stderr, "Error: piece table allocation failed");
+      exit(1);
+    }
+    node->p = (piece){
+        .buf_type = ORIGINAL,
+        .start = ptbl_p->orig_len,
+        .len = len,
+        .cp_len = cp_len,
+    };
+    pl_place_between(tail, node, NULL);
+    if (tail == NULL) {
+      ptbl_p->piece_list_head_p = node;
+    }
+    pos = running_len;
+  }
+  ptbl_p->orig_len += len;
+
+  // the cursor and the selection stay on the text they were on
+  if (ptbl_p->selection_anchor > pos) {
+    ptbl_p->selection_anchor += len;
+  }
+  size_t cursor = ptbl_p->global_cursor_pos;
+  ptbl_update_global_cursor_pos(ptbl_p, cursor > pos ? cursor + len : cursor);
+  ptbl_note_edit(ptbl_p, pos, 0, len);
+  return pos;
+}
+
+// replaces the whole text with buf, for a viewer moving the window of a file
+// the table holds. The table owns buf from here on, the buffer it replaces is
+// freed once no snapshot reads it. The cursor goes to the start
+void ptbl_replace_original(piece_table *ptbl_p, char *buf, size_t len,
+                           size_t cp_len) {
+  append_only_buffer *add_buffer_p = &ptbl_p->add_buffer;
+  size_t old_len = ptbl_length(ptbl_p);
+  if (add_buffer_p->pins > 0) {
+    char **retired = realloc(add_buffer_p->retired,
+                             (add_buffer_p->num_retired + 1) * sizeof(char *));
+    if (retired == NULL) {
+      fprintf(stderr, "Error: piece table allocation failed");
+      exit(1);
+    }
+    retired[add_buffer_p->num_retired++] = ptbl_p->orig_buf;
+    add_buffer_p->retired = retired;
+  } else {
+    free(ptbl_p->orig_buf);
+  }
+
+  pl_node *iter = ptbl_p->piece_list_head_p;
+  while (iter != NULL) {
+    pl_node *next = iter->next_node_p;
+    free(iter);
+    iter = next;
+  }
+  ptbl_p->piece_list_head_p = NULL;
+  ptbl_p->cursor_hint = NULL;
+  ptbl_p->global_cursor_pos = 0;
+  ptbl_p->local_cursor_pos = 0;
+  ptbl_p->selection_active = 0;
+  ptbl_p->selection_anchor = 0;
+  ptbl_p->orig_len = 0;
+  ptbl_note_edit(ptbl_p, 0, old_len, 0);
+  ptbl_extend_original(ptbl_p, buf, len, cp_len);
+}
+
+// merges an edit into the pending one, so whoever indexes the text can
+// catch up on a whole frame of edits by re-reading a single span
+void ptbl_note_edit(piece_table *ptbl_p, size_t start, size_t removed,
+                    size_t inserted) {
+  if (!ptbl_p->edit_pending) {
+    ptbl_p->edit_start = start;
+    ptbl_p->edit_removed = removed;
+    ptbl_p->edit_inserted = inserted;
+    ptbl_p->edit_pending = 1;
+    return;
+  }
+  // span covering both edits, in the text as it was before this one
+  size_t pending_end = ptbl_p->edit_start + ptbl_p->edit_inserted;
+  size_t span_start = start < ptbl_p->edit_start ? start : ptbl_p->edit_start;
+  size_t span_end = start + removed > pending_end ? start + removed
+                                                  : pending_end;
+  size_t span = span_end - span_start;
+  ptbl_p->edit_removed = span - ptbl_p->edit_inserted + ptbl_p->edit_removed;
+  ptbl_p->edit_inserted = span - removed + inserted;
+  ptbl_p->edit_start = span_start;
+}
+
+int ptbl_take_edit(piece_table *ptbl_p, size_t *start_p, size_t *removed_p,
+                   size_t *inserted_p) {
+  if (!ptbl_p->edit_pending) {
+    return 0;
+  }
+  *start_p = ptbl_p->edit_start;
+  *removed_p = ptbl_p->edit_removed;
+  *inserted_p = ptbl_p->edit_inserted;
+  ptbl_p->edit_pending = 0;
+  return 1;
+}
+
+// copies out where every piece's text lives and pins the add buffer, O(pieces)
+void ptbl_snapshot_take(piece_table *ptbl_p, ptbl_snapshot *snap_p) {
+  size_t num_pieces = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    num_pieces++;
+  }
+  snap_p->chars = malloc((num_pieces + 1) * sizeof(const char *));
+  snap_p->lens = malloc((num_pieces + 1) * sizeof(size_t));
+  if (snap_p->chars == NULL || snap_p->lens == NULL) {
+    fprintf(stderr, "Error: snapshot allocation failed");
+    exit(1);
+  }
+  snap_p->num_pieces = 0;
+  snap_p->len = 0;
+  for (pl_node *iter = ptbl_p->piece_list_head_p; iter != NULL;
+       iter = iter->next_node_p) {
+    snap_p->chars[snap_p->num_pieces] = ptbl_piece_chars(ptbl_p, &iter->p);
+    snap_p->lens[snap_p->num_pieces++] = iter->p.len;
+    snap_p->len += iter->p.len;
+  }
+  ptbl_p->add_buffer.pins++;
+}
+
+// the table must not be touched by anyone else while releasing
+void ptbl_snapshot_release(piece_table *ptbl_p, ptbl_snapshot *snap_p) {
+  free(snap_p->chars);
+  free(snap_p->lens);
+  *snap_p = (ptbl_snapshot){0};
+  append_only_buffer *add_buffer_p = &ptbl_p->add_buffer;
+  if (--add_buffer_p->pins == 0) {
+    for (size_t i = 0; i < add_buffer_p->num_retired; i++) {
+      free(add_buffer_p->retired[i]);
+    }
+    add_buffer_p->num_retired = 0;
+  }
+}
+
 void ptbl_display(piece_table *ptbl_p) {
   pl_node *head = ptbl_p->piece_list_head_p;
   while (head != NULL) {
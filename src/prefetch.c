@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/prefetch.h"
+
+static void *prefetch_worker(void *arg) {
+  line_prefetcher *lp = (line_prefetcher *)arg;
+
+  pthread_mutex_lock(&lp->lock);
+  while (!lp->quit) {
+    if (!lp->pending) {
+      pthread_cond_wait(&lp->wake, &lp->lock);
+      continue;
+    }
+    size_t first_line = lp->req_first_line;
+    size_t first_line_pos = lp->req_first_line_pos;
+    size_t window_lines = lp->req_window_lines;
+    size_t version = lp->req_version;
+    lp->pending = false;
+    pthread_mutex_unlock(&lp->lock);
+
+    pthread_mutex_lock(&lp->table_lock);
+    load_ptbl_data(lp->ptbl_p, lp->scratch_p, first_line, first_line_pos,
+                   window_lines);
+    pthread_mutex_unlock(&lp->table_lock);
+
+    pthread_mutex_lock(&lp->lock);
+    render_buffers *tmp = lp->back_p;
+    lp->back_p = lp->scratch_p;
+    lp->scratch_p = tmp;
+    lp->back_version = version;
+    lp->ready = true;
+  }
+  pthread_mutex_unlock(&lp->lock);
+  return NULL;
+}
+
+void prefetch_start(line_prefetcher *lp, piece_table *ptbl_p) {
+  assert(lp != NULL);
+  *lp = (line_prefetcher){.ptbl_p = ptbl_p};
+  lp->scratch_p = (render_buffers *)calloc(1, sizeof(render_buffers));
+  lp->back_p = (render_buffers *)calloc(1, sizeof(render_buffers));
+  if (lp->scratch_p == NULL || lp->back_p == NULL) {
+    fprintf(stderr, "Error: prefetch buffer allocation failed");
+    exit(1);
+  }
+
+  pthread_mutex_init(&lp->lock, NULL);
+  pthread_cond_init(&lp->wake, NULL);
+  pthread_mutex_init(&lp->table_lock, NULL);
+  if (pthread_create(&lp->thread, NULL, prefetch_worker, lp) != 0) {
+    fprintf(stderr, "Error: prefetch thread creation failed");
+    exit(1);
+  }
+}
+
+void prefetch_stop(line_prefetcher *lp) {
+  pthread_mutex_lock(&lp->lock);
+  lp->quit = true;
+  pthread_cond_signal(&lp->wake);
+  pthread_mutex_unlock(&lp->lock);
+  pthread_join(lp->thread, NULL);
+
+  pthread_mutex_destroy(&lp->lock);
+  pthread_cond_destroy(&lp->wake);
+  pthread_mutex_destroy(&lp->table_lock);
+  free(lp->scratch_p);
+  free(lp->back_p);
+}
+
+// replaces any request the worker hasn't picked up yet. first_line_pos is
+// taken when the request is made, a load from a stale one is never taken as
+// the version has moved on by then
+void prefetch_request(line_prefetcher *lp, size_t first_line,
+                      size_t first_line_pos, size_t window_lines,
+                      size_t version) {
+  pthread_mutex_lock(&lp->lock);
+  if (!lp->pending && lp->ready && lp->back_version == version &&
+      lp->back_p->first_line == first_line &&
+      lp->back_p->window_lines == window_lines) {
+    pthread_mutex_unlock(&lp->lock);
+    return;
+  }
+  lp->req_first_line = first_line;
+  lp->req_first_line_pos = first_line_pos;
+  lp->req_window_lines = window_lines;
+  lp->req_version = version;
+  lp->pending = true;
+  pthread_cond_signal(&lp->wake);
+  pthread_mutex_unlock(&lp->lock);
+}
+
+// copies the prefetched window out if it was loaded from the current version
+// of the table and covers the requested lines
+bool prefetch_take(line_prefetcher *lp, render_buffers *render_bufs_p,
+                   size_t first_line, size_t num_lines, size_t version) {
+  bool taken = false;
+  pthread_mutex_lock(&lp->lock);
+  if (lp->ready && lp->back_version == version &&
+      render_buffers_cover(lp->back_p, first_line, num_lines)) {
+    memcpy(render_bufs_p, lp->back_p, sizeof(render_buffers));
+    taken = true;
+  }
+  pthread_mutex_unlock(&lp->lock);
+  return taken;
+}
+
+bool render_buffers_cover(render_buffers *render_bufs_p, size_t first_line,
+                          size_t num_lines) {
+  size_t rows = render_bufs_p->num_line_breaks + 1;
+  size_t last_line = first_line + num_lines - 1;
+  if (last_line > render_bufs_p->total_lines) {
+    last_line = render_bufs_p->total_lines;
+  }
+  return render_bufs_p->first_line > 0 &&
+         first_line >= render_bufs_p->first_line &&
+         last_line < render_bufs_p->first_line + rows;
+}
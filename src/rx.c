@@ -0,0 +1,1086 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/rx.h"
+
+#define RX_NONE SIZE_MAX
+#define RX_UNKNOWN UINT32_MAX  // transition not computed yet
+#define RX_MATCHED 0x80000000u // a match ends before the byte
+#define RX_STATE_MASK 0x7FFFFFFFu
+#define RX_DEAD 0 // state with no threads left
+#define RX_FULL UINT32_MAX
+#define RX_PREFIX_CHUNK (1 << 20) // bytes searched for prefix candidates at once
+#define RX_ACCEL_UNKNOWN 0xFF
+#define RX_ACCEL_NONE 0
+
+static void *rx_alloc(size_t size) {
+  void *p = malloc(size);
+  if (p == NULL) {
+    fprintf(stderr, "Error: regex allocation failed");
+    exit(1);
+  }
+  return p;
+}
+
+static void set_add(uint8_t *set, uint8_t b) { set[b >> 3] |= 1 << (b & 7); }
+
+static bool set_has(const uint8_t *set, uint8_t b) {
+  return (set[b >> 3] >> (b & 7)) & 1;
+}
+
+static void set_range(uint8_t *set, int lo, int hi) {
+  for (int b = lo; b <= hi; b++) {
+    set_add(set, (uint8_t)b);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Parser, pattern to syntax tree
+//------------------------------------------------------------------------------
+
+typedef enum {
+  RX_NODE_SET,
+  RX_NODE_CAT,
+  RX_NODE_ALT,
+  RX_NODE_REPEAT,
+  RX_NODE_BOL,
+  RX_NODE_EOL,
+} rx_node_kind;
+
+typedef struct rx_node {
+  uint8_t kind;
+  bool greedy;
+  int min;
+  int max; // -1 for no bound
+  uint8_t set[32];
+  struct rx_node **kids;
+  size_t num_kids;
+} rx_node;
+
+typedef struct {
+  const unsigned char *p;
+  const unsigned char *end;
+  int flags;
+  int depth;
+  const char *error;
+  rx_node **nodes; // every node made, freed together
+  size_t num_nodes;
+  size_t cap_nodes;
+} rx_parser;
+
+static rx_node *rx_node_new(rx_parser *ps, rx_node_kind kind) {
+  if (ps->num_nodes == ps->cap_nodes) {
+    ps->cap_nodes = ps->cap_nodes > 0 ? ps->cap_nodes * 2 : 32;
+    rx_node **nodes = realloc(ps->nodes, ps->cap_nodes * sizeof(rx_node *));
+    if (nodes == NULL) {
+      fprintf(stderr, "Error: regex allocation failed");
+      exit(1);
+    }
+    ps->nodes = nodes;
+  }
+  rx_node *node = rx_alloc(sizeof(rx_node));
+  *node = (rx_node){.kind = kind, .greedy = true};
+  ps->nodes[ps->num_nodes++] = node;
+  return node;
+}
+
+static void rx_node_add(rx_node *node, rx_node *kid) {
+  rx_node **kids = realloc(node->kids, (node->num_kids + 1) * sizeof(rx_node *));
+  if (kids == NULL) {
+    fprintf(stderr, "Error: regex allocation failed");
+    exit(1);
+  }
+  node->kids = kids;
+  node->kids[node->num_kids++] = kid;
+}
+
+static void rx_parser_free(rx_parser *ps) {
+  for (size_t i = 0; i < ps->num_nodes; i++) {
+    free(ps->nodes[i]->kids);
+    free(ps->nodes[i]);
+  }
+  free(ps->nodes);
+}
+
+static void rx_fold_case(uint8_t *set) {
+  for (int b = 'a'; b <= 'z'; b++) {
+    if (set_has(set, b) || set_has(set, b - 32)) {
+      set_add(set, b);
+      set_add(set, b - 32);
+    }
+  }
+}
+
+static rx_node *rx_set_node(rx_parser *ps, const uint8_t *set) {
+  rx_node *node = rx_node_new(ps, RX_NODE_SET);
+  memcpy(node->set, set, 32);
+  if (ps->flags & RX_ICASE) {
+    rx_fold_case(node->set);
+  }
+  return node;
+}
+
+static rx_node *rx_byte_node(rx_parser *ps, uint8_t b) {
+  uint8_t set[32] = {0};
+  set_add(set, b);
+  return rx_set_node(ps, set);
+}
+
+static rx_node *rx_range_node(rx_parser *ps, int lo, int hi) {
+  uint8_t set[32] = {0};
+  set_range(set, lo, hi);
+  return rx_set_node(ps, set);
+}
+
+// the ASCII bytes in ascii or any multi-byte UTF-8 sequence, so that . and
+// negated classes step over whole codepoints
+static rx_node *rx_any_node(rx_parser *ps, const uint8_t *ascii) {
+  uint8_t set[32] = {0};
+  memcpy(set, ascii, 16);
+  rx_node *alt = rx_node_new(ps, RX_NODE_ALT);
+  rx_node_add(alt, rx_set_node(ps, set));
+  static const int leads[3][2] = {{0xC2, 0xDF}, {0xE0, 0xEF}, {0xF0, 0xF4}};
+  for (int k = 0; k < 3; k++) {
+    rx_node *cat = rx_node_new(ps, RX_NODE_CAT);
+    rx_node_add(cat, rx_range_node(ps, leads[k][0], leads[k][1]));
+    for (int i = 0; i <= k; i++) {
+      rx_node_add(cat, rx_range_node(ps, 0x80, 0xBF));
+    }
+    rx_node_add(alt, cat);
+  }
+  return alt;
+}
+
+static void rx_class_set(uint8_t *set, char c) {
+  switch (c) {
+  case 'd':
+    set_range(set, '0', '9');
+    break;
+  case 'w':
+    set_range(set, '0', '9');
+    set_range(set, 'A', 'Z');
+    set_range(set, 'a', 'z');
+    set_add(set, '_');
+    break;
+  case 's':
+    set_add(set, ' ');
+    set_range(set, '\t', '\r');
+    break;
+  }
+}
+
+static int rx_hex(int c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if ((c | 32) >= 'a' && (c | 32) <= 'f') {
+    return (c | 32) - 'a' + 10;
+  }
+  return -1;
+}
+
+// byte an escape stands for, -1 if it is a class, -2 if it is invalid
+static int rx_escape_byte(rx_parser *ps, int e) {
+  switch (e) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case 'f':
+    return '\f';
+  case 'v':
+    return '\v';
+  case 'd':
+  case 'w':
+  case 's':
+  case 'D':
+  case 'W':
+  case 'S':
+    return -1;
+  case 'x':
+    if (ps->end - ps->p >= 2 && rx_hex(ps->p[0]) >= 0 &&
+        rx_hex(ps->p[1]) >= 0) {
+      int b = rx_hex(ps->p[0]) * 16 + rx_hex(ps->p[1]);
+      ps->p += 2;
+      return b;
+    }
+    return -2;
+  }
+  if ((e >= '0' && e <= '9') || ((e | 32) >= 'a' && (e | 32) <= 'z')) {
+    return -2;
+  }
+  return e;
+}
+
+// [...], negated classes don't match line breaks
+static rx_node *rx_parse_class(rx_parser *ps) {
+  uint8_t set[32] = {0};
+  bool negate = ps->p < ps->end && *ps->p == '^';
+  if (negate) {
+    ps->p++;
+  }
+  bool any_utf8 = false; // \W, \S or \D inside, non-ASCII codepoints match
+  bool first = true;
+  while (ps->p < ps->end && (*ps->p != ']' || first)) {
+    first = false;
+    int lo = *ps->p++;
+    if (lo == '\\') {
+      if (ps->p == ps->end) {
+        break;
+      }
+      int e = *ps->p++;
+      lo = rx_escape_byte(ps, e);
+      if (lo == -2) {
+        ps->error = "unknown escape in class";
+        return NULL;
+      }
+      if (lo == -1) {
+        uint8_t cls[32] = {0};
+        rx_class_set(cls, e | 32);
+        for (int i = 0; i < 16; i++) {
+          set[i] |= e >= 'a' ? cls[i] : (uint8_t)~cls[i];
+        }
+        any_utf8 |= e < 'a';
+        continue;
+      }
+    } else if (lo >= 0x80) {
+      ps->error = "non-ASCII characters in a class";
+      return NULL;
+    }
+    int hi = lo;
+    if (ps->end - ps->p >= 2 && ps->p[0] == '-' && ps->p[1] != ']') {
+      ps->p++;
+      hi = *ps->p++;
+      if (hi == '\\' && ps->p < ps->end) {
+        hi = rx_escape_byte(ps, *ps->p++);
+      }
+      if (hi < lo || hi >= 0x80) {
+        ps->error = "bad class range";
+        return NULL;
+      }
+    }
+    set_range(set, lo, hi);
+  }
+  if (ps->p == ps->end) {
+    ps->error = "missing ]";
+    return NULL;
+  }
+  ps->p++;
+  if (ps->flags & RX_ICASE) {
+    rx_fold_case(set);
+  }
+  if (negate) {
+    for (int i = 0; i < 16; i++) {
+      set[i] = ~set[i];
+    }
+    set[1] &= ~(1 << 2); // '\n'
+    return rx_any_node(ps, set);
+  }
+  return any_utf8 ? rx_any_node(ps, set) : rx_set_node(ps, set);
+}
+
+static rx_node *rx_parse_alt(rx_parser *ps);
+
+static rx_node *rx_parse_atom(rx_parser *ps) {
+  int c = *ps->p++;
+  switch (c) {
+  case '(': {
+    if (ps->end - ps->p >= 2 && ps->p[0] == '?' && ps->p[1] == ':') {
+      ps->p += 2;
+    }
+    if (++ps->depth > RX_MAX_DEPTH) {
+      ps->error = "groups nested too deeply";
+      return NULL;
+    }
+    rx_node *inner = rx_parse_alt(ps);
+    ps->depth--;
+    if (inner == NULL) {
+      return NULL;
+    }
+    if (ps->p == ps->end || *ps->p != ')') {
+      ps->error = "missing )";
+      return NULL;
+    }
+    ps->p++;
+    return inner;
+  }
+  case '[':
+    return rx_parse_class(ps);
+  case '.': {
+    uint8_t set[32] = {0};
+    set_range(set, 0, 0x7F);
+    set[1] &= ~(1 << 2); // '\n'
+    return rx_any_node(ps, set);
+  }
+  case '^':
+    return rx_node_new(ps, RX_NODE_BOL);
+  case '$':
+    return rx_node_new(ps, RX_NODE_EOL);
+  case '*':
+  case '+':
+  case '?':
+    ps->error = "nothing to repeat";
+    return NULL;
+  case '\\': {
+    if (ps->p == ps->end) {
+      ps->error = "trailing \\";
+      return NULL;
+    }
+    int e = *ps->p++;
+    int b = rx_escape_byte(ps, e);
+    if (b == -2) {
+      ps->error = "unknown escape";
+      return NULL;
+    }
+    if (b == -1) {
+      uint8_t set[32] = {0};
+      rx_class_set(set, e | 32);
+      if (e >= 'a') {
+        return rx_set_node(ps, set);
+      }
+      for (int i = 0; i < 16; i++) {
+        set[i] = ~set[i];
+      }
+      return rx_any_node(ps, set);
+    }
+    return rx_byte_node(ps, (uint8_t)b);
+  }
+  }
+  if (c < 0xC0) {
+    return rx_byte_node(ps, (uint8_t)c);
+  }
+  // a multi-byte character is one atom, quantifiers apply to all of it
+  rx_node *cat = rx_node_new(ps, RX_NODE_CAT);
+  rx_node_add(cat, rx_byte_node(ps, (uint8_t)c));
+  while (ps->p < ps->end && (*ps->p & 0xC0) == 0x80) {
+    rx_node_add(cat, rx_byte_node(ps, *ps->p++));
+  }
+  return cat;
+}
+
+// parses {m}, {m,} or {m,n}, a brace that doesn't start one is a literal
+static bool rx_parse_count(rx_parser *ps, int *min_p, int *max_p) {
+  const unsigned char *p = ps->p + 1;
+  int min = 0, max;
+  if (p == ps->end || *p < '0' || *p > '9') {
+    return false;
+  }
+  while (p < ps->end && *p >= '0' && *p <= '9' && min <= RX_MAX_REPEAT) {
+    min = min * 10 + (*p++ - '0');
+  }
+  max = min;
+  if (p < ps->end && *p == ',') {
+    p++;
+    max = -1;
+    if (p < ps->end && *p >= '0' && *p <= '9') {
+      max = 0;
+      while (p < ps->end && *p >= '0' && *p <= '9' && max <= RX_MAX_REPEAT) {
+        max = max * 10 + (*p++ - '0');
+      }
+    }
+  }
+  if (p == ps->end || *p != '}') {
+    return false;
+  }
+  ps->p = p + 1;
+  *min_p = min;
+  *max_p = max;
+  return true;
+}
+
+static rx_node *rx_parse_repeat(rx_parser *ps) {
+  rx_node *atom = rx_parse_atom(ps);
+  for (int stacked = 0; atom != NULL && ps->p < ps->end; stacked++) {
+    if (stacked == RX_MAX_DEPTH) {
+      ps->error = "too many quantifiers";
+      return NULL;
+    }
+    int min, max;
+    switch (*ps->p) {
+    case '*':
+      min = 0, max = -1, ps->p++;
+      break;
+    case '+':
+      min = 1, max = -1, ps->p++;
+      break;
+    case '?':
+      min = 0, max = 1, ps->p++;
+      break;
+    case '{':
+      if (!rx_parse_count(ps, &min, &max)) {
+        return atom;
+      }
+      if (min > RX_MAX_REPEAT || max > RX_MAX_REPEAT ||
+          (max >= 0 && max < min)) {
+        ps->error = "bad repeat count";
+        return NULL;
+      }
+      break;
+    default:
+      return atom;
+    }
+    rx_node *rep = rx_node_new(ps, RX_NODE_REPEAT);
+    rep->min = min;
+    rep->max = max;
+    if (ps->p < ps->end && *ps->p == '?') {
+      rep->greedy = false;
+      ps->p++;
+    }
+    rx_node_add(rep, atom);
+    atom = rep;
+  }
+  return atom;
+}
+
+static rx_node *rx_parse_cat(rx_parser *ps) {
+  rx_node *cat = rx_node_new(ps, RX_NODE_CAT);
+  while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+    rx_node *kid = rx_parse_repeat(ps);
+    if (kid == NULL) {
+      return NULL;
+    }
+    rx_node_add(cat, kid);
+  }
+  return cat;
+}
+
+static rx_node *rx_parse_alt(rx_parser *ps) {
+  rx_node *first = rx_parse_cat(ps);
+  if (first == NULL || ps->p == ps->end || *ps->p != '|') {
+    return first;
+  }
+  rx_node *alt = rx_node_new(ps, RX_NODE_ALT);
+  rx_node_add(alt, first);
+  while (ps->p < ps->end && *ps->p == '|') {
+    ps->p++;
+    rx_node *kid = rx_parse_cat(ps);
+    if (kid == NULL) {
+      return NULL;
+    }
+    rx_node_add(alt, kid);
+  }
+  return alt;
+}
+
+// appends the bytes every match has to start with, returns whether the whole
+// node was a literal
+static bool rx_prefix(const rx_node *node, char *prefix, size_t *len_p) {
+  if (node->kind == RX_NODE_SET) {
+    int count = 0, last = 0;
+    for (int b = 0; b < 256 && count < 2; b++) {
+      if (set_has(node->set, b)) {
+        count++;
+        last = b;
+      }
+    }
+    if (count != 1 || *len_p == RX_PREFIX_MAX) {
+      return false;
+    }
+    prefix[(*len_p)++] = (char)last;
+    return true;
+  }
+  if (node->kind == RX_NODE_CAT) {
+    for (size_t i = 0; i < node->num_kids; i++) {
+      if (!rx_prefix(node->kids[i], prefix, len_p)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// Compiler, syntax tree to NFA. Nodes are compiled back to front, each one
+// given the instruction that follows it. The reverse program matches the
+// pattern read backwards, with ^ and $ swapped
+//------------------------------------------------------------------------------
+
+static uint32_t rx_emit(rx_prog *prog, rx_op op, uint32_t out, uint32_t out1) {
+  if (prog->num == prog->cap) {
+    prog->cap = prog->cap > 0 ? prog->cap * 2 : 64;
+    rx_inst *insts = realloc(prog->insts, prog->cap * sizeof(rx_inst));
+    if (insts == NULL) {
+      fprintf(stderr, "Error: regex allocation failed");
+      exit(1);
+    }
+    prog->insts = insts;
+  }
+  prog->insts[prog->num] = (rx_inst){.op = op, .out = out, .out1 = out1};
+  return (uint32_t)prog->num++;
+}
+
+static uint32_t rx_compile_node(rx_prog *prog, const rx_node *node,
+                                uint32_t next, bool reverse) {
+  if (prog->num > RX_MAX_INSTS) {
+    return next; // reported by the caller
+  }
+  switch (node->kind) {
+  case RX_NODE_SET: {
+    uint32_t i = rx_emit(prog, RX_OP_SET, next, 0);
+    memcpy(prog->insts[i].set, node->set, 32);
+    return i;
+  }
+  case RX_NODE_CAT:
+    for (size_t k = 0; k < node->num_kids; k++) {
+      size_t kid = reverse ? k : node->num_kids - 1 - k;
+      next = rx_compile_node(prog, node->kids[kid], next, reverse);
+    }
+    return next;
+  case RX_NODE_ALT: {
+    uint32_t s =
+        rx_compile_node(prog, node->kids[node->num_kids - 1], next, reverse);
+    for (size_t k = node->num_kids - 1; k-- > 0;) {
+      uint32_t kid = rx_compile_node(prog, node->kids[k], next, reverse);
+      s = rx_emit(prog, RX_OP_SPLIT, kid, s);
+    }
+    return s;
+  }
+  case RX_NODE_REPEAT: {
+    const rx_node *kid = node->kids[0];
+    uint32_t s = next;
+    if (node->max < 0) {
+      uint32_t loop = rx_emit(prog, RX_OP_SPLIT, 0, 0);
+      uint32_t body = rx_compile_node(prog, kid, loop, reverse);
+      prog->insts[loop].out = node->greedy ? body : next;
+      prog->insts[loop].out1 = node->greedy ? next : body;
+      s = loop;
+    } else {
+      for (int k = node->min; k < node->max; k++) {
+        uint32_t body = rx_compile_node(prog, kid, s, reverse);
+        s = node->greedy ? rx_emit(prog, RX_OP_SPLIT, body, next)
+                         : rx_emit(prog, RX_OP_SPLIT, next, body);
+      }
+    }
+    for (int k = 0; k < node->min; k++) {
+      s = rx_compile_node(prog, kid, s, reverse);
+    }
+    return s;
+  }
+  case RX_NODE_BOL:
+  case RX_NODE_EOL: {
+    bool bol = (node->kind == RX_NODE_BOL) != reverse;
+    prog->has_bol |= bol;
+    return rx_emit(prog, bol ? RX_OP_BOL : RX_OP_EOL, next, 0);
+  }
+  }
+  return next;
+}
+
+//------------------------------------------------------------------------------
+// Lazy DFA
+//------------------------------------------------------------------------------
+
+static void rx_dfa_flush(rx_dfa *d);
+
+static void rx_dfa_init(rx_dfa *d, const rx_prog *prog, bool longest) {
+  size_t n = prog->num;
+  *d = (rx_dfa){.prog = prog, .longest = longest};
+  d->max_ids = RX_DFA_MAX_IDS > 4 * n ? RX_DFA_MAX_IDS : 4 * n;
+  d->trans = rx_alloc((size_t)RX_DFA_MAX_STATES * 256 * sizeof(uint32_t));
+  d->ids = rx_alloc(d->max_ids * sizeof(uint32_t));
+  d->state_off = rx_alloc(RX_DFA_MAX_STATES * sizeof(size_t));
+  d->state_len = rx_alloc(RX_DFA_MAX_STATES * sizeof(uint32_t));
+  d->state_flags = rx_alloc(RX_DFA_MAX_STATES);
+  d->table = rx_alloc(2 * RX_DFA_MAX_STATES * sizeof(uint32_t));
+  d->accel_len = rx_alloc(RX_DFA_MAX_STATES);
+  d->accel = rx_alloc(RX_DFA_MAX_STATES * RX_ACCEL_BYTES);
+  d->marks = calloc(n, sizeof(uint32_t));
+  if (d->marks == NULL) {
+    fprintf(stderr, "Error: regex allocation failed");
+    exit(1);
+  }
+  d->stack = rx_alloc((2 * n + 2) * sizeof(uint32_t));
+  d->list_a = rx_alloc(n * sizeof(uint32_t));
+  d->list_b = rx_alloc(n * sizeof(uint32_t));
+  rx_dfa_flush(d);
+}
+
+static void rx_dfa_free(rx_dfa *d) {
+  free(d->trans);
+  free(d->ids);
+  free(d->state_off);
+  free(d->state_len);
+  free(d->state_flags);
+  free(d->table);
+  free(d->accel_len);
+  free(d->accel);
+  free(d->marks);
+  free(d->stack);
+  free(d->list_a);
+  free(d->list_b);
+}
+
+static uint32_t rx_dfa_hash(const uint32_t *ids, size_t n, uint8_t flags) {
+  uint32_t h = 2166136261u ^ flags;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ ids[i]) * 16777619u;
+  }
+  return h;
+}
+
+// index of the state with these ids, RX_FULL if it is new and the cache
+// has no room for it
+static uint32_t rx_dfa_intern(rx_dfa *d, const uint32_t *ids, size_t n,
+                              uint8_t flags) {
+  size_t mask = 2 * RX_DFA_MAX_STATES - 1;
+  size_t i = rx_dfa_hash(ids, n, flags) & mask;
+  for (; d->table[i] != 0; i = (i + 1) & mask) {
+    uint32_t s = d->table[i] - 1;
+    if (d->state_len[s] == n && d->state_flags[s] == flags &&
+        memcmp(d->ids + d->state_off[s], ids, n * sizeof(uint32_t)) == 0) {
+      return s;
+    }
+  }
+  if (d->num_states == RX_DFA_MAX_STATES || d->num_ids + n > d->max_ids) {
+    return RX_FULL;
+  }
+  uint32_t s = (uint32_t)d->num_states++;
+  d->state_off[s] = d->num_ids;
+  d->state_len[s] = (uint32_t)n;
+  d->state_flags[s] = flags;
+  if (n > 0) {
+    memcpy(d->ids + d->num_ids, ids, n * sizeof(uint32_t));
+    d->num_ids += n;
+  }
+  // a state without threads never comes back to life
+  memset(d->trans + (size_t)s * 256, n > 0 ? 0xFF : RX_DEAD,
+         256 * sizeof(uint32_t));
+  d->accel_len[s] = RX_ACCEL_UNKNOWN;
+  d->table[i] = s + 1;
+  return s;
+}
+
+static void rx_dfa_flush(rx_dfa *d) {
+  d->num_states = 0;
+  d->num_ids = 0;
+  memset(d->table, 0, 2 * RX_DFA_MAX_STATES * sizeof(uint32_t));
+  rx_dfa_intern(d, NULL, 0, 0); // RX_DEAD
+  d->flushes++;
+}
+
+static uint32_t rx_dfa_add(rx_dfa *d, const uint32_t *ids, size_t n,
+                           uint8_t flags) {
+  uint32_t s = rx_dfa_intern(d, ids, n, flags);
+  if (s == RX_FULL && !d->no_flush) {
+    rx_dfa_flush(d);
+    s = rx_dfa_intern(d, ids, n, flags);
+  }
+  return s;
+}
+
+// appends the instructions reachable from id without consuming a byte, in
+// priority order. ^ holds after a line break, $ only once the next byte is
+// known to be one, until then it stays in the list
+static void rx_dfa_closure(rx_dfa *d, uint32_t *list, size_t *n_p,
+                           uint32_t id, bool line_start, bool line_end) {
+  size_t top = 0;
+  d->stack[top++] = id;
+  while (top > 0) {
+    uint32_t x = d->stack[--top];
+    if (d->marks[x] == d->gen) {
+      continue;
+    }
+    d->marks[x] = d->gen;
+    const rx_inst *inst = &d->prog->insts[x];
+    switch (inst->op) {
+    case RX_OP_SET:
+    case RX_OP_MATCH:
+      list[(*n_p)++] = x;
+      break;
+    case RX_OP_EOL:
+      if (line_end) {
+        d->stack[top++] = inst->out;
+      } else {
+        list[(*n_p)++] = x;
+      }
+      break;
+    case RX_OP_BOL:
+      if (line_start) {
+        d->stack[top++] = inst->out;
+      }
+      break;
+    case RX_OP_SPLIT:
+      d->stack[top++] = inst->out1;
+      d->stack[top++] = inst->out;
+      break;
+    }
+  }
+}
+
+static void rx_dfa_new_gen(rx_dfa *d) {
+  if (++d->gen == 0) {
+    memset(d->marks, 0, d->prog->num * sizeof(uint32_t));
+    d->gen = 1;
+  }
+}
+
+// the threads of state s once the position is known to end a line
+static size_t rx_dfa_at_line_end(rx_dfa *d, uint32_t s, uint32_t *list) {
+  const uint32_t *ids = d->ids + d->state_off[s];
+  bool line_start = d->state_flags[s] & 1;
+  size_t n = 0;
+  rx_dfa_new_gen(d);
+  for (size_t i = 0; i < d->state_len[s]; i++) {
+    if (d->prog->insts[ids[i]].op == RX_OP_EOL) {
+      rx_dfa_closure(d, list, &n, d->prog->insts[ids[i]].out, line_start,
+                     true);
+    } else if (d->marks[ids[i]] != d->gen) {
+      d->marks[ids[i]] = d->gen;
+      list[n++] = ids[i];
+    }
+  }
+  return n;
+}
+
+// slot picks one of two entries a DFA is started from
+static uint32_t rx_dfa_start(rx_dfa *d, uint32_t entry, int slot,
+                             bool line_start) {
+  if (d->start_flushes != d->flushes) {
+    memset(d->start_cache, 0xFF, sizeof(d->start_cache));
+    d->start_flushes = d->flushes;
+  }
+  uint32_t *cached = &d->start_cache[slot * 2 + line_start];
+  if (*cached == RX_FULL) {
+    size_t n = 0;
+    rx_dfa_new_gen(d);
+    rx_dfa_closure(d, d->list_b, &n, entry, line_start, false);
+    uint32_t s =
+        rx_dfa_add(d, d->list_b, n, line_start && d->prog->has_bol ? 1 : 0);
+    if (d->start_flushes != d->flushes) {
+      memset(d->start_cache, 0xFF, sizeof(d->start_cache));
+      d->start_flushes = d->flushes;
+    }
+    d->start_cache[slot * 2 + line_start] = s;
+    return s;
+  }
+  return *cached;
+}
+
+// computes and caches the transition of state s on byte b
+static uint32_t rx_dfa_step(rx_dfa *d, uint32_t s, uint8_t b) {
+  const uint32_t *list = d->ids + d->state_off[s];
+  size_t n = d->state_len[s];
+  if (b == '\n') {
+    n = rx_dfa_at_line_end(d, s, d->list_a);
+    list = d->list_a;
+  }
+  bool matched = false;
+  size_t m = 0;
+  rx_dfa_new_gen(d);
+  for (size_t i = 0; i < n; i++) {
+    const rx_inst *inst = &d->prog->insts[list[i]];
+    if (inst->op == RX_OP_MATCH) {
+      matched = true;
+      if (!d->longest) {
+        break; // threads after the match lose to it
+      }
+    } else if (inst->op == RX_OP_SET && set_has(inst->set, b)) {
+      rx_dfa_closure(d, d->list_b, &m, inst->out, b == '\n', false);
+    }
+  }
+  size_t flushes = d->flushes;
+  uint32_t next = rx_dfa_add(d, d->list_b, m,
+                             b == '\n' && d->prog->has_bol ? 1 : 0);
+  if (next == RX_FULL) {
+    return RX_UNKNOWN;
+  }
+  uint32_t t = next | (matched ? RX_MATCHED : 0);
+  if (d->flushes == flushes) {
+    d->trans[(size_t)s * 256 + b] = t;
+  }
+  return t;
+}
+
+// fills in every transition of s to find the bytes that leave it, a state
+// that loops on all but a few can be skipped through with a SIMD scan
+static void rx_dfa_accel(rx_dfa *d, uint32_t s) {
+  uint8_t escapes[RX_ACCEL_BYTES];
+  size_t n = 0;
+  d->accel_len[s] = RX_ACCEL_NONE;
+  d->no_flush = true; // s has to stay valid
+  for (int b = 0; b < 256; b++) {
+    uint32_t t = d->trans[(size_t)s * 256 + b];
+    if (t == RX_UNKNOWN) {
+      t = rx_dfa_step(d, s, (uint8_t)b);
+    }
+    if (t == RX_UNKNOWN) {
+      n = RX_ACCEL_BYTES + 1; // out of room, try again after a flush
+    } else if (t != s && n <= RX_ACCEL_BYTES) {
+      if (n < RX_ACCEL_BYTES) {
+        escapes[n] = (uint8_t)b;
+      }
+      n++;
+    }
+    if (n > RX_ACCEL_BYTES) {
+      break;
+    }
+  }
+  d->no_flush = false;
+  if (n > 0 && n <= RX_ACCEL_BYTES) {
+    memcpy(d->accel[s], escapes, n);
+    d->accel_len[s] = (uint8_t)n;
+  }
+}
+
+// whether a match ends where the input does
+static bool rx_dfa_final(rx_dfa *d, uint32_t s, bool line_end) {
+  const uint32_t *list = d->ids + d->state_off[s];
+  size_t n = d->state_len[s];
+  if (line_end) {
+    n = rx_dfa_at_line_end(d, s, d->list_a);
+    list = d->list_a;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (d->prog->insts[list[i]].op == RX_OP_MATCH) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// state s without the thread skipping ahead to later start positions
+static uint32_t rx_dfa_without(rx_dfa *d, uint32_t s, uint32_t id) {
+  const uint32_t *ids = d->ids + d->state_off[s];
+  size_t m = 0;
+  for (size_t i = 0; i < d->state_len[s]; i++) {
+    if (ids[i] != id) {
+      d->list_b[m++] = ids[i];
+    }
+  }
+  return rx_dfa_add(d, d->list_b, m, d->state_flags[s]);
+}
+
+//------------------------------------------------------------------------------
+// Search, the DFAs run over the snapshot's pieces in place
+//------------------------------------------------------------------------------
+
+// piece holding a position, moved incrementally as the search goes
+typedef struct {
+  const ptbl_snapshot *snap_p;
+  size_t piece;
+  size_t piece_start;
+} rx_cursor;
+
+static void rx_seek(rx_cursor *c, size_t pos) {
+  const ptbl_snapshot *snap_p = c->snap_p;
+  while (pos >= c->piece_start + snap_p->lens[c->piece] &&
+         c->piece + 1 < snap_p->num_pieces) {
+    c->piece_start += snap_p->lens[c->piece++];
+  }
+  while (pos < c->piece_start) {
+    c->piece_start -= snap_p->lens[--c->piece];
+  }
+}
+
+static uint8_t rx_byte_at(rx_cursor *c, size_t pos) {
+  rx_seek(c, pos);
+  return (uint8_t)c->snap_p->chars[c->piece][pos - c->piece_start];
+}
+
+static bool rx_line_start(rx_cursor *c, size_t pos) {
+  return pos == 0 || rx_byte_at(c, pos - 1) == '\n';
+}
+
+// runs the forward DFA from pos until it dies, returns where the last match
+// it saw ends. From drop_at on no new start positions are tried
+static size_t rx_run_forward(rx_regex *rx, rx_cursor *c, uint32_t s,
+                             size_t pos, size_t drop_at) {
+  rx_dfa *d = &rx->fwd_dfa;
+  size_t len = c->snap_p->len;
+  size_t last = RX_NONE;
+  while (pos < len) {
+    if (pos == drop_at) {
+      s = rx_dfa_without(d, s, rx->fwd_loop_any);
+      if (s == RX_DEAD) {
+        return last;
+      }
+    }
+    rx_seek(c, pos);
+    size_t stop = c->piece_start + c->snap_p->lens[c->piece];
+    if (pos < drop_at && drop_at < stop) {
+      stop = drop_at;
+    }
+    const uint8_t *p =
+        (const uint8_t *)c->snap_p->chars[c->piece] + (pos - c->piece_start);
+    const uint8_t *p_end = p + (stop - pos);
+    for (; pos < stop; pos++, p++) {
+      uint32_t t = d->trans[(size_t)s * 256 + *p];
+      if (t == s) {
+        if (d->accel_len[s] == RX_ACCEL_UNKNOWN) {
+          rx_dfa_accel(d, s);
+        }
+        if (d->accel_len[s] != RX_ACCEL_NONE) {
+          const uint8_t *q = (const uint8_t *)search_any_byte(
+              (const char *)p + 1, (const char *)p_end, d->accel[s],
+              d->accel_len[s]);
+          pos += q - p - 1;
+          p = q - 1;
+        }
+        continue;
+      }
+      if (t == RX_UNKNOWN) {
+        t = rx_dfa_step(d, s, *p);
+      }
+      if (t & RX_MATCHED) {
+        last = pos;
+      }
+      s = t & RX_STATE_MASK;
+      if (s == RX_DEAD) {
+        return last;
+      }
+    }
+  }
+  return rx_dfa_final(d, s, true) ? len : last;
+}
+
+// runs the reverse DFA back from end, no further than from, returns the
+// earliest position a match ending at end can start
+static size_t rx_run_reverse(rx_regex *rx, rx_cursor *c, size_t end,
+                             size_t from) {
+  rx_dfa *d = &rx->rev_dfa;
+  bool line_end = end == c->snap_p->len || rx_byte_at(c, end) == '\n';
+  uint32_t s = rx_dfa_start(d, rx->rev_start, 0, line_end);
+  size_t last = RX_NONE;
+  size_t pos = end;
+  while (pos > from) {
+    rx_seek(c, pos - 1);
+    size_t stop = c->piece_start > from ? c->piece_start : from;
+    const uint8_t *p =
+        (const uint8_t *)c->snap_p->chars[c->piece] + (pos - c->piece_start);
+    for (; pos > stop; pos--) {
+      uint8_t b = *--p;
+      uint32_t t = d->trans[(size_t)s * 256 + b];
+      if (t == RX_UNKNOWN) {
+        t = rx_dfa_step(d, s, b);
+      }
+      if (t & RX_MATCHED) {
+        last = pos;
+      }
+      s = t & RX_STATE_MASK;
+      if (s == RX_DEAD) {
+        return last;
+      }
+    }
+  }
+  return rx_dfa_final(d, s, rx_line_start(c, from)) ? from : last;
+}
+
+// every match is checked from a candidate found by the literal scanner
+static void rx_search_prefix(rx_regex *rx, rx_cursor *c, size_t from,
+                             size_t to, search_results *out) {
+  search_results cands = {0};
+  size_t pos = from;
+  while (pos < to) {
+    size_t chunk_end = to - pos > RX_PREFIX_CHUNK ? pos + RX_PREFIX_CHUNK : to;
+    cands.count = 0;
+    search_literal(c->snap_p, pos, chunk_end, rx->prefix, rx->prefix_len,
+                   &cands);
+    for (size_t i = 0; i < cands.count; i++) {
+      size_t start = cands.offsets[i];
+      if (start < pos) {
+        continue; // inside the last match
+      }
+      uint32_t s = rx_dfa_start(&rx->fwd_dfa, rx->fwd_start, 0,
+                                rx_line_start(c, start));
+      size_t end = rx_run_forward(rx, c, s, start, RX_NONE);
+      if (end != RX_NONE && end > start) {
+        search_results_push(out, start, end - start);
+        pos = end;
+      }
+    }
+    pos = pos > chunk_end ? pos : chunk_end;
+  }
+  search_results_free(&cands);
+}
+
+// appends every leftmost-first match starting in [from, to), matches don't
+// overlap and empty ones are skipped. The forward DFA finds where the
+// leftmost match ends, the reverse DFA where it starts, so no text is
+// copied and the state kept is bounded by the DFA caches
+size_t rx_search(rx_regex *rx, const ptbl_snapshot *snap_p, size_t from,
+                 size_t to, search_results *out) {
+  size_t found = out->count;
+  to = to < snap_p->len ? to : snap_p->len;
+  if (from >= to || snap_p->num_pieces == 0) {
+    return 0;
+  }
+  rx_cursor c = {.snap_p = snap_p};
+  if (rx->prefix_len > 0) {
+    rx_search_prefix(rx, &c, from, to, out);
+    return out->count - found;
+  }
+  size_t pos = from;
+  while (pos < to) {
+    uint32_t s =
+        rx_dfa_start(&rx->fwd_dfa, rx->fwd_loop, 1, rx_line_start(&c, pos));
+    size_t end = rx_run_forward(rx, &c, s, pos, to);
+    if (end == RX_NONE) {
+      break;
+    }
+    size_t start = rx_run_reverse(rx, &c, end, pos);
+    if (start >= to) {
+      break;
+    }
+    if (end > start) {
+      search_results_push(out, start, end - start);
+    }
+    pos = end > start ? end : end + 1;
+  }
+  return out->count - found;
+}
+
+rx_regex *rx_compile(const char *pattern, size_t len, int flags,
+                     const char **error_p) {
+  rx_parser ps = {.p = (const unsigned char *)pattern,
+                  .end = (const unsigned char *)pattern + len,
+                  .flags = flags};
+  rx_node *root = rx_parse_alt(&ps);
+  if (root != NULL && ps.p != ps.end) {
+    ps.error = "unmatched )";
+  }
+  if (ps.error != NULL) {
+    *error_p = ps.error;
+    rx_parser_free(&ps);
+    return NULL;
+  }
+
+  rx_regex *rx = rx_alloc(sizeof(rx_regex));
+  *rx = (rx_regex){0};
+  uint32_t match = rx_emit(&rx->fwd, RX_OP_MATCH, 0, 0);
+  rx->fwd_start = rx_compile_node(&rx->fwd, root, match, false);
+  rx->fwd_loop_any = rx_emit(&rx->fwd, RX_OP_SET, 0, 0);
+  memset(rx->fwd.insts[rx->fwd_loop_any].set, 0xFF, 32);
+  rx->fwd_loop = rx_emit(&rx->fwd, RX_OP_SPLIT, rx->fwd_start,
+                         rx->fwd_loop_any);
+  rx->fwd.insts[rx->fwd_loop_any].out = rx->fwd_loop;
+  match = rx_emit(&rx->rev, RX_OP_MATCH, 0, 0);
+  rx->rev_start = rx_compile_node(&rx->rev, root, match, true);
+  rx_prefix(root, rx->prefix, &rx->prefix_len);
+  rx_parser_free(&ps);
+  if (rx->fwd.num > RX_MAX_INSTS || rx->rev.num > RX_MAX_INSTS) {
+    *error_p = "pattern too large";
+    free(rx->fwd.insts);
+    free(rx->rev.insts);
+    free(rx);
+    return NULL;
+  }
+  rx_dfa_init(&rx->fwd_dfa, &rx->fwd, false);
+  rx_dfa_init(&rx->rev_dfa, &rx->rev, true);
+  return rx;
+}
+
+void rx_free(rx_regex *rx) {
+  if (rx == NULL) {
+    return;
+  }
+  rx_dfa_free(&rx->fwd_dfa);
+  rx_dfa_free(&rx->rev_dfa);
+  free(rx->fwd.insts);
+  free(rx->rev.insts);
+  free(rx);
+}
@@ -0,0 +1,247 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/search.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SEARCH_X86 1
+#endif
+
+void search_results_push(search_results *sr, size_t offset, size_t len) {
+  if (sr->count == sr->cap) {
+    size_t cap = sr->cap > 0 ? sr->cap * 2 : 64;
+    size_t *offsets = realloc(sr->offsets, cap * sizeof(size_t));
+    size_t *lens = offsets != NULL ? realloc(sr->lens, cap * sizeof(size_t))
+                                   : NULL;
+    if (offsets == NULL || lens == NULL) {
+      fprintf(stderr, "Error: search results allocation failed");
+      exit(1);
+    }
+    sr->offsets = offsets;
+    sr->lens = lens;
+    sr->cap = cap;
+  }
+  sr->offsets[sr->count] = offset;
+  sr->lens[sr->count++] = len;
+}
+
+void search_results_free(search_results *sr) {
+  free(sr->offsets);
+  free(sr->lens);
+  *sr = (search_results){0};
+}
+
+// index of the first match starting at or after pos
+size_t search_results_lower_bound(const search_results *sr, size_t pos) {
+  size_t lo = 0;
+  size_t hi = sr->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (sr->offsets[mid] < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Span kernels, report every i < max_start with hay[i, i + n) == needle as
+// base + i. Candidates are filtered on the needle's first and last byte a
+// block at a time, only those are compared in full. n >= 2 and len >= n
+
+static void search_span_scalar(const char *hay, size_t len, const char *needle,
+                               size_t n, size_t base, size_t max_start,
+                               search_results *out) {
+  size_t end = len - n + 1 < max_start ? len - n + 1 : max_start;
+  const char *p = hay;
+  while ((p = memchr(p, needle[0], end - (p - hay))) != NULL) {
+    if (p[n - 1] == needle[n - 1] && memcmp(p + 1, needle + 1, n - 2) == 0) {
+      search_results_push(out, base + (p - hay), n);
+    }
+    p++;
+  }
+}
+
+#ifdef SEARCH_X86
+static void search_span_sse2(const char *hay, size_t len, const char *needle,
+                             size_t n, size_t base, size_t max_start,
+                             search_results *out) {
+  size_t end = len - n + 1 < max_start ? len - n + 1 : max_start;
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[n - 1]);
+  size_t i = 0;
+  for (; i + 16 <= end; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+    __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + n - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                      _mm_cmpeq_epi8(last, block_last)));
+    while (mask != 0) {
+      size_t at = i + __builtin_ctz(mask);
+      if (memcmp(hay + at + 1, needle + 1, n - 2) == 0) {
+        search_results_push(out, base + at, n);
+      }
+      mask &= mask - 1;
+    }
+  }
+  if (i < end) {
+    search_span_scalar(hay + i, len - i, needle, n, base + i, end - i, out);
+  }
+}
+
+__attribute__((target("avx2"))) static void
+search_span_avx2(const char *hay, size_t len, const char *needle, size_t n,
+                 size_t base, size_t max_start, search_results *out) {
+  size_t end = len - n + 1 < max_start ? len - n + 1 : max_start;
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[n - 1]);
+  size_t i = 0;
+  for (; i + 32 <= end; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+    __m256i block_last =
+        _mm256_loadu_si256((const __m256i *)(hay + i + n - 1));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                         _mm256_cmpeq_epi8(last, block_last)));
+    while (mask != 0) {
+      size_t at = i + __builtin_ctz(mask);
+      if (memcmp(hay + at + 1, needle + 1, n - 2) == 0) {
+        search_results_push(out, base + at, n);
+      }
+      mask &= mask - 1;
+    }
+  }
+  if (i < end) {
+    search_span_sse2(hay + i, len - i, needle, n, base + i, end - i, out);
+  }
+}
+#endif
+
+typedef void (*search_span_fn)(const char *, size_t, const char *, size_t,
+                               size_t, size_t, search_results *);
+
+static search_span_fn search_pick_kernel(void) {
+#ifdef SEARCH_X86
+  return __builtin_cpu_supports("avx2") ? search_span_avx2 : search_span_sse2;
+#else
+  return search_span_scalar;
+#endif
+}
+
+static void search_span(search_span_fn kernel, const char *hay, size_t len,
+                        const char *needle, size_t n, size_t base,
+                        size_t max_start, search_results *out) {
+  if (len < n || max_start == 0) {
+    return;
+  }
+  if (n == 1) {
+    size_t end = len < max_start ? len : max_start;
+    const char *p = hay;
+    while ((p = memchr(p, needle[0], end - (p - hay))) != NULL) {
+      search_results_push(out, base + (p - hay), n);
+      p++;
+    }
+    return;
+  }
+  kernel(hay, len, needle, n, base, max_start, out);
+}
+
+// first byte in [p, end) that is one of bytes, end if there is none. Used to
+// skip runs the caller doesn't care about, num_bytes <= 3
+const char *search_any_byte(const char *p, const char *end,
+                            const uint8_t *bytes, size_t num_bytes) {
+  if (num_bytes == 1) {
+    const char *q = memchr(p, bytes[0], end - p);
+    return q != NULL ? q : end;
+  }
+  uint8_t b2 = num_bytes > 2 ? bytes[2] : bytes[1];
+#ifdef SEARCH_X86
+  const __m128i v0 = _mm_set1_epi8((char)bytes[0]);
+  const __m128i v1 = _mm_set1_epi8((char)bytes[1]);
+  const __m128i v2 = _mm_set1_epi8((char)b2);
+  for (; end - p >= 16; p += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, v0),
+                                  _mm_cmpeq_epi8(block, v1)),
+                     _mm_cmpeq_epi8(block, v2)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; p < end; p++) {
+    uint8_t c = (uint8_t)*p;
+    if (c == bytes[0] || c == bytes[1] || c == b2) {
+      return p;
+    }
+  }
+  return end;
+}
+
+// appends the offset of every match starting in [from, to) to out, returns
+// how many were found. Each piece is scanned in place, only the last n - 1
+// bytes before a piece boundary and the first n - 1 after it are copied, to
+// catch the matches that straddle it
+size_t search_literal(const ptbl_snapshot *snap_p, size_t from, size_t to,
+                      const char *needle, size_t needle_len,
+                      search_results *out) {
+  size_t n = needle_len;
+  size_t found = out->count;
+  if (n == 0 || to <= from) {
+    return 0;
+  }
+  size_t scan_end = to + n - 1 < snap_p->len ? to + n - 1 : snap_p->len;
+  char *window = NULL;
+  if (n > 1) {
+    window = malloc(2 * (n - 1));
+    if (window == NULL) {
+      fprintf(stderr, "Error: search window allocation failed");
+      exit(1);
+    }
+  }
+  size_t tail_len = 0;
+  search_span_fn kernel = search_pick_kernel();
+
+  size_t piece_start = 0;
+  for (size_t i = 0; i < snap_p->num_pieces && piece_start < scan_end;
+       piece_start += snap_p->lens[i++]) {
+    size_t start = from > piece_start ? from : piece_start;
+    size_t end = piece_start + snap_p->lens[i];
+    if (end > scan_end) {
+      end = scan_end;
+    }
+    if (start >= end) {
+      continue;
+    }
+    const char *chars = snap_p->chars[i] + (start - piece_start);
+    size_t len = end - start;
+
+    if (tail_len > 0) {
+      size_t head = len < n - 1 ? len : n - 1;
+      memcpy(window + tail_len, chars, head);
+      search_span(kernel, window, tail_len + head, needle, n, start - tail_len,
+                  tail_len, out);
+    }
+    search_span(kernel, chars, len, needle, n, start, SIZE_MAX, out);
+
+    // keep the last n - 1 bytes seen for the next boundary
+    if (n > 1) {
+      if (len >= n - 1) {
+        memcpy(window, chars + len - (n - 1), n - 1);
+        tail_len = n - 1;
+      } else {
+        size_t keep = tail_len < n - 1 - len ? tail_len : n - 1 - len;
+        memmove(window, window + tail_len - keep, keep);
+        memcpy(window + keep, chars, len);
+        tail_len = keep + len;
+      }
+    }
+  }
+  free(window);
+  return out->count - found;
+}
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/search_index.h"
+
+static void si_tree_build(size_t *tree, const size_t *vals, size_t n) {
+  for (size_t i = 1; i <= n; i++) {
+    tree[i] = vals[i - 1];
+  }
+  for (size_t i = 1; i <= n; i++) {
+    size_t parent = i + (i & (~i + 1));
+    if (parent <= n) {
+      tree[parent] += tree[i];
+    }
+  }
+}
+
+// delta wraps around for decreases, the sums come out right all the same
+static void si_tree_add(size_t *tree, size_t n, size_t i, size_t delta) {
+  for (; i <= n; i += i & (~i + 1)) {
+    tree[i] += delta;
+  }
+}
+
+static size_t si_tree_prefix(const size_t *tree, size_t i) {
+  size_t sum = 0;
+  for (; i > 0; i -= i & (~i + 1)) {
+    sum += tree[i];
+  }
+  return sum;
+}
+
+// largest i with a prefix sum of at most target
+static size_t si_tree_search(const size_t *tree, size_t n, size_t target) {
+  size_t step = 1;
+  while (step * 2 <= n) {
+    step *= 2;
+  }
+  size_t i = 0;
+  for (; step > 0; step /= 2) {
+    if (i + step <= n && tree[i + step] <= target) {
+      i += step;
+      target -= tree[i];
+    }
+  }
+  return i;
+}
+
+// grows the tree by val at n, the new last index
+static void si_tree_push(size_t *tree, size_t n, size_t val) {
+  tree[n] = val + si_tree_prefix(tree, n - 1) -
+            si_tree_prefix(tree, n - (n & (~n + 1)));
+}
+
+static void si_reserve(search_index *si, size_t num_blocks) {
+  if (num_blocks <= si->cap) {
+    return;
+  }
+  size_t cap = si->cap > 0 ? si->cap : 16;
+  while (cap < num_blocks) {
+    cap *= 2;
+  }
+  si->blocks = realloc(si->blocks, cap * sizeof(search_block *));
+  si->gaps = realloc(si->gaps, cap * sizeof(size_t));
+  si->counts = realloc(si->counts, cap * sizeof(size_t));
+  si->gap_tree = realloc(si->gap_tree, (cap + 1) * sizeof(size_t));
+  si->count_tree = realloc(si->count_tree, (cap + 1) * sizeof(size_t));
+  if (si->blocks == NULL || si->gaps == NULL || si->counts == NULL ||
+      si->gap_tree == NULL || si->count_tree == NULL) {
+    fprintf(stderr, "Error: search index allocation failed");
+    exit(1);
+  }
+  si->cap = cap;
+}
+
+static search_block *si_block_alloc(void) {
+  search_block *block = malloc(sizeof(search_block));
+  if (block == NULL) {
+    fprintf(stderr, "Error: search block allocation failed");
+    exit(1);
+  }
+  return block;
+}
+
+void search_index_free(search_index *si) {
+  for (size_t b = 0; b < si->num_blocks; b++) {
+    free(si->blocks[b]);
+  }
+  free(si->blocks);
+  free(si->gaps);
+  free(si->counts);
+  free(si->gap_tree);
+  free(si->count_tree);
+  *si = (search_index){0};
+}
+
+static size_t si_anchor(search_index *si, size_t b) {
+  return si_tree_prefix(si->gap_tree, b + 1);
+}
+
+// block holding match i, i < count
+static size_t si_block_of(search_index *si, size_t i) {
+  return si_tree_search(si->count_tree, si->num_blocks, i);
+}
+
+static void si_push(search_index *si, size_t offset, size_t len) {
+  size_t n = si->num_blocks;
+  size_t anchor = n > 0 ? si_anchor(si, n - 1) : 0;
+  if (n == 0 || si->counts[n - 1] == SEARCH_INDEX_BLOCK) {
+    si_reserve(si, n + 1);
+    si->blocks[n] = si_block_alloc();
+    si->gaps[n] = offset - anchor;
+    si->counts[n] = 0;
+    si->num_blocks = ++n;
+    si_tree_push(si->gap_tree, n, si->gaps[n - 1]);
+    si_tree_push(si->count_tree, n, 0);
+    anchor = offset;
+  }
+  search_block *block = si->blocks[n - 1];
+  block->offsets[si->counts[n - 1]] = offset - anchor;
+  block->lens[si->counts[n - 1]++] = len;
+  si_tree_add(si->count_tree, n, n, 1);
+  si->count++;
+}
+
+// adds matches after the last one indexed
+void search_index_append(search_index *si, const search_results *sr) {
+  for (size_t i = 0; i < sr->count; i++) {
+    si_push(si, sr->offsets[i], sr->lens[i]);
+  }
+}
+
+// index of the first match starting at or after pos
+size_t search_index_lower_bound(search_index *si, size_t pos) {
+  size_t before = si_tree_search(si->gap_tree, si->num_blocks, pos);
+  if (before == 0) {
+    return 0;
+  }
+  size_t b = before - 1; // last block anchored at or before pos
+  const search_block *block = si->blocks[b];
+  size_t rel = pos - si_anchor(si, b);
+  size_t lo = 0;
+  size_t hi = si->counts[b];
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (block->offsets[mid] < rel) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return si_tree_prefix(si->count_tree, b) + lo;
+}
+
+void search_index_get(search_index *si, size_t i, size_t *offset_p,
+                      size_t *len_p) {
+  size_t b = si_block_of(si, i);
+  size_t j = i - si_tree_prefix(si->count_tree, b);
+  *offset_p = si_anchor(si, b) + si->blocks[b]->offsets[j];
+  *len_p = si->blocks[b]->lens[j];
+}
+
+// appends every match to out in order, O(n)
+void search_index_copy(search_index *si, search_results *out) {
+  size_t anchor = 0;
+  for (size_t b = 0; b < si->num_blocks; b++) {
+    anchor += si->gaps[b];
+    for (size_t j = 0; j < si->counts[b]; j++) {
+      search_results_push(out, anchor + si->blocks[b]->offsets[j],
+                          si->blocks[b]->lens[j]);
+    }
+  }
+}
+
+// replaces the matches starting in [lo, hi_old) with found and moves those
+// after it to start hi_new - hi_old further on. Only the blocks around the
+// range are rewritten, the blocks after it move with the gap before them
+static void si_splice(search_index *si, size_t lo, size_t hi_old,
+                      size_t hi_new, const search_results *found) {
+  if (si->count == 0) {
+    search_index_append(si, found);
+    return;
+  }
+  size_t i0 = search_index_lower_bound(si, lo);
+  size_t i1 = search_index_lower_bound(si, hi_old);
+  size_t b0 = si_block_of(si, i0 < si->count ? i0 : si->count - 1);
+  size_t b1 = si_block_of(si, i1 < si->count ? i1 : si->count - 1);
+  size_t prev_anchor = b0 > 0 ? si_anchor(si, b0 - 1) : 0;
+  bool has_next = b1 + 1 < si->num_blocks;
+  size_t next_anchor =
+      has_next ? si_anchor(si, b1 + 1) - hi_old + hi_new : 0;
+
+  // every match of the blocks in the range, as they end up
+  search_results all = {0};
+  size_t first_anchor = si_anchor(si, b0);
+  size_t anchor = first_anchor;
+  for (size_t b = b0; b <= b1; anchor += b < b1 ? si->gaps[b + 1] : 0, b++) {
+    for (size_t j = 0; j < si->counts[b]; j++) {
+      size_t offset = anchor + si->blocks[b]->offsets[j];
+      if (offset < lo) {
+        search_results_push(&all, offset, si->blocks[b]->lens[j]);
+      }
+    }
+  }
+  for (size_t i = 0; i < found->count; i++) {
+    search_results_push(&all, found->offsets[i], found->lens[i]);
+  }
+  anchor = first_anchor;
+  for (size_t b = b0; b <= b1; anchor += b < b1 ? si->gaps[b + 1] : 0, b++) {
+    for (size_t j = 0; j < si->counts[b]; j++) {
+      size_t offset = anchor + si->blocks[b]->offsets[j];
+      if (offset >= hi_old) {
+        search_results_push(&all, offset - hi_old + hi_new,
+                            si->blocks[b]->lens[j]);
+      }
+    }
+  }
+
+  // spread them over as many blocks as before if they still fill them
+  size_t k = b1 - b0 + 1;
+  size_t n = all.count;
+  size_t m = (n + SEARCH_INDEX_BLOCK - 1) / SEARCH_INDEX_BLOCK;
+  if (m < k && n >= k) {
+    m = k;
+  }
+  if (m != k) {
+    for (size_t b = b0 + m; b < b0 + k; b++) {
+      free(si->blocks[b]);
+    }
+    size_t num_blocks = si->num_blocks - k + m;
+    si_reserve(si, num_blocks);
+    size_t tail = si->num_blocks - b1 - 1;
+    memmove(si->blocks + b0 + m, si->blocks + b1 + 1,
+            tail * sizeof(search_block *));
+    memmove(si->gaps + b0 + m, si->gaps + b1 + 1, tail * sizeof(size_t));
+    memmove(si->counts + b0 + m, si->counts + b1 + 1, tail * sizeof(size_t));
+    for (size_t b = b0 + k; b < b0 + m; b++) {
+      si->blocks[b] = si_block_alloc();
+    }
+    si->num_blocks = num_blocks;
+  }
+  size_t last_anchor = prev_anchor;
+  for (size_t j = 0; j < m; j++) {
+    size_t first = j * n / m;
+    size_t end = (j + 1) * n / m;
+    size_t b = b0 + j;
+    search_block *block = si->blocks[b];
+    for (size_t i = first; i < end; i++) {
+      block->offsets[i - first] = all.offsets[i] - all.offsets[first];
+      block->lens[i - first] = all.lens[i];
+    }
+    size_t gap = all.offsets[first] - last_anchor;
+    if (m == k) {
+      si_tree_add(si->gap_tree, si->num_blocks, b + 1, gap - si->gaps[b]);
+      si_tree_add(si->count_tree, si->num_blocks, b + 1,
+                  (end - first) - si->counts[b]);
+    }
+    si->gaps[b] = gap;
+    si->counts[b] = end - first;
+    last_anchor = all.offsets[first];
+  }
+  if (has_next) {
+    size_t b = b0 + m;
+    size_t gap = next_anchor - last_anchor;
+    if (m == k) {
+      si_tree_add(si->gap_tree, si->num_blocks, b + 1, gap - si->gaps[b]);
+    }
+    si->gaps[b] = gap;
+  }
+  if (m != k) {
+    // blocks came or went, rebuild the trees in O(blocks)
+    si_tree_build(si->gap_tree, si->gaps, si->num_blocks);
+    si_tree_build(si->count_tree, si->counts, si->num_blocks);
+  }
+  si->count = si->count - (i1 - i0) + found->count;
+  search_results_free(&all);
+}
+
+// updates the matches of the query after [start, start + removed) of the
+// text was replaced by [start, start + inserted), snap_p is the text after
+// the edit. A literal is looked for again only where it could overlap the
+// edit. A regex is searched again SEARCH_INDEX_CONTEXT bytes either side of
+// it and past that until it finds the matches from before the edit again,
+// matches depending on text further away than that are taken to be the same
+void search_index_update(search_index *si, const ptbl_snapshot *snap_p,
+                         size_t start, size_t removed, size_t inserted,
+                         const char *query, size_t query_len, rx_regex *rx) {
+  search_results found = {0};
+  if (rx == NULL) {
+    size_t back = query_len > 0 ? query_len - 1 : 0;
+    size_t lo = start > back ? start - back : 0;
+    search_literal(snap_p, lo, start + inserted, query, query_len, &found);
+    si_splice(si, lo, start + removed, start + inserted, &found);
+    search_results_free(&found);
+    return;
+  }
+
+  // widen the range to matches straddling its ends
+  size_t offset, len;
+  size_t lo = start > SEARCH_INDEX_CONTEXT ? start - SEARCH_INDEX_CONTEXT : 0;
+  size_t i = search_index_lower_bound(si, lo);
+  if (i > 0) {
+    search_index_get(si, i - 1, &offset, &len);
+    lo = offset + len > lo ? offset : lo;
+  }
+  size_t hi_old = start + removed + SEARCH_INDEX_CONTEXT;
+  i = search_index_lower_bound(si, hi_old);
+  if (i > 0) {
+    search_index_get(si, i - 1, &offset, &len);
+    hi_old = offset + len > hi_old ? offset + len : hi_old;
+  }
+  size_t hi_new = hi_old - removed + inserted;
+  if (hi_new > snap_p->len) {
+    hi_old -= hi_new - snap_p->len;
+    hi_new = snap_p->len;
+  }
+  rx_search(rx, snap_p, lo, hi_new, &found);
+  si_splice(si, lo, hi_old, hi_new, &found);
+
+  // a match running past the range hides the matches after it that start
+  // inside it, search on until a match agrees with one from before the edit
+  size_t pos = found.count > 0
+                   ? found.offsets[found.count - 1] + found.lens[found.count - 1]
+                   : 0;
+  if (pos <= hi_new) {
+    search_results_free(&found);
+    return;
+  }
+  found.count = 0;
+  size_t sync;
+  for (;;) {
+    i = search_index_lower_bound(si, pos);
+    bool has_next = i < si->count;
+    if (has_next) {
+      search_index_get(si, i, &offset, &len);
+    }
+    size_t until = has_next ? offset + 1 : snap_p->len;
+    size_t before = found.count;
+    rx_search(rx, snap_p, pos, until, &found);
+    if (found.count == before) {
+      sync = has_next ? offset : snap_p->len;
+      break;
+    }
+    size_t last = found.count - 1;
+    if (has_next && found.offsets[last] == offset) {
+      found.count--;
+      sync = offset;
+      break;
+    }
+    pos = found.offsets[last] + found.lens[last];
+  }
+  si_splice(si, hi_new, sync, sync, &found);
+  search_results_free(&found);
+}
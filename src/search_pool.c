@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/rx.h"
+#include "../include/search_pool.h"
+
+static void sp_append(search_results *to, const search_results *from,
+                      size_t first) {
+  for (size_t i = first; i < from->count; i++) {
+    search_results_push(to, from->offsets[i], from->lens[i]);
+  }
+}
+
+// a regex match running out of the previous range hides the matches of this
+// one that start inside it, and the matches after it may line up
+// differently. Search again from where it ends until a match agrees with
+// the range's own results, from there on they are the same
+static void sp_stitch(rx_regex *rx, const ptbl_snapshot *snap_p,
+                      size_t prev_end, size_t to, search_results *r) {
+  search_results fixed = {0};
+  size_t pos = prev_end;
+  size_t k = 0;
+  while (pos < to) {
+    while (k < r->count && r->offsets[k] < pos) {
+      k++;
+    }
+    size_t until = k < r->count ? r->offsets[k] + 1 : to;
+    size_t before = fixed.count;
+    rx_search(rx, snap_p, pos, until, &fixed);
+    if (fixed.count == before) {
+      break;
+    }
+    size_t last = fixed.count - 1;
+    if (k < r->count && fixed.offsets[last] == r->offsets[k]) {
+      sp_append(&fixed, r, k + 1);
+      break;
+    }
+    pos = fixed.offsets[last] + fixed.lens[last];
+  }
+  search_results_free(r);
+  *r = fixed;
+}
+
+static void sp_range_bounds(search_pool *sp, size_t i, size_t *from_p,
+                            size_t *to_p) {
+  *from_p = i * SEARCH_RANGE_BYTES;
+  *to_p = *from_p + SEARCH_RANGE_BYTES < sp->snap_p->snap.len
+              ? *from_p + SEARCH_RANGE_BYTES
+              : sp->snap_p->snap.len;
+}
+
+// merges the finished ranges that are next in document order, called with
+// the lock held by the worker that finished a range. Only one worker merges
+// at a time, the others leave their ranges to it
+static void sp_publish(search_pool *sp, rx_regex *rx) {
+  if (sp->merging) {
+    return;
+  }
+  sp->merging = true;
+  size_t generation = sp->generation;
+  while (sp->published < sp->num_ranges && sp->ranges[sp->published].done) {
+    size_t i = sp->published;
+    search_results r = sp->ranges[i].results;
+    sp->ranges[i].results = (search_results){0};
+    size_t from, to;
+    sp_range_bounds(sp, i, &from, &to);
+    if (sp->regex && sp->prev_end > from && rx != NULL) {
+      size_t prev_end = sp->prev_end;
+      const ptbl_snapshot *snap_p = &sp->snap_p->snap;
+      pthread_mutex_unlock(&sp->lock);
+      sp_stitch(rx, snap_p, prev_end, to, &r);
+      pthread_mutex_lock(&sp->lock);
+      if (generation != sp->generation) {
+        search_results_free(&r);
+        return; // merging belongs to the new search now
+      }
+    }
+    sp_append(&sp->results, &r, 0);
+    if (r.count > 0 && r.offsets[r.count - 1] + r.lens[r.count - 1] >
+                           sp->prev_end) {
+      sp->prev_end = r.offsets[r.count - 1] + r.lens[r.count - 1];
+    }
+    search_results_free(&r);
+    sp->published++;
+  }
+  sp->merging = false;
+}
+
+// drops a worker's hold on a snapshot, the last user of a retired one
+// releases it. Called and returns with the lock held
+static void sp_unuse(search_pool *sp, search_snapshot *snap) {
+  snap->users--;
+  if (!snap->retired || snap->users > 0) {
+    return;
+  }
+  pthread_mutex_unlock(&sp->lock);
+  pthread_mutex_lock(sp->table_lock);
+  ptbl_snapshot_release(sp->ptbl_p, &snap->snap);
+  pthread_mutex_unlock(sp->table_lock);
+  free(snap);
+  pthread_mutex_lock(&sp->lock);
+}
+
+static void *sp_worker(void *arg) {
+  search_pool *sp = (search_pool *)arg;
+  rx_regex *rx = NULL; // every worker runs its own DFA caches
+  size_t rx_generation = SIZE_MAX;
+  char *needle = NULL;
+  size_t needle_len = 0;
+
+  pthread_mutex_lock(&sp->lock);
+  while (!sp->quit) {
+    if (sp->snap_p == NULL || sp->next_range == sp->num_ranges) {
+      pthread_cond_wait(&sp->wake, &sp->lock);
+      continue;
+    }
+    size_t generation = sp->generation;
+    size_t i = sp->next_range++;
+    search_snapshot *snap = sp->snap_p;
+    snap->users++;
+    bool regex = sp->regex;
+    if (rx_generation != generation) {
+      rx_free(rx);
+      rx = NULL;
+      if (regex) {
+        const char *error;
+        rx = rx_compile(sp->query, sp->query_len, 0, &error);
+      }
+      free(needle);
+      needle = malloc(sp->query_len);
+      if (needle == NULL) {
+        fprintf(stderr, "Error: search query allocation failed");
+        exit(1);
+      }
+      memcpy(needle, sp->query, sp->query_len);
+      needle_len = sp->query_len;
+      rx_generation = generation;
+    }
+    size_t from, to;
+    sp_range_bounds(sp, i, &from, &to);
+    pthread_mutex_unlock(&sp->lock);
+
+    search_results found = {0};
+    if (!regex) {
+      search_literal(&snap->snap, from, to, needle, needle_len, &found);
+    } else if (rx != NULL) {
+      rx_search(rx, &snap->snap, from, to, &found);
+    }
+
+    pthread_mutex_lock(&sp->lock);
+    if (generation == sp->generation) {
+      sp->ranges[i].results = found;
+      sp->ranges[i].done = true;
+      sp_publish(sp, rx);
+    } else {
+      search_results_free(&found); // cancelled
+    }
+    sp_unuse(sp, snap);
+  }
+  pthread_mutex_unlock(&sp->lock);
+  rx_free(rx);
+  free(needle);
+  return NULL;
+}
+
+void search_pool_start(search_pool *sp, piece_table *ptbl_p,
+                       pthread_mutex_t *table_lock) {
+  *sp = (search_pool){.ptbl_p = ptbl_p, .table_lock = table_lock};
+  pthread_mutex_init(&sp->lock, NULL);
+  pthread_cond_init(&sp->wake, NULL);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  sp->num_threads = cpus < 1 ? 1 : (size_t)cpus;
+  sp->num_threads = sp->num_threads > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS
+                                                         : sp->num_threads;
+  for (size_t i = 0; i < sp->num_threads; i++) {
+    if (pthread_create(&sp->threads[i], NULL, sp_worker, sp) != 0) {
+      fprintf(stderr, "Error: search thread creation failed");
+      exit(1);
+    }
+  }
+}
+
+// ends the search running, if any. Called with both locks held
+static void sp_clear(search_pool *sp) {
+  sp->generation++;
+  if (sp->snap_p != NULL) {
+    if (sp->snap_p->users == 0) {
+      ptbl_snapshot_release(sp->ptbl_p, &sp->snap_p->snap);
+      free(sp->snap_p);
+    } else {
+      sp->snap_p->retired = true;
+    }
+    sp->snap_p = NULL;
+  }
+  for (size_t i = 0; i < sp->num_ranges; i++) {
+    search_results_free(&sp->ranges[i].results);
+  }
+  free(sp->ranges);
+  sp->ranges = NULL;
+  sp->num_ranges = 0;
+  sp->next_range = 0;
+  sp->published = 0;
+  sp->prev_end = 0;
+  sp->merging = false;
+  sp->results.count = 0;
+}
+
+// the caller must not hold the table lock
+void search_pool_stop(search_pool *sp) {
+  pthread_mutex_lock(&sp->lock);
+  sp->quit = true;
+  pthread_cond_broadcast(&sp->wake);
+  pthread_mutex_unlock(&sp->lock);
+  for (size_t i = 0; i < sp->num_threads; i++) {
+    pthread_join(sp->threads[i], NULL);
+  }
+
+  pthread_mutex_lock(sp->table_lock);
+  sp_clear(sp);
+  pthread_mutex_unlock(sp->table_lock);
+  pthread_mutex_destroy(&sp->lock);
+  pthread_cond_destroy(&sp->wake);
+  search_results_free(&sp->results);
+  free(sp->query);
+}
+
+// starts searching the table for query, cancelling the search before it.
+// Returns why a pattern doesn't compile, NULL if it does. Tables smaller
+// than SEARCH_PARALLEL_MIN_BYTES are searched before this returns. The
+// caller holds the table lock
+const char *search_pool_submit(search_pool *sp, const char *query,
+                               size_t query_len, bool regex) {
+  const char *error = NULL;
+  rx_regex *rx = NULL;
+  if (regex) {
+    rx = rx_compile(query, query_len, 0, &error);
+    if (rx == NULL) {
+      search_pool_cancel(sp);
+      return error;
+    }
+  }
+
+  pthread_mutex_lock(&sp->lock);
+  sp_clear(sp);
+  size_t len = ptbl_length(sp->ptbl_p);
+  if (len < SEARCH_PARALLEL_MIN_BYTES || query_len == 0) {
+    ptbl_snapshot snap;
+    ptbl_snapshot_take(sp->ptbl_p, &snap);
+    if (rx != NULL) {
+      rx_search(rx, &snap, 0, snap.len, &sp->results);
+    } else {
+      search_literal(&snap, 0, snap.len, query, query_len, &sp->results);
+    }
+    ptbl_snapshot_release(sp->ptbl_p, &snap);
+    pthread_mutex_unlock(&sp->lock);
+    rx_free(rx);
+    return NULL;
+  }
+  rx_free(rx);
+
+  char *copy = realloc(sp->query, query_len);
+  sp->snap_p = calloc(1, sizeof(search_snapshot));
+  sp->num_ranges = (len + SEARCH_RANGE_BYTES - 1) / SEARCH_RANGE_BYTES;
+  sp->ranges = calloc(sp->num_ranges, sizeof(search_range));
+  if (copy == NULL || sp->snap_p == NULL || sp->ranges == NULL) {
+    fprintf(stderr, "Error: search allocation failed");
+    exit(1);
+  }
+  memcpy(copy, query, query_len);
+  sp->query = copy;
+  sp->query_len = query_len;
+  sp->regex = regex;
+  ptbl_snapshot_take(sp->ptbl_p, &sp->snap_p->snap);
+  pthread_cond_broadcast(&sp->wake);
+  pthread_mutex_unlock(&sp->lock);
+  return NULL;
+}
+
+// stops the search running, the caller holds the table lock
+void search_pool_cancel(search_pool *sp) {
+  pthread_mutex_lock(&sp->lock);
+  sp_clear(sp);
+  pthread_mutex_unlock(&sp->lock);
+}
+
+// appends the matches merged after the first *taken_p to out and counts
+// them in, *taken_p starts at 0 for every search. Returns whether the search
+// is still running
+bool search_pool_poll(search_pool *sp, size_t *taken_p, search_results *out) {
+  pthread_mutex_lock(&sp->lock);
+  sp_append(out, &sp->results, *taken_p);
+  *taken_p = sp->results.count > *taken_p ? sp->results.count : *taken_p;
+  bool running = sp->published < sp->num_ranges;
+  pthread_mutex_unlock(&sp->lock);
+  return running;
+}
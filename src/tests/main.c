@@ -1,8 +1,20 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
+#include "../../include/file_loader.h"
+#include "../../include/file_view.h"
+#include "../../include/highlight.h"
+#include "../../include/line_scan.h"
 #include "../../include/piece_table.h"
+#include "../../include/rx.h"
+#include "../../include/search.h"
+#include "../../include/search_index.h"
+#include "../../include/search_pool.h"
+#include "../../include/wrap_index.h"
 
 int main(int argc, char *argv[]) {
   if (argc != 2) {
@@ -77,6 +89,431 @@ int main(int argc, char *argv[]) {
   printf("---------------------\n");
   ptbl_display(&ptbl);
 
+  // select across several pieces, copy it out, indent it, then delete it
+  ptbl_update_global_cursor_pos(&ptbl, 3);
+  ptbl_start_selection(&ptbl);
+  ptbl_update_global_cursor_pos(&ptbl, 40);
+  size_t sel_start, sel_end;
+  ptbl_selection_range(&ptbl, &sel_start, &sel_end);
+  char *copied = malloc(sel_end - sel_start);
+  size_t copied_len =
+      ptbl_copy_range(&ptbl, sel_start, sel_end - sel_start, copied);
+  printf("---------------------\n");
+  printf("%.*s\n", (int)copied_len, copied);
+  free(copied);
+
+  ptbl_indent_selection(&ptbl, '\t');
+  printf("---------------------\n");
+  ptbl_display(&ptbl);
+
+  ptbl_delete_selection(&ptbl);
+  printf("---------------------\n");
+  ptbl_display(&ptbl);
+
+  ptbl_insert_text(&ptbl, "pasted\ntext", 11);
+  printf("---------------------\n");
+  ptbl_display(&ptbl);
+
+  // codepoint counts are kept per piece through splits and deletes
+  ptbl_update_global_cursor_pos(&ptbl, 5);
+  char *utf8_text = "h\xc3\xa9llo \xe4\xb8\x96\xe7\x95\x8c!";
+  ptbl_insert_text(&ptbl, utf8_text, strlen(utf8_text));
+  ptbl_delete_range(&ptbl, 12, 3);
+  size_t total_len = ptbl_length(&ptbl);
+  printf("---------------------\n");
+  ptbl_display(&ptbl);
+  printf("%zu bytes, %zu codepoints, codepoint 11 at byte %zu\n", total_len,
+         ptbl_codepoint_index(&ptbl, total_len), ptbl_codepoint_pos(&ptbl, 11));
+
+  // with no window loaded the cursor steps and backspaces whole clusters in a
+  // span copied from the table
+  piece_table step_ptbl = create_piece_table("h\xc3\xa9\n\xe4\xb8\x96", 7);
+  size_t after_e = ptbl_grapheme_step(&step_ptbl, 1, 1);
+  size_t before_e = ptbl_grapheme_step(&step_ptbl, 3, -1);
+  size_t past_break = ptbl_grapheme_step(&step_ptbl, 3, 1);
+  size_t back_over_break = ptbl_grapheme_step(&step_ptbl, 4, -1);
+  ptbl_delete_range(&step_ptbl, before_e, 3 - before_e);
+  char stepped[8];
+  size_t stepped_len = ptbl_copy_range(&step_ptbl, 0, ptbl_length(&step_ptbl),
+                                       stepped);
+  printf("over \xc3\xa9 to %zu and back to %zu, over the break to %zu and "
+         "back to %zu, backspaced %zu bytes left\n",
+         after_e, before_e, past_break, back_over_break, stepped_len);
+  free_piece_table(&step_ptbl);
+
+  // wrap at 16 columns, then splice an edit in and map rows back to lines
+  wrap_index wrap = {0};
+  size_t edit_start, edit_removed, edit_inserted;
+  wrap_index_build(&wrap, &ptbl, 16, 0);
+  ptbl_take_edit(&ptbl, &edit_start, &edit_removed, &edit_inserted);
+  ptbl_update_global_cursor_pos(&ptbl, 0);
+  ptbl_insert_text(&ptbl, "a long enough line to wrap\n", 27);
+  ptbl_take_edit(&ptbl, &edit_start, &edit_removed, &edit_inserted);
+  wrap_index_splice(&wrap, &ptbl, edit_start, edit_removed, edit_inserted);
+  printf("---------------------\n");
+  printf("%zu lines, %zu rows\n", wrap.num_lines, wrap_index_total_rows(&wrap));
+  for (size_t line = 1; line <= wrap.num_lines; line++) {
+    size_t sub_row;
+    size_t row = wrap_index_row_of_line(&wrap, line);
+    printf("line %zu: %zu rows from row %zu, line %zu at that row, "
+           "starts at %zu\n",
+           line, wrap_index_rows(&wrap, line), row,
+           wrap_index_line_at_row(&wrap, row, &sub_row),
+           wrap_index_line_start(&wrap, line));
+  }
+  wrap_index_free(&wrap);
+
+  // styles of a line of C. A 100k line file is lexed by the worker, then an
+  // edit only re-lexes until the line states agree with the cache again
+  const hl_language *c_lang = hl_language_by_name("c");
+  const char *c_line = "static int x = 42; /* note */ return \"s\";";
+  uint8_t c_styles[64];
+  hl_lex(c_lang, hl_initial_state(c_lang), c_line, strlen(c_line), c_styles);
+  printf("---------------------\n%s\n", c_line);
+  for (size_t i = 0; i < strlen(c_line); i++) {
+    printf("%x", c_styles[i]);
+  }
+  printf("\n");
+
+  const char *c_src = "int f(void) { /* lines */\n  return 1;\n}\n";
+  size_t c_src_len = strlen(c_src);
+  size_t big_len = c_src_len * 33334;
+  char *big = malloc(big_len);
+  for (size_t i = 0; i < 33334; i++) {
+    memcpy(big + i * c_src_len, c_src, c_src_len);
+  }
+  piece_table big_ptbl = create_piece_table(big, big_len);
+  pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+  highlighter hl;
+  highlight_worker hl_worker;
+  highlight_init(&hl, c_lang);
+  highlight_worker_start(&hl_worker, &big_ptbl, &table_lock, c_lang);
+  wrap_index_build(&wrap, &big_ptbl, 80, 0);
+  highlight_reset(&hl, wrap.num_lines);
+  while (hl.valid < hl.num_lines) {
+    pthread_mutex_lock(&table_lock);
+    highlight_update(&hl, &hl_worker, &big_ptbl, &wrap);
+    pthread_mutex_unlock(&table_lock);
+    usleep(1000);
+  }
+  printf("worker lexed %zu lines\n", hl.valid);
+  size_t full_lex = hl.lexed;
+  ptbl_update_global_cursor_pos(&big_ptbl, c_src_len * 500 + 5);
+  ptbl_insert_text(&big_ptbl, "a", 1);
+  ptbl_take_edit(&big_ptbl, &edit_start, &edit_removed, &edit_inserted);
+  wrap_index_splice(&wrap, &big_ptbl, edit_start, edit_removed, edit_inserted);
+  highlight_splice(&hl, &big_ptbl, &wrap, edit_start, edit_removed,
+                   edit_inserted);
+  printf("%zu lines lexed again after typing\n", hl.lexed - full_lex);
+  ptbl_update_global_cursor_pos(&big_ptbl, c_src_len * 500);
+  ptbl_insert_text(&big_ptbl, "/*", 2);
+  ptbl_take_edit(&big_ptbl, &edit_start, &edit_removed, &edit_inserted);
+  wrap_index_splice(&wrap, &big_ptbl, edit_start, edit_removed, edit_inserted);
+  highlight_splice(&hl, &big_ptbl, &wrap, edit_start, edit_removed,
+                   edit_inserted);
+  printf("%zu again after opening a comment\n", hl.lexed - full_lex);
+  // a window deep in the table is found by skipping line breaks in blocks
+  render_buffers deep_bufs;
+  load_ptbl_data(&big_ptbl, &deep_bufs, 90001, 0, 3);
+  printf("line 90001 at byte %zu (wrap index %zu), %zu lines read, cursor "
+         "on line %zu col %zu\n",
+         deep_bufs.first_line_pos, wrap_index_line_start(&wrap, 90001),
+         deep_bufs.total_lines, deep_bufs.cursor_line,
+         deep_bufs.cursor_offset);
+  // or seeks to where the wrap index has the line, a wrong byte is scanned
+  // past instead
+  render_buffers *seek_bufs = malloc(2 * sizeof(render_buffers));
+  load_ptbl_data(&big_ptbl, &seek_bufs[0], 90001,
+                 wrap_index_line_start(&wrap, 90001), 3);
+  load_ptbl_data(&big_ptbl, &seek_bufs[1], 90001,
+                 wrap_index_line_start(&wrap, 90001) + 1, 3);
+  printf("seeked window %s, misplaced seek %s\n",
+         seek_bufs[0].edit_text_len == deep_bufs.edit_text_len &&
+                 memcmp(seek_bufs[0].edit_text_buf, deep_bufs.edit_text_buf,
+                        deep_bufs.edit_text_len) == 0
+             ? "matches"
+             : "differs",
+         seek_bufs[1].first_line_pos == deep_bufs.first_line_pos
+             ? "scanned"
+             : "trusted");
+  free(seek_bufs);
+  printf("line_scan counts %zu line breaks in the original buffer\n",
+         line_scan_count(big, big_len));
+
+  // a file is handed to an empty table a chunk at a time as it is read, the
+  // wrap index follows each chunk like an edit
+  char load_path[] = "/tmp/rippope_load_XXXXXX";
+  int load_fd = mkstemp(load_path);
+  if (load_fd < 0 || write(load_fd, big, big_len) != (ssize_t)big_len) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(load_fd);
+  file_loader fl;
+  file_loader_start(&fl, load_path, false);
+  piece_table load_ptbl = create_piece_table(NULL, 0);
+  wrap_index load_wrap = {0};
+  wrap_index_build(&load_wrap, &load_ptbl, 80, fl.len);
+  size_t chunks = 0;
+  size_t load_pos;
+  while (file_loader_busy(&fl)) {
+    if (file_loader_take(&fl, &load_ptbl, &load_pos)) {
+      chunks++;
+      ptbl_take_edit(&load_ptbl, &edit_start, &edit_removed, &edit_inserted);
+      wrap_index_splice(&load_wrap, &load_ptbl, edit_start, edit_removed,
+                        edit_inserted);
+    }
+    usleep(100);
+  }
+  printf("loaded %zu bytes (%s) in %zu chunks, %zu lines, line 90001 at byte "
+         "%zu\n",
+         ptbl_length(&load_ptbl), file_encoding_name(fl.encoding), chunks,
+         load_wrap.num_lines, wrap_index_line_start(&load_wrap, 90001));
+  file_loader_stop(&fl);
+  munmap(fl.buf, fl.len);
+  // the same file viewed through a one page cache, reads that miss it and
+  // find past the window read the file directly
+  file_view fv;
+  file_view_open(&fv, load_path, VIEW_PAGE_BYTES);
+  char view_buf[4096];
+  size_t view_bad = 0;
+  for (size_t i = 0, at = 12345; i < 64; i++, at = (at * 7919 + 4093) % big_len) {
+    size_t got = file_view_read(&fv, at, sizeof(view_buf), view_buf, i % 2);
+    view_bad += got == 0 || memcmp(view_buf, big + at, got) != 0;
+  }
+  size_t view_cps;
+  char *view_win = file_view_window(&fv, big_len / 2, &view_cps);
+  size_t ahead_start, ahead_len, behind_start, behind_len, view_stop;
+  file_view_find(&fv, 1000000, true, "return", 6, NULL, &ahead_start,
+                 &ahead_len, &view_stop);
+  file_view_find(&fv, 1000000, false, "return", 6, NULL, &behind_start,
+                 &behind_len, &view_stop);
+  printf("viewed %zu bytes, %zu bad reads, %zu hits %zu misses, window %zu+%zu "
+         "(%zu codepoints), return at %zu and %zu\n",
+         fv.len, view_bad, fv.hits, fv.misses, fv.win_start, fv.win_len,
+         view_cps, ahead_start, behind_start);
+  free(view_win);
+  file_view_close(&fv);
+
+  // a followed file keeps growing into the table, appends show up as new
+  // chunks at the end and following stops once the file is truncated
+  file_loader follow;
+  file_loader_start(&follow, load_path, true);
+  piece_table follow_ptbl = create_piece_table(NULL, 0);
+  wrap_index follow_wrap = {0};
+  wrap_index_build(&follow_wrap, &follow_ptbl, 80, follow.len);
+  int append_fd = open(load_path, O_WRONLY | O_APPEND);
+  size_t appended = 0;
+  size_t follow_chunks = 0;
+  for (int i = 0; i < 20000 && ptbl_length(&follow_ptbl) < big_len + 400000;
+       i++) {
+    if (ptbl_length(&follow_ptbl) >= big_len && appended < 400000) {
+      appended += write(append_fd, c_src, c_src_len) > 0 ? c_src_len : 0;
+    }
+    if (file_loader_take(&follow, &follow_ptbl, &load_pos)) {
+      follow_chunks++;
+      ptbl_take_edit(&follow_ptbl, &edit_start, &edit_removed, &edit_inserted);
+      wrap_index_splice(&follow_wrap, &follow_ptbl, edit_start, edit_removed,
+                        edit_inserted);
+    }
+    usleep(appended < 400000 ? 0 : 1000);
+  }
+  size_t followed_len = ptbl_length(&follow_ptbl);
+  size_t followed_lines = follow_wrap.num_lines;
+  if (ftruncate(append_fd, 0) != 0) {
+    perror("ftruncate");
+  }
+  for (int i = 0; i < 2000 && file_loader_busy(&follow); i++) {
+    file_loader_take(&follow, &follow_ptbl, &load_pos);
+    usleep(1000);
+  }
+  printf("followed %zu bytes in %s chunks, %zu lines, %s after truncation\n",
+         followed_len, follow_chunks > 1 ? "several" : "one", followed_lines,
+         file_loader_busy(&follow) ? "still following" : "stopped");
+  close(append_fd);
+  file_loader_stop(&follow);
+  munmap(follow.buf, LOADER_FOLLOW_RESERVE_BYTES);
+  wrap_index_free(&follow_wrap);
+  free_piece_table(&follow_ptbl);
+  unlink(load_path);
+  wrap_index_free(&load_wrap);
+  free_piece_table(&load_ptbl);
+  highlight_worker_stop(&hl_worker);
+  highlight_free(&hl);
+  wrap_index_free(&wrap);
+  free_piece_table(&big_ptbl);
+  free(big);
+
+  // past WRAP_SPARSE_MIN_BYTES only a checkpoint every few hundred lines is
+  // kept, lines in between are measured again when asked about
+  size_t huge_len = (WRAP_SPARSE_MIN_BYTES / c_src_len + 1) * c_src_len;
+  char *huge = malloc(huge_len);
+  for (size_t i = 0; i < huge_len / c_src_len; i++) {
+    memcpy(huge + i * c_src_len, c_src, c_src_len);
+  }
+  piece_table huge_ptbl = create_piece_table(huge, huge_len);
+  wrap_index_build(&wrap, &huge_ptbl, 80, 0);
+  size_t goto_line = wrap.num_lines / 2 + 1;
+  size_t goto_pos = wrap_index_line_start(&wrap, goto_line);
+  printf("sparse %d: %zu lines in %zu checkpoints, line %zu at byte %zu\n",
+         wrap.sparse, wrap.num_lines, wrap.num_entries, goto_line, goto_pos);
+  ptbl_update_global_cursor_pos(&huge_ptbl, goto_pos);
+  ptbl_insert_text(&huge_ptbl, "\n\n", 2);
+  ptbl_take_edit(&huge_ptbl, &edit_start, &edit_removed, &edit_inserted);
+  wrap_index_splice(&wrap, &huge_ptbl, edit_start, edit_removed,
+                    edit_inserted);
+  printf("%zu lines after two line breaks, byte %zu is on line %zu\n",
+         wrap.num_lines, goto_pos + 2,
+         wrap_index_line_of_pos(&wrap, goto_pos + 2));
+  wrap_index_free(&wrap);
+  free_piece_table(&huge_ptbl);
+  free(huge);
+
+  // a match split over inserted pieces is found without joining the text
+  char *hay = strdup("find the needle, nee and dle");
+  piece_table find_ptbl = create_piece_table(hay, strlen(hay));
+  ptbl_update_global_cursor_pos(&find_ptbl, 20);
+  ptbl_insert_text(&find_ptbl, "d", 1);
+  ptbl_insert_text(&find_ptbl, "le need", 7);
+  ptbl_snapshot snap;
+  ptbl_snapshot_take(&find_ptbl, &snap);
+  search_results found = {0};
+  search_literal(&snap, 0, snap.len, "needle", 6, &found);
+  printf("---------------------\nneedle at");
+  for (size_t i = 0; i < found.count; i++) {
+    printf(" %zu", found.offsets[i]);
+  }
+  printf("\n");
+
+  // regex matches come back as offset+length, straight off the pieces
+  const char *patterns[] = {"need.e", "ne+d(le)?", "^f\\w+", "[^ ,]+$"};
+  for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+    const char *rx_error = NULL;
+    rx_regex *rx =
+        rx_compile(patterns[p], strlen(patterns[p]), 0, &rx_error);
+    found.count = 0;
+    rx_search(rx, &snap, 0, snap.len, &found);
+    printf("%s at", patterns[p]);
+    for (size_t i = 0; i < found.count; i++) {
+      printf(" %zu+%zu", found.offsets[i], found.lens[i]);
+    }
+    printf("\n");
+    rx_free(rx);
+  }
+  ptbl_snapshot_release(&find_ptbl, &snap);
+
+  // edits only look for matches around themselves, the rest move along
+  search_index matches = {0};
+  ptbl_snapshot_take(&find_ptbl, &snap);
+  found.count = 0;
+  search_literal(&snap, 0, snap.len, "ne", 2, &found);
+  search_index_append(&matches, &found);
+  ptbl_snapshot_release(&find_ptbl, &snap);
+  ptbl_take_edit(&find_ptbl, &edit_start, &edit_removed, &edit_inserted);
+  ptbl_delete_range(&find_ptbl, 4, 5); // "find needle" -> "findneedle"
+  ptbl_update_global_cursor_pos(&find_ptbl, 0);
+  ptbl_insert_text(&find_ptbl, "n", 1);
+  ptbl_update_global_cursor_pos(&find_ptbl, 1); // "nefind..."
+  ptbl_insert_text(&find_ptbl, "e", 1);
+  ptbl_take_edit(&find_ptbl, &edit_start, &edit_removed, &edit_inserted);
+  ptbl_snapshot_take(&find_ptbl, &snap);
+  search_index_update(&matches, &snap, edit_start, edit_removed,
+                      edit_inserted, "ne", 2, NULL);
+  ptbl_snapshot_release(&find_ptbl, &snap);
+  printf("ne at");
+  for (size_t i = 0; i < matches.count; i++) {
+    size_t offset, len;
+    search_index_get(&matches, i, &offset, &len);
+    printf(" %zu", offset);
+  }
+  printf("\n");
+  search_index_free(&matches);
+
+  // replace-all rebuilds the pieces in a single pass
+  ptbl_snapshot_take(&find_ptbl, &snap);
+  found.count = 0;
+  search_literal(&snap, 0, snap.len, "ne", 2, &found);
+  ptbl_snapshot_release(&find_ptbl, &snap);
+  ptbl_replace_all(&find_ptbl, found.offsets, found.lens, found.count, "N", 1);
+  char replaced[64];
+  size_t replaced_len = ptbl_copy_range(&find_ptbl, 0, ptbl_length(&find_ptbl),
+                                        replaced);
+  printf("replaced: %.*s\n", (int)replaced_len, replaced);
+  free_piece_table(&find_ptbl);
+
+  // a replacement longer than its matches makes the text outgrow the buffers,
+  // deleting at the end afterwards stays within the text
+  char grow_text[] = "aaaaaaaaaa";
+  piece_table grow_ptbl = create_piece_table(grow_text, 10);
+  size_t grow_offsets[10], grow_lens[10];
+  for (size_t i = 0; i < 10; i++) {
+    grow_offsets[i] = i;
+    grow_lens[i] = 1;
+  }
+  ptbl_replace_all(&grow_ptbl, grow_offsets, grow_lens, 10, "XYZ", 3);
+  ptbl_update_global_cursor_pos(&grow_ptbl, ptbl_length(&grow_ptbl));
+  ptbl_delete_char(&grow_ptbl);
+  ptbl_delete_char(&grow_ptbl);
+  replaced_len = ptbl_copy_range(&grow_ptbl, 0, ptbl_length(&grow_ptbl),
+                                 replaced);
+  printf("grown: %.*s\n", (int)replaced_len, replaced);
+  free_piece_table(&grow_ptbl);
+  free(hay);
+
+  // the pool stitches regex matches running over its range boundaries back
+  // into the sequence a single scan finds
+  size_t pool_len = 3 * SEARCH_RANGE_BYTES;
+  char *pool_text = malloc(pool_len);
+  for (size_t i = 0; i < pool_len; i++) {
+    pool_text[i] = i % 4099 == 0 ? 'x' : 'a';
+  }
+  piece_table pool_ptbl = create_piece_table(pool_text, pool_len);
+  pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+  search_pool pool;
+  search_pool_start(&pool, &pool_ptbl, &pool_lock);
+  const char *pool_patterns[] = {"a+", "x", "a{3}|xa"};
+  for (size_t p = 0; p < sizeof(pool_patterns) / sizeof(pool_patterns[0]);
+       p++) {
+    bool regex = p != 1;
+    pthread_mutex_lock(&pool_lock);
+    search_pool_submit(&pool, "a", 1, false); // cancelled by the next one
+    search_pool_submit(&pool, pool_patterns[p], strlen(pool_patterns[p]),
+                       regex);
+    ptbl_snapshot_take(&pool_ptbl, &snap);
+    pthread_mutex_unlock(&pool_lock);
+    search_results streamed = {0};
+    size_t taken = 0;
+    while (search_pool_poll(&pool, &taken, &streamed)) {
+      usleep(1000);
+    }
+    search_pool_poll(&pool, &taken, &streamed);
+    found.count = 0;
+    if (regex) {
+      const char *rx_error = NULL;
+      rx_regex *rx = rx_compile(pool_patterns[p], strlen(pool_patterns[p]),
+                                0, &rx_error);
+      rx_search(rx, &snap, 0, snap.len, &found);
+      rx_free(rx);
+    } else {
+      search_literal(&snap, 0, snap.len, pool_patterns[p], 1, &found);
+    }
+    bool same = streamed.count == found.count;
+    for (size_t i = 0; same && i < found.count; i++) {
+      same = streamed.offsets[i] == found.offsets[i] &&
+             streamed.lens[i] == found.lens[i];
+    }
+    printf("pool %s: %zu matches, %s\n", pool_patterns[p], streamed.count,
+           same ? "same as one scan" : "DIFFERENT");
+    pthread_mutex_lock(&pool_lock);
+    ptbl_snapshot_release(&pool_ptbl, &snap);
+    pthread_mutex_unlock(&pool_lock);
+    search_results_free(&streamed);
+  }
+  search_pool_stop(&pool);
+  search_results_free(&found);
+  free_piece_table(&pool_ptbl);
+  free(pool_text);
+
   free_piece_table(&ptbl);
   free(buf);  // free the buffer
   fclose(fp); // close the file
@@ -0,0 +1,179 @@
+#include <assert.h>
+
+#include "../include/utf8.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define UTF8_X86 1
+#endif
+
+// how far back utf8_grapheme_start looks for a known boundary
+#define GRAPHEME_LOOKBACK 256
+
+int utf8_is_continuation(char c) { return ((unsigned char)c & 0xC0) == 0x80; }
+
+uint32_t utf8_decode(const char *s, size_t len, size_t *size_p) {
+  assert(len > 0);
+  const unsigned char *u = (const unsigned char *)s;
+  uint32_t cp;
+  size_t size;
+  if (u[0] < 0x80) {
+    *size_p = 1;
+    return u[0];
+  } else if ((u[0] & 0xE0) == 0xC0) {
+    cp = u[0] & 0x1F;
+    size = 2;
+  } else if ((u[0] & 0xF0) == 0xE0) {
+    cp = u[0] & 0x0F;
+    size = 3;
+  } else if ((u[0] & 0xF8) == 0xF0) {
+    cp = u[0] & 0x07;
+    size = 4;
+  } else {
+    *size_p = 1;
+    return UTF8_REPLACEMENT_CHAR;
+  }
+
+  if (size > len) {
+    *size_p = 1;
+    return UTF8_REPLACEMENT_CHAR;
+  }
+  for (size_t i = 1; i < size; i++) {
+    if (!utf8_is_continuation(s[i])) {
+      *size_p = 1;
+      return UTF8_REPLACEMENT_CHAR;
+    }
+    cp = (cp << 6) | (u[i] & 0x3F);
+  }
+  *size_p = size;
+  return cp;
+}
+
+// counts the bytes that aren't continuation bytes. Whole files go through
+// here on open, so blocks of 16 are counted into byte counters first
+size_t utf8_count_codepoints(const char *s, size_t len) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef UTF8_X86
+  // continuation bytes, 0x80 to 0xBF, are the signed bytes below -64
+  const __m128i limit = _mm_set1_epi8(-64);
+  while (len - i >= 16) {
+    size_t blocks = (len - i) / 16 < 255 ? (len - i) / 16 : 255;
+    __m128i counters = _mm_setzero_si128();
+    for (size_t b = 0; b < blocks; b++, i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+      counters = _mm_sub_epi8(counters, _mm_cmplt_epi8(block, limit));
+    }
+    __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+    size_t continuations = (size_t)_mm_cvtsi128_si64(sums) +
+                           (size_t)_mm_extract_epi16(sums, 4);
+    count += blocks * 16 - continuations;
+  }
+#endif
+  for (; i < len; i++) {
+    count += !utf8_is_continuation(s[i]);
+  }
+  return count;
+}
+
+// codepoints that never start a cluster of their own
+static int utf8_is_extend(uint32_t cp) {
+  return (cp >= 0x0300 && cp <= 0x036F) ||   // combining diacritics
+         (cp >= 0x1AB0 && cp <= 0x1AFF) ||   // combining diacritics ext.
+         (cp >= 0x1DC0 && cp <= 0x1DFF) ||   // combining diacritics supp.
+         (cp >= 0x20D0 && cp <= 0x20FF) ||   // combining marks for symbols
+         (cp >= 0xFE20 && cp <= 0xFE2F) ||   // combining half marks
+         (cp >= 0xFE00 && cp <= 0xFE0F) ||   // variation selectors
+         (cp >= 0xE0100 && cp <= 0xE01EF) || // variation selectors supp.
+         (cp >= 0x1F3FB && cp <= 0x1F3FF) || // emoji skin tone modifiers
+         (cp >= 0xE0020 && cp <= 0xE007F) || // emoji tag sequences
+         cp == 0x200C || cp == 0x200D;        // ZWNJ, ZWJ
+}
+
+static int utf8_is_wide(uint32_t cp) {
+  return (cp >= 0x1100 && cp <= 0x115F) ||   // hangul jamo
+         (cp >= 0x2E80 && cp <= 0x303E) ||   // CJK radicals, punctuation
+         (cp >= 0x3041 && cp <= 0x33FF) ||   // kana, CJK compatibility
+         (cp >= 0x3400 && cp <= 0x4DBF) ||   // CJK extension A
+         (cp >= 0x4E00 && cp <= 0x9FFF) ||   // CJK unified ideographs
+         (cp >= 0xA000 && cp <= 0xA4CF) ||   // yi
+         (cp >= 0xAC00 && cp <= 0xD7A3) ||   // hangul syllables
+         (cp >= 0xF900 && cp <= 0xFAFF) ||   // CJK compatibility ideographs
+         (cp >= 0xFE30 && cp <= 0xFE4F) ||   // CJK compatibility forms
+         (cp >= 0xFF00 && cp <= 0xFF60) ||   // fullwidth forms
+         (cp >= 0xFFE0 && cp <= 0xFFE6) ||   // fullwidth signs
+         (cp >= 0x1F300 && cp <= 0x1F64F) || // emoji
+         (cp >= 0x1F900 && cp <= 0x1F9FF) || // supplemental emoji
+         (cp >= 0x20000 && cp <= 0x3FFFD);   // CJK extensions B and up
+}
+
+int utf8_column_width(uint32_t cp) {
+  if (utf8_is_extend(cp)) {
+    return 0;
+  }
+  return utf8_is_wide(cp) ? 2 : 1;
+}
+
+static int utf8_is_regional_indicator(uint32_t cp) {
+  return cp >= 0x1F1E6 && cp <= 0x1F1FF;
+}
+
+size_t utf8_next_grapheme(const char *s, size_t len, size_t pos) {
+  if (pos >= len) {
+    return len;
+  }
+  size_t size;
+  uint32_t prev = utf8_decode(s + pos, len - pos, &size);
+  size_t i = pos + size;
+  size_t regional_indicators = utf8_is_regional_indicator(prev);
+  while (i < len) {
+    uint32_t cp = utf8_decode(s + i, len - i, &size);
+    int join = (prev == '\r' && cp == '\n') || utf8_is_extend(cp) ||
+               prev == 0x200D ||
+               (utf8_is_regional_indicator(cp) && regional_indicators % 2 == 1);
+    if (!join) {
+      break;
+    }
+    regional_indicators =
+        utf8_is_regional_indicator(cp) ? regional_indicators + 1 : 0;
+    prev = cp;
+    i += size;
+  }
+  return i;
+}
+
+// start of the cluster containing pos. Clusters are found by walking
+// forward from a point known to be a boundary, a line break or, for very long
+// lines, a codepoint start far enough back
+size_t utf8_grapheme_start(const char *s, size_t len, size_t pos) {
+  if (pos >= len) {
+    return len;
+  }
+  size_t start = pos > GRAPHEME_LOOKBACK ? pos - GRAPHEME_LOOKBACK : 0;
+  for (size_t i = pos; i > start; i--) {
+    if (s[i - 1] == '\n') {
+      start = i;
+      break;
+    }
+  }
+  while (start > 0 && utf8_is_continuation(s[start])) {
+    start--;
+  }
+
+  size_t boundary = start;
+  while (boundary < pos) {
+    size_t next = utf8_next_grapheme(s, len, boundary);
+    if (next > pos) {
+      break;
+    }
+    boundary = next;
+  }
+  return boundary;
+}
+
+size_t utf8_prev_grapheme(const char *s, size_t len, size_t pos) {
+  if (pos == 0) {
+    return 0;
+  }
+  return utf8_grapheme_start(s, len, pos - 1);
+}
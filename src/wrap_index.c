@@ -0,0 +1,753 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/line_scan.h"
+#include "../include/utf8.h"
+#include "../include/wrap_index.h"
+
+void wrap_begin(wrap_state *ws, size_t cols, size_t *starts,
+                size_t max_starts) {
+  *ws = (wrap_state){
+      .cols = cols > 0 ? cols : 1,
+      .rows = 1,
+      .starts = starts,
+      .max_starts = max_starts,
+  };
+  if (max_starts > 0) {
+    starts[0] = 0;
+  }
+}
+
+static void wrap_place(wrap_state *ws, uint32_t cp, size_t start) {
+  size_t width = cp == '\t' ? WRAP_TAB_SIZE : (size_t)utf8_column_width(cp);
+  while (ws->col + width > ws->cols && ws->col > 0) {
+    if (ws->break_pos > ws->row_start) {
+      ws->row_start = ws->break_pos;
+      ws->col -= ws->break_col;
+    } else {
+      ws->row_start = start;
+      ws->col = 0;
+    }
+    if (ws->rows < ws->max_starts) {
+      ws->starts[ws->rows] = ws->row_start;
+    }
+    ws->rows++;
+    ws->break_pos = ws->row_start;
+    ws->break_col = 0;
+  }
+  ws->col += width;
+  if (cp == ' ' || cp == '\t') {
+    ws->break_pos = start + 1;
+    ws->break_col = ws->col;
+  }
+}
+
+// decodes as it goes, a sequence cut short counts as one replacement
+// character starting at its lead byte
+void wrap_feed(wrap_state *ws, unsigned char c) {
+  size_t pos = ws->pos++;
+  if (ws->cp_need > 0) {
+    if ((c & 0xC0) == 0x80) {
+      ws->cp = (ws->cp << 6) | (c & 0x3F);
+      if (--ws->cp_need == 0) {
+        wrap_place(ws, ws->cp, ws->cp_start);
+      }
+      return;
+    }
+    ws->cp_need = 0;
+    wrap_place(ws, UTF8_REPLACEMENT_CHAR, ws->cp_start);
+  }
+
+  if (c < 0x80) {
+    wrap_place(ws, c, pos);
+    return;
+  }
+  ws->cp_start = pos;
+  if ((c & 0xE0) == 0xC0) {
+    ws->cp = c & 0x1F;
+    ws->cp_need = 1;
+  } else if ((c & 0xF0) == 0xE0) {
+    ws->cp = c & 0x0F;
+    ws->cp_need = 2;
+  } else if ((c & 0xF8) == 0xF0) {
+    ws->cp = c & 0x07;
+    ws->cp_need = 3;
+  } else {
+    wrap_place(ws, UTF8_REPLACEMENT_CHAR, pos);
+  }
+}
+
+void wrap_end(wrap_state *ws) {
+  if (ws->cp_need > 0) {
+    ws->cp_need = 0;
+    wrap_place(ws, UTF8_REPLACEMENT_CHAR, ws->cp_start);
+  }
+}
+
+// splits one line of text into visual rows, returns the number of rows and
+// fills starts with up to max_starts row start offsets
+size_t wrap_segments(const char *text, size_t len, size_t cols,
+                     size_t *starts, size_t max_starts) {
+  wrap_state ws;
+  wrap_begin(&ws, cols, starts, max_starts);
+  for (size_t i = 0; i < len; i++) {
+    wrap_feed(&ws, (unsigned char)text[i]);
+  }
+  wrap_end(&ws);
+  return ws.rows;
+}
+
+// Sequential reader over the table text
+typedef struct {
+  piece_table *ptbl_p;
+  pl_node *node;
+  const char *chars;
+  size_t index;
+} wi_reader;
+
+static void wi_reader_seek(wi_reader *r, piece_table *ptbl_p, size_t pos) {
+  size_t piece_start = 0;
+  pl_node *iter = ptbl_p->piece_list_head_p;
+  while (iter != NULL && piece_start + iter->p.len <= pos) {
+    piece_start += iter->p.len;
+    iter = iter->next_node_p;
+  }
+  *r = (wi_reader){
+      .ptbl_p = ptbl_p,
+      .node = iter,
+      .chars = iter != NULL ? ptbl_piece_chars(ptbl_p, &iter->p) : NULL,
+      .index = iter != NULL ? pos - piece_start : 0,
+  };
+}
+
+static void wi_reader_next_piece(wi_reader *r) {
+  r->node = r->node->next_node_p;
+  r->chars = r->node != NULL ? ptbl_piece_chars(r->ptbl_p, &r->node->p) : NULL;
+  r->index = 0;
+}
+
+// consumes the rest of a line, returns whether it ended in a line break
+static int wi_skip_line(wi_reader *r, size_t *bytes_p) {
+  size_t bytes = 0;
+  while (r->node != NULL) {
+    size_t left = r->node->p.len - r->index;
+    const char *newline = memchr(r->chars + r->index, '\n', left);
+    if (newline != NULL) {
+      size_t used = newline - (r->chars + r->index) + 1;
+      bytes += used;
+      r->index += used;
+      if (r->index == r->node->p.len) {
+        wi_reader_next_piece(r);
+      }
+      *bytes_p = bytes;
+      return 1;
+    }
+    bytes += left;
+    wi_reader_next_piece(r);
+  }
+  *bytes_p = bytes;
+  return 0;
+}
+
+// wraps the line at the reader, returns whether it ended in a line break
+static int wi_measure_line(wi_reader *r, size_t cols, size_t *rows_p,
+                           size_t *bytes_p) {
+  wrap_state ws;
+  wrap_begin(&ws, cols, NULL, 0);
+  size_t bytes = 0;
+  int newline = 0;
+  while (r->node != NULL && !newline) {
+    size_t len = r->node->p.len;
+    while (r->index < len) {
+      char c = r->chars[r->index++];
+      bytes++;
+      if (c == '\n') {
+        newline = 1;
+        break;
+      }
+      wrap_feed(&ws, (unsigned char)c);
+    }
+    if (r->index == len) {
+      wi_reader_next_piece(r);
+    }
+  }
+  wrap_end(&ws);
+  *rows_p = ws.rows;
+  *bytes_p = bytes;
+  return newline;
+}
+
+// finds where the line ends with line_scan and only wraps it byte by byte
+// when it may not fit in one row. Codepoints other than tabs never take more
+// columns than they have bytes, so a short line without many tabs is one row
+static int wi_scan_line(wi_reader *r, size_t cols, size_t *rows_p,
+                        size_t *bytes_p) {
+  wi_reader start = *r;
+  size_t bytes = 0;
+  size_t tabs = 0;
+  while (r->node != NULL) {
+    size_t left = r->node->p.len - r->index;
+    size_t span = left < cols + 1 - bytes ? left : cols + 1 - bytes;
+    size_t at = line_scan_next(r->chars + r->index, span, &tabs);
+    bytes += at;
+    if (bytes + tabs * (WRAP_TAB_SIZE - 1) > cols) {
+      *r = start;
+      return wi_measure_line(r, cols, rows_p, bytes_p);
+    }
+    if (at < span) {
+      r->index += at + 1;
+      if (r->index == r->node->p.len) {
+        wi_reader_next_piece(r);
+      }
+      *rows_p = 1;
+      *bytes_p = bytes + 1;
+      return 1;
+    }
+    wi_reader_next_piece(r);
+  }
+  *rows_p = 1;
+  *bytes_p = bytes;
+  return 0;
+}
+
+// Growable per entry results, line counts are only kept when grouped
+typedef struct {
+  size_t *rows;
+  size_t *bytes;
+  size_t *lines;
+  size_t count;
+  size_t cap;
+  bool grouped;
+} wi_lines;
+
+static void wi_lines_push(wi_lines *lines, size_t rows, size_t bytes,
+                          size_t num_lines) {
+  if (lines->count == lines->cap) {
+    lines->cap = lines->cap > 0 ? lines->cap * 2 : 64;
+    lines->rows = realloc(lines->rows, lines->cap * sizeof(size_t));
+    lines->bytes = realloc(lines->bytes, lines->cap * sizeof(size_t));
+    if (lines->grouped) {
+      lines->lines = realloc(lines->lines, lines->cap * sizeof(size_t));
+    }
+    if (lines->rows == NULL || lines->bytes == NULL ||
+        (lines->grouped && lines->lines == NULL)) {
+      fprintf(stderr, "Error: wrap index allocation failed");
+      exit(1);
+    }
+  }
+  lines->rows[lines->count] = rows;
+  lines->bytes[lines->count] = bytes;
+  if (lines->grouped) {
+    lines->lines[lines->count] = num_lines;
+  }
+  lines->count++;
+}
+
+static void wi_lines_free(wi_lines *lines) {
+  free(lines->rows);
+  free(lines->bytes);
+  free(lines->lines);
+}
+
+static void wi_tree_build(size_t *tree, const size_t *vals, size_t n) {
+  for (size_t i = 1; i <= n; i++) {
+    tree[i] = vals[i - 1];
+  }
+  for (size_t i = 1; i <= n; i++) {
+    size_t parent = i + (i & (~i + 1));
+    if (parent <= n) {
+      tree[parent] += tree[i];
+    }
+  }
+}
+
+// delta wraps around for decreases, the sums come out right all the same
+static void wi_tree_add(size_t *tree, size_t n, size_t i, size_t delta) {
+  for (; i <= n; i += i & (~i + 1)) {
+    tree[i] += delta;
+  }
+}
+
+static size_t wi_tree_prefix(const size_t *tree, size_t i) {
+  size_t sum = 0;
+  for (; i > 0; i -= i & (~i + 1)) {
+    sum += tree[i];
+  }
+  return sum;
+}
+
+// appends val as entry n + 1 in O(log n), the node covers the entries after
+// the last one its lowest bit skips
+static void wi_tree_push(size_t *tree, size_t n, size_t val) {
+  size_t i = n + 1;
+  tree[i] = val + wi_tree_prefix(tree, n) -
+            wi_tree_prefix(tree, i - (i & (~i + 1)));
+}
+
+// largest i with a prefix sum of at most target
+static size_t wi_tree_search(const size_t *tree, size_t n, size_t target) {
+  size_t step = 1;
+  while (step * 2 <= n) {
+    step *= 2;
+  }
+  size_t i = 0;
+  for (; step > 0; step /= 2) {
+    if (i + step <= n && tree[i + step] <= target) {
+      i += step;
+      target -= tree[i];
+    }
+  }
+  return i;
+}
+
+static void wi_reserve(wrap_index *wi, size_t num_entries) {
+  if (num_entries <= wi->cap && (!wi->sparse || wi->lines != NULL)) {
+    return;
+  }
+  size_t cap = wi->cap > 0 ? wi->cap : 64;
+  while (cap < num_entries) {
+    cap *= 2;
+  }
+  wi->rows = realloc(wi->rows, cap * sizeof(size_t));
+  wi->bytes = realloc(wi->bytes, cap * sizeof(size_t));
+  wi->row_tree = realloc(wi->row_tree, (cap + 1) * sizeof(size_t));
+  wi->byte_tree = realloc(wi->byte_tree, (cap + 1) * sizeof(size_t));
+  if (wi->sparse) {
+    wi->lines = realloc(wi->lines, cap * sizeof(size_t));
+    wi->line_tree = realloc(wi->line_tree, (cap + 1) * sizeof(size_t));
+  }
+  if (wi->rows == NULL || wi->bytes == NULL || wi->row_tree == NULL ||
+      wi->byte_tree == NULL ||
+      (wi->sparse && (wi->lines == NULL || wi->line_tree == NULL))) {
+    fprintf(stderr, "Error: wrap index allocation failed");
+    exit(1);
+  }
+  wi->cap = cap;
+}
+
+static void wi_rebuild_trees(wrap_index *wi) {
+  wi_tree_build(wi->row_tree, wi->rows, wi->num_entries);
+  wi_tree_build(wi->byte_tree, wi->bytes, wi->num_entries);
+  if (wi->sparse) {
+    wi_tree_build(wi->line_tree, wi->lines, wi->num_entries);
+  }
+}
+
+static void wi_forget_blocks(wrap_index *wi) {
+  for (size_t i = 0; i < WRAP_BLOCK_CACHE; i++) {
+    wi->cache[i].block = 0;
+  }
+}
+
+void wrap_index_free(wrap_index *wi) {
+  free(wi->rows);
+  free(wi->bytes);
+  free(wi->lines);
+  free(wi->row_tree);
+  free(wi->byte_tree);
+  free(wi->line_tree);
+  *wi = (wrap_index){0};
+}
+
+// Bulk build job, measures the lines that start in [chunk_start, chunk_end)
+typedef struct {
+  piece_table *ptbl_p;
+  size_t cols;
+  size_t chunk_start;
+  size_t chunk_end;
+  size_t group; // lines per entry
+  wi_lines lines;
+} wi_job;
+
+static void *wi_build_worker(void *arg) {
+  wi_job *job = (wi_job *)arg;
+  wi_reader r;
+  size_t line_start = job->chunk_start;
+  if (job->chunk_start > 0) {
+    // the line running into the chunk belongs to the previous job
+    size_t skipped;
+    wi_reader_seek(&r, job->ptbl_p, job->chunk_start - 1);
+    if (!wi_skip_line(&r, &skipped)) {
+      return NULL;
+    }
+    line_start = job->chunk_start - 1 + skipped;
+  } else {
+    wi_reader_seek(&r, job->ptbl_p, 0);
+  }
+
+  size_t entry_rows = 0;
+  size_t entry_bytes = 0;
+  size_t entry_lines = 0;
+  while (line_start < job->chunk_end) {
+    size_t rows, bytes;
+    int newline = wi_scan_line(&r, job->cols, &rows, &bytes);
+    entry_rows += rows;
+    entry_bytes += bytes;
+    if (++entry_lines == job->group) {
+      wi_lines_push(&job->lines, entry_rows, entry_bytes, entry_lines);
+      entry_rows = entry_bytes = entry_lines = 0;
+    }
+    line_start += bytes;
+    if (!newline) {
+      break;
+    }
+  }
+  if (entry_lines > 0) {
+    wi_lines_push(&job->lines, entry_rows, entry_bytes, entry_lines);
+  }
+  return NULL;
+}
+
+// recounts every line, splitting the table between worker threads. The
+// caller keeps the table from changing until this returns. Large tables, or
+// ones expected to grow large (a file still being loaded), switch to a
+// sparse index, small ones back to a dense one
+void wrap_index_build(wrap_index *wi, piece_table *ptbl_p, size_t cols,
+                      size_t expected_len) {
+  size_t len = ptbl_length(ptbl_p);
+  wi->sparse = (len > expected_len ? len : expected_len) >=
+               WRAP_SPARSE_MIN_BYTES;
+  wi->ptbl_p = ptbl_p;
+  if (!wi->sparse) {
+    free(wi->lines);
+    free(wi->line_tree);
+    wi->lines = wi->line_tree = NULL;
+  }
+  size_t num_jobs = 1;
+  if (len >= WRAP_PARALLEL_MIN_BYTES) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_jobs = cpus < 1 ? 1 : (size_t)cpus;
+    num_jobs = num_jobs > WRAP_MAX_THREADS ? WRAP_MAX_THREADS : num_jobs;
+  }
+
+  wi_job jobs[WRAP_MAX_THREADS];
+  pthread_t threads[WRAP_MAX_THREADS];
+  size_t chunk = len / num_jobs;
+  for (size_t i = 0; i < num_jobs; i++) {
+    jobs[i] = (wi_job){
+        .ptbl_p = ptbl_p,
+        .cols = cols > 0 ? cols : 1,
+        .chunk_start = i * chunk,
+        // the last job also owns the empty line after a trailing line break
+        .chunk_end = i + 1 == num_jobs ? len + 1 : (i + 1) * chunk,
+        .group = wi->sparse ? WRAP_CHECKPOINT_LINES : 1,
+        .lines = {.grouped = wi->sparse},
+    };
+  }
+  for (size_t i = 1; i < num_jobs; i++) {
+    if (pthread_create(&threads[i], NULL, wi_build_worker, &jobs[i]) != 0) {
+      fprintf(stderr, "Error: wrap index thread creation failed");
+      exit(1);
+    }
+  }
+  wi_build_worker(&jobs[0]);
+  for (size_t i = 1; i < num_jobs; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  size_t num_entries = 0;
+  for (size_t i = 0; i < num_jobs; i++) {
+    num_entries += jobs[i].lines.count;
+  }
+  wi_reserve(wi, num_entries);
+  wi->num_entries = 0;
+  wi->num_lines = 0;
+  for (size_t i = 0; i < num_jobs; i++) {
+    wi_lines *lines = &jobs[i].lines;
+    size_t at = wi->num_entries;
+    memcpy(wi->rows + at, lines->rows, lines->count * sizeof(size_t));
+    memcpy(wi->bytes + at, lines->bytes, lines->count * sizeof(size_t));
+    if (wi->sparse) {
+      memcpy(wi->lines + at, lines->lines, lines->count * sizeof(size_t));
+      for (size_t j = 0; j < lines->count; j++) {
+        wi->num_lines += lines->lines[j];
+      }
+    } else {
+      wi->num_lines += lines->count;
+    }
+    wi->num_entries += lines->count;
+    wi_lines_free(lines);
+  }
+  wi->cols = cols > 0 ? cols : 1;
+  wi_rebuild_trees(wi);
+  wi_forget_blocks(wi);
+}
+
+// entry holding pos, the last one for positions past the end
+static size_t wi_entry_of_pos(wrap_index *wi, size_t pos) {
+  size_t i = wi_tree_search(wi->byte_tree, wi->num_entries, pos);
+  return i < wi->num_entries ? i : wi->num_entries - 1;
+}
+
+// checkpoint block holding a line, *k_p receives the line's index in it
+static size_t wi_block_of_line(wrap_index *wi, size_t line, size_t *k_p) {
+  size_t i = wi_tree_search(wi->line_tree, wi->num_entries, line - 1);
+  i = i < wi->num_entries ? i : wi->num_entries - 1;
+  *k_p = line - 1 - wi_tree_prefix(wi->line_tree, i);
+  return i;
+}
+
+// per line counts of checkpoint block i, measured from the table unless a
+// recent query already did. While the table has an edit the index hasn't
+// taken in, lines move under the blocks and nothing measured is kept
+static wrap_block *wi_block(wrap_index *wi, size_t i) {
+  wrap_block *wb = &wi->cache[i % WRAP_BLOCK_CACHE];
+  if (wb->block != i + 1) {
+    wi_reader r;
+    wi_reader_seek(&r, wi->ptbl_p, wi_tree_prefix(wi->byte_tree, i));
+    for (size_t k = 0; k < wi->lines[i]; k++) {
+      wi_scan_line(&r, wi->cols, &wb->rows[k], &wb->bytes[k]);
+    }
+    wb->block = wi->ptbl_p->edit_pending ? 0 : i + 1;
+  }
+  return wb;
+}
+
+// sparse wrap_index_splice. The checkpoint blocks the edit touched are
+// measured again and their lines shared out between as many blocks as
+// before, unless that leaves a block empty or over twice
+// WRAP_CHECKPOINT_LINES long
+static void wi_splice_blocks(wrap_index *wi, piece_table *ptbl_p, size_t start,
+                             size_t removed, size_t inserted) {
+  size_t first = wi_entry_of_pos(wi, start);
+  size_t last = wi_entry_of_pos(wi, start + removed);
+  size_t pos = wi_tree_prefix(wi->byte_tree, first);
+  size_t end = wi_tree_prefix(wi->byte_tree, last + 1) - removed + inserted;
+  bool to_end = last + 1 == wi->num_entries; // takes in the last empty line
+
+  wi_lines lines = {0};
+  wi_reader r;
+  wi_reader_seek(&r, ptbl_p, pos);
+  for (;;) {
+    size_t rows, bytes;
+    int newline = wi_scan_line(&r, wi->cols, &rows, &bytes);
+    wi_lines_push(&lines, rows, bytes, 1);
+    pos += bytes;
+    if (!newline || (!to_end && pos >= end)) {
+      break;
+    }
+  }
+
+  size_t old_count = last - first + 1;
+  size_t old_lines = wi_tree_prefix(wi->line_tree, last + 1) -
+                     wi_tree_prefix(wi->line_tree, first);
+  size_t count = old_count;
+  if (lines.count < count ||
+      lines.count > count * 2 * WRAP_CHECKPOINT_LINES) {
+    count = (lines.count + WRAP_CHECKPOINT_LINES - 1) / WRAP_CHECKPOINT_LINES;
+  }
+  if (count != old_count) {
+    size_t num_entries = wi->num_entries - old_count + count;
+    wi_reserve(wi, num_entries);
+    size_t tail = wi->num_entries - last - 1;
+    memmove(wi->rows + first + count, wi->rows + last + 1,
+            tail * sizeof(size_t));
+    memmove(wi->bytes + first + count, wi->bytes + last + 1,
+            tail * sizeof(size_t));
+    memmove(wi->lines + first + count, wi->lines + last + 1,
+            tail * sizeof(size_t));
+    wi->num_entries = num_entries;
+  }
+
+  size_t k = 0;
+  for (size_t b = 0; b < count; b++) {
+    size_t take = lines.count / count + (b < lines.count % count);
+    size_t rows = 0;
+    size_t bytes = 0;
+    for (size_t j = 0; j < take; j++, k++) {
+      rows += lines.rows[k];
+      bytes += lines.bytes[k];
+    }
+    size_t i = first + b;
+    if (count == old_count) {
+      wi_tree_add(wi->row_tree, wi->num_entries, i + 1, rows - wi->rows[i]);
+      wi_tree_add(wi->byte_tree, wi->num_entries, i + 1,
+                  bytes - wi->bytes[i]);
+      wi_tree_add(wi->line_tree, wi->num_entries, i + 1, take - wi->lines[i]);
+    }
+    wi->rows[i] = rows;
+    wi->bytes[i] = bytes;
+    wi->lines[i] = take;
+  }
+  if (count != old_count) {
+    wi_rebuild_trees(wi);
+  }
+  wi_forget_blocks(wi);
+  wi->num_lines = wi->num_lines - old_lines + lines.count;
+  wi_lines_free(&lines);
+}
+
+// catches up on an edit that turned [start, start + removed) of the old
+// text into [start, start + inserted). Only the lines the edit touched are
+// measured again
+void wrap_index_splice(wrap_index *wi, piece_table *ptbl_p, size_t start,
+                       size_t removed, size_t inserted) {
+  if (wi->sparse) {
+    wi_splice_blocks(wi, ptbl_p, start, removed, inserted);
+    return;
+  }
+  size_t first = wrap_index_line_of_pos(wi, start);
+  size_t last = wrap_index_line_of_pos(wi, start + removed);
+  size_t pos = wrap_index_line_start(wi, first);
+  size_t edit_end = start + inserted;
+
+  wi_lines lines = {0};
+  wi_reader r;
+  wi_reader_seek(&r, ptbl_p, pos);
+  for (;;) {
+    size_t rows, bytes;
+    int newline = wi_scan_line(&r, wi->cols, &rows, &bytes);
+    wi_lines_push(&lines, rows, bytes, 1);
+    pos += bytes;
+    if (!newline || pos > edit_end) {
+      break;
+    }
+  }
+
+  size_t old_count = last - first + 1;
+  // lines added at the end, as when a followed file grows, are pushed onto
+  // the trees instead of rebuilding them
+  bool grown = last == wi->num_lines && lines.count > old_count;
+  if (lines.count == old_count || grown) {
+    for (size_t i = 0; i < old_count; i++) {
+      size_t line = first + i;
+      wi_tree_add(wi->row_tree, wi->num_lines, line,
+                  lines.rows[i] - wi->rows[line - 1]);
+      wi_tree_add(wi->byte_tree, wi->num_lines, line,
+                  lines.bytes[i] - wi->bytes[line - 1]);
+      wi->rows[line - 1] = lines.rows[i];
+      wi->bytes[line - 1] = lines.bytes[i];
+    }
+    wi_reserve(wi, first - 1 + lines.count);
+    for (size_t i = old_count; i < lines.count; i++) {
+      wi_tree_push(wi->row_tree, wi->num_lines, lines.rows[i]);
+      wi_tree_push(wi->byte_tree, wi->num_lines, lines.bytes[i]);
+      wi->rows[wi->num_lines] = lines.rows[i];
+      wi->bytes[wi->num_lines] = lines.bytes[i];
+      wi->num_lines++;
+    }
+    wi->num_entries = wi->num_lines;
+  } else {
+    // lines came or went, shift the tail and rebuild the trees in O(n)
+    size_t num_lines = wi->num_lines - old_count + lines.count;
+    wi_reserve(wi, num_lines);
+    size_t tail = wi->num_lines - last;
+    memmove(wi->rows + first - 1 + lines.count, wi->rows + last,
+            tail * sizeof(size_t));
+    memmove(wi->bytes + first - 1 + lines.count, wi->bytes + last,
+            tail * sizeof(size_t));
+    memcpy(wi->rows + first - 1, lines.rows, lines.count * sizeof(size_t));
+    memcpy(wi->bytes + first - 1, lines.bytes, lines.count * sizeof(size_t));
+    wi->num_lines = num_lines;
+    wi->num_entries = num_lines;
+    wi_rebuild_trees(wi);
+  }
+  wi_lines_free(&lines);
+}
+
+size_t wrap_index_rows(wrap_index *wi, size_t line) {
+  if (line < 1 || line > wi->num_lines) {
+    return 1;
+  }
+  if (!wi->sparse) {
+    return wi->rows[line - 1];
+  }
+  size_t k;
+  size_t i = wi_block_of_line(wi, line, &k);
+  return wi_block(wi, i)->rows[k];
+}
+
+size_t wrap_index_total_rows(wrap_index *wi) {
+  return wi_tree_prefix(wi->row_tree, wi->num_entries);
+}
+
+size_t wrap_index_row_of_line(wrap_index *wi, size_t line) {
+  if (line > wi->num_lines) {
+    return wrap_index_total_rows(wi);
+  }
+  if (line == 0) {
+    return 0;
+  }
+  if (!wi->sparse) {
+    return wi_tree_prefix(wi->row_tree, line - 1);
+  }
+  size_t k;
+  size_t i = wi_block_of_line(wi, line, &k);
+  wrap_block *wb = wi_block(wi, i);
+  size_t row = wi_tree_prefix(wi->row_tree, i);
+  for (size_t j = 0; j < k; j++) {
+    row += wb->rows[j];
+  }
+  return row;
+}
+
+// line shown at a visual row, rows past the end land on the last line
+size_t wrap_index_line_at_row(wrap_index *wi, size_t row, size_t *sub_row_p) {
+  if (wi->num_lines == 0) {
+    if (sub_row_p != NULL) {
+      *sub_row_p = 0;
+    }
+    return 1;
+  }
+  size_t before = wi_tree_search(wi->row_tree, wi->num_entries, row);
+  if (before >= wi->num_entries) {
+    before = wi->num_entries - 1;
+  }
+  size_t sub_row = row - wi_tree_prefix(wi->row_tree, before);
+  size_t line = before + 1;
+  size_t rows = wi->rows[before];
+  if (wi->sparse) {
+    wrap_block *wb = wi_block(wi, before);
+    size_t k = 0;
+    while (k + 1 < wi->lines[before] && sub_row >= wb->rows[k]) {
+      sub_row -= wb->rows[k++];
+    }
+    line = wi_tree_prefix(wi->line_tree, before) + k + 1;
+    rows = wb->rows[k];
+  }
+  if (sub_row_p != NULL) {
+    *sub_row_p = sub_row < rows ? sub_row : rows - 1;
+  }
+  return line;
+}
+
+size_t wrap_index_line_start(wrap_index *wi, size_t line) {
+  if (line > wi->num_lines) {
+    line = wi->num_lines;
+  }
+  if (line == 0) {
+    return 0;
+  }
+  if (!wi->sparse) {
+    return wi_tree_prefix(wi->byte_tree, line - 1);
+  }
+  size_t k;
+  size_t i = wi_block_of_line(wi, line, &k);
+  wrap_block *wb = wi_block(wi, i);
+  size_t pos = wi_tree_prefix(wi->byte_tree, i);
+  for (size_t j = 0; j < k; j++) {
+    pos += wb->bytes[j];
+  }
+  return pos;
+}
+
+size_t wrap_index_line_of_pos(wrap_index *wi, size_t pos) {
+  if (wi->num_lines == 0) {
+    return 1;
+  }
+  if (!wi->sparse) {
+    size_t before = wi_tree_search(wi->byte_tree, wi->num_lines, pos);
+    return before < wi->num_lines ? before + 1 : wi->num_lines;
+  }
+  size_t i = wi_entry_of_pos(wi, pos);
+  wrap_block *wb = wi_block(wi, i);
+  size_t offset = pos - wi_tree_prefix(wi->byte_tree, i);
+  size_t k = 0;
+  while (k + 1 < wi->lines[i] && offset >= wb->bytes[k]) {
+    offset -= wb->bytes[k++];
+  }
+  return wi_tree_prefix(wi->line_tree, i) + k + 1;
+}